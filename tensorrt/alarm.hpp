@@ -0,0 +1,275 @@
+#pragma once
+// Alarm events with temporal debouncing.
+//
+// A violation (a box of one of the alarm classes) raises an event only after it
+// was present in at least k of the last n inferred frames. With tracking the
+// window is kept per track id, otherwise per class. An event fires once when a
+// violation starts and again every `repeat_sec` while it lasts; it is
+// re-armed once the violation has been absent for n frames.
+//
+// Each event is one JSON line in <alarm_dir>/events.jsonl (stream, class, track,
+// confidence, box, frame index, stream time, wall-clock time, evidence paths).
+// The evidence (the annotated frame and a crop around the box, JPEG) is queued
+// on the background FrameWriter, so the output thread never encodes or writes
+// images itself.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection.hpp"
+#include "frame_sink.hpp"
+
+struct AlarmConfig
+{
+    std::set<std::string> classes = {"no_vest", "head"};
+    int k = 3, n = 5;         // violation in at least k of the last n inferred frames (n <= 32)
+    double repeat_sec = 30.0; // re-alert a lasting violation after this long (0 = once per violation)
+    bool save_frame = true, save_crop = true;
+    int jpeg_quality = 90;
+};
+
+// Comma-separated class names, e.g. "no_vest,head".
+inline std::set<std::string> parse_class_list(const std::string &s)
+{
+    std::set<std::string> out;
+    size_t start = 0;
+    while (start <= s.size())
+    {
+        size_t comma = s.find(',', start);
+        if (comma == std::string::npos)
+            comma = s.size();
+        if (comma > start)
+            out.insert(s.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return out;
+}
+
+inline std::string json_escape(const std::string &s)
+{
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+                out += c;
+        }
+    }
+    return out;
+}
+
+// UTC wall-clock time as 2024-01-31T12:34:56.789Z
+inline std::string iso_time_utc(std::chrono::system_clock::time_point t)
+{
+    std::time_t secs = std::chrono::system_clock::to_time_t(t);
+    int ms = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count() % 1000);
+    std::tm tm{};
+    gmtime_r(&secs, &tm);
+    char buf[40];
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, sizeof(buf) - n, ".%03dZ", ms);
+    return buf;
+}
+
+class AlarmEngine
+{
+public:
+    void configure(const AlarmConfig &cfg, const std::vector<std::string> &class_names, std::string stream, std::string dir,
+                   int log_level, std::string tag)
+    {
+        cfg_ = cfg;
+        cfg_.n = std::min(32, std::max(1, cfg_.n));
+        cfg_.k = std::min(cfg_.n, std::max(1, cfg_.k));
+        class_names_ = class_names;
+        alarm_class_.assign(class_names.size(), 0);
+        for (size_t i = 0; i < class_names.size(); ++i)
+            alarm_class_[i] = cfg_.classes.count(class_names[i]) ? 1 : 0;
+        stream_ = std::move(stream);
+        dir_ = std::move(dir);
+        log_level_ = log_level;
+        tag_ = std::move(tag);
+    }
+
+    bool is_alarm_class(int class_id) const
+    {
+        return class_id >= 0 && class_id < (int)alarm_class_.size() && alarm_class_[class_id];
+    }
+
+    // Feed the boxes of one inferred frame (annotated `frame`). With `debounce`
+    // false (independent images) every violation is an event. Returns the number
+    // of events raised. `box_scale` maps the boxes (and `frame`) to the original
+    // image for the event record, when the frame was decoded at reduced size.
+    int update(const std::vector<Detection> &dets, const cv::Mat &frame, size_t frame_idx, double time_sec, bool debounce,
+               FrameWriter &writer, float box_scale = 1.0f)
+    {
+        const int k = debounce ? cfg_.k : 1, n = debounce ? cfg_.n : 1;
+        const uint32_t mask = n >= 32 ? 0xFFFFFFFFu : ((1u << n) - 1);
+        ++round_;
+
+        // strongest violating box per key this frame
+        current_.clear();
+        for (const Detection &d : dets)
+        {
+            if (!is_alarm_class(d.class_id))
+                continue;
+            int64_t key = d.track_id >= 0 ? (int64_t)d.track_id : -1 - (int64_t)d.class_id;
+            auto it = std::find_if(current_.begin(), current_.end(), [key](const std::pair<int64_t, Detection> &p)
+                                   { return p.first == key; });
+            if (it == current_.end())
+                current_.emplace_back(key, d);
+            else if (d.score > it->second.score)
+                it->second = d;
+        }
+        for (auto &c : current_)
+        {
+            KeyState &st = states_[c.first];
+            st.history = (st.history << 1) | 1u;
+            st.round = round_;
+        }
+        for (auto it = states_.begin(); it != states_.end();)
+        {
+            if (it->second.round != round_)
+                it->second.history <<= 1;
+            if ((it->second.history & mask) == 0)
+                it = states_.erase(it); // absent for n frames: re-armed
+            else
+                ++it;
+        }
+
+        int raised = 0;
+        std::string frame_path;
+        for (auto &c : current_)
+        {
+            auto it = states_.find(c.first);
+            if (it == states_.end())
+                continue;
+            KeyState &st = it->second;
+            int hits = __builtin_popcount(st.history & mask);
+            if (hits < k)
+            {
+                ++debounced_;
+                continue;
+            }
+            if (debounce && st.fired && (cfg_.repeat_sec <= 0.0 || time_sec - st.last_event < cfg_.repeat_sec))
+                continue;
+            st.fired = true;
+            st.last_event = time_sec;
+            emit(c.second, hits, n, frame, frame_idx, time_sec, box_scale, frame_path, writer);
+            ++raised;
+        }
+        return raised;
+    }
+
+    uint64_t events() const { return events_; }
+
+    void close()
+    {
+        if (out_.is_open())
+            out_.close();
+        if (log_level_ >= 1 && (events_ > 0 || debounced_ > 0))
+            std::cout << tag_ << "Alarms: " << events_ << " events (" << dir_ << "/events.jsonl), "
+                      << debounced_ << " violations below " << cfg_.k << " of " << cfg_.n << " frames" << std::endl;
+    }
+
+private:
+    struct KeyState
+    {
+        uint32_t history = 0; // bit i: violation i inferred frames ago
+        uint64_t round = 0;   // last frame it was seen in
+        bool fired = false;
+        double last_event = 0.0;
+    };
+
+    void emit(const Detection &d, int hits, int n, const cv::Mat &frame, size_t frame_idx, double time_sec, float box_scale,
+              std::string &frame_path, FrameWriter &writer)
+    {
+        std::string cls = d.class_id >= 0 && d.class_id < (int)class_names_.size() ? class_names_[d.class_id] : std::to_string(d.class_id);
+        char base[4096];
+        snprintf(base, sizeof(base), "%s/alarm_t%06.0f_f%06zu", dir_.c_str(), time_sec, frame_idx + 1);
+        FrameFormat jpeg = {FrameFormat::Jpeg, cfg_.jpeg_quality};
+
+        // one full frame per frame, however many events it carries
+        if (cfg_.save_frame && frame_path.empty())
+        {
+            writer.write(frame, base, jpeg);
+            frame_path = std::string(base) + frame_format_ext(jpeg);
+        }
+        std::string crop_path;
+        if (cfg_.save_crop)
+        {
+            // box plus 20% margin, clipped to the frame
+            float mx = 0.2f * (d.x2 - d.x1), my = 0.2f * (d.y2 - d.y1);
+            int x1 = std::max(0, (int)(d.x1 - mx)), y1 = std::max(0, (int)(d.y1 - my));
+            int x2 = std::min(frame.cols, (int)(d.x2 + mx)), y2 = std::min(frame.rows, (int)(d.y2 + my));
+            if (x2 > x1 && y2 > y1)
+            {
+                std::string crop_base = std::string(base) + "_" + cls + (d.track_id >= 0 ? "_id" + std::to_string(d.track_id) : std::string()) + "_crop";
+                writer.write(frame(cv::Rect(x1, y1, x2 - x1, y2 - y1)), crop_base, jpeg);
+                crop_path = crop_base + frame_format_ext(jpeg);
+            }
+        }
+
+        if (!out_.is_open())
+        {
+            out_.open(dir_ + "/events.jsonl", std::ios::app);
+            if (!out_)
+                std::cerr << tag_ << "Failed to open " << dir_ << "/events.jsonl" << std::endl;
+        }
+        // the crop above is cut from `frame`; the record, like --results, is in original coordinates
+        char box[160];
+        snprintf(box, sizeof(box), "[%.1f,%.1f,%.1f,%.1f]", d.x1 * box_scale, d.y1 * box_scale, d.x2 * box_scale, d.y2 * box_scale);
+        char conf[32], when[32];
+        snprintf(conf, sizeof(conf), "%.3f", d.score);
+        snprintf(when, sizeof(when), "%.3f", time_sec);
+        std::string line = "{\"stream\":\"" + json_escape(stream_) + "\",\"class\":\"" + json_escape(cls) + "\",\"class_id\":" + std::to_string(d.class_id) +
+                           ",\"track\":" + std::to_string(d.track_id) + ",\"conf\":" + conf + ",\"box\":" + box +
+                           ",\"frame\":" + std::to_string(frame_idx) + ",\"hits\":" + std::to_string(hits) + ",\"window\":" + std::to_string(n);
+        line += std::string(",\"time_sec\":") + when + ",\"wall_time\":\"" + iso_time_utc(std::chrono::system_clock::now()) + "\"";
+        line += ",\"frame_path\":\"" + json_escape(frame_path) + "\",\"crop_path\":\"" + json_escape(crop_path) + "\"}\n";
+        out_ << line;
+        out_.flush(); // events are rare after debouncing; keep the file current for tailing
+        ++events_;
+        if (log_level_ >= 1)
+            std::cout << tag_ << "ALARM " << cls << (d.track_id >= 0 ? " #" + std::to_string(d.track_id) : std::string())
+                      << " conf " << conf << " at t=" << time_sec << "s (" << hits << "/" << n << " frames)" << std::endl;
+    }
+
+    AlarmConfig cfg_;
+    std::vector<std::string> class_names_;
+    std::vector<uint8_t> alarm_class_;
+    std::string stream_, dir_, tag_;
+    int log_level_ = 1;
+    std::unordered_map<int64_t, KeyState> states_; // track id, or -1 - class id without tracking
+    std::vector<std::pair<int64_t, Detection>> current_;
+    uint64_t round_ = 0, events_ = 0, debounced_ = 0;
+    std::ofstream out_;
+};
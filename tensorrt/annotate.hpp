@@ -0,0 +1,35 @@
+#pragma once
+// Box and label drawing for the output frames: alarm classes red, others green,
+// labels "cls:score" or "cls #track:score" above the box.
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection.hpp"
+
+// `is_alarm(class_id)` picks the colour. Returns true if any alarm-class box was drawn.
+template <typename IsAlarm>
+bool draw_detections(cv::Mat &frame, const std::vector<Detection> &dets, const std::vector<std::string> &class_names, IsAlarm is_alarm)
+{
+    bool alarm = false;
+    char lbl[128];
+    for (const Detection &d : dets)
+    {
+        const char *cls = d.class_id >= 0 && d.class_id < (int)class_names.size() ? class_names[d.class_id].c_str() : nullptr;
+        bool is_alarm_class = is_alarm(d.class_id);
+        alarm = alarm || is_alarm_class;
+        cv::Scalar color = is_alarm_class ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0);
+        cv::rectangle(frame, cv::Point((int)d.x1, (int)d.y1), cv::Point((int)d.x2, (int)d.y2), color, 2);
+        int n = cls ? snprintf(lbl, sizeof(lbl), "%s", cls) : snprintf(lbl, sizeof(lbl), "%d", d.class_id);
+        n = std::min(n, (int)sizeof(lbl) - 1);
+        if (d.track_id >= 0)
+            snprintf(lbl + n, sizeof(lbl) - n, " #%d:%.2f", d.track_id, d.score);
+        else
+            snprintf(lbl + n, sizeof(lbl) - n, ":%.2f", d.score);
+        cv::putText(frame, lbl, cv::Point(std::max(0, (int)d.x1), std::max(15, (int)d.y1) - 5), cv::FONT_HERSHEY_SIMPLEX, 0.5, color, 1);
+    }
+    return alarm;
+}
@@ -0,0 +1,35 @@
+#pragma once
+// Selects an InferenceBackend by name (--backend). TensorRT is optional at
+// compile time: build with -DHELMET_WITH_TENSORRT=0 on machines without CUDA.
+#include <memory>
+#include <string>
+
+#include "dnn_backend.hpp"
+#include "inference_backend.hpp"
+
+#ifndef HELMET_WITH_TENSORRT
+#define HELMET_WITH_TENSORRT 1
+#endif
+
+#if HELMET_WITH_TENSORRT
+#include "trt_backend.hpp"
+#endif
+
+inline const char *default_backend_name()
+{
+    return HELMET_WITH_TENSORRT ? "trt" : "dnn";
+}
+
+// trt | dnn | stub; returns nullptr for unknown or not-compiled-in names.
+inline std::unique_ptr<InferenceBackend> make_inference_backend(const std::string &name)
+{
+#if HELMET_WITH_TENSORRT
+    if (name == "trt")
+        return std::make_unique<TrtBackend>();
+#endif
+    if (name == "dnn")
+        return std::make_unique<DnnBackend>();
+    if (name == "stub")
+        return std::make_unique<StubBackend>();
+    return nullptr;
+}
@@ -0,0 +1,87 @@
+#pragma once
+// Synthetic inputs shared by trt_bench and trt_bench_suite. Deterministic
+// (fixed LCG seeds), so runs on different machines and releases see the same data.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection.hpp"
+
+inline cv::Mat synthetic_frame(int w, int h)
+{
+    cv::Mat img(h, w, CV_8UC3);
+    uint32_t s = 12345;
+    for (int y = 0; y < h; ++y)
+    {
+        uint8_t *row = img.ptr<uint8_t>(y);
+        for (int x = 0; x < w * 3; ++x)
+        {
+            s = s * 1664525u + 1013904223u;
+            // smooth gradient plus noise, closer to camera content than pure noise
+            row[x] = (uint8_t)(((x / 3 + y) & 0xFF) / 2 + ((s >> 24) & 0x7F));
+        }
+    }
+    return img;
+}
+
+// Synthetic YOLOv8 head output: mostly background anchors, ~`hit_rate` above threshold.
+inline std::vector<float> synthetic_output(int C, int L, int input_w, int input_h, float hit_rate, bool logits)
+{
+    std::vector<float> out((size_t)C * L);
+    uint32_t s = 2024;
+    auto rnd = [&s]()
+    {
+        s = s * 1664525u + 1013904223u;
+        return (s >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int i = 0; i < L; ++i)
+    {
+        out[i] = rnd() * input_w;
+        out[L + i] = rnd() * input_h;
+        out[2 * (size_t)L + i] = 8.0f + rnd() * 120.0f;
+        out[3 * (size_t)L + i] = 8.0f + rnd() * 120.0f;
+    }
+    for (int c = 4; c < C; ++c)
+    {
+        for (int i = 0; i < L; ++i)
+        {
+            float p = rnd() < hit_rate ? 0.3f + 0.7f * rnd() : 0.05f * rnd();
+            out[(size_t)c * L + i] = logits ? std::log(p / (1.0f - p)) : p;
+        }
+    }
+    return out;
+}
+
+// Crowded-scene candidates: clusters of jittered boxes (several per worker, as a
+// low --conf produces) spread over a 1920x1080 frame, distinct scores.
+inline void synthetic_candidates(int n, int num_classes, DetectionBuffer &buf, std::vector<Detection> &list)
+{
+    uint32_t s = 99;
+    auto rnd = [&s]()
+    {
+        s = s * 1664525u + 1013904223u;
+        return (s >> 8) * (1.0f / 16777216.0f);
+    };
+    int clusters = std::max(1, n / 8);
+    buf.clear();
+    buf.reserve(n);
+    list.clear();
+    std::vector<float> scores(n);
+    for (int i = 0; i < n; ++i)
+        scores[i] = (i + 0.5f) / n;
+    for (int i = n - 1; i > 0; --i)
+        std::swap(scores[i], scores[(int)(rnd() * (i + 1)) % (i + 1)]);
+    for (int i = 0; i < n; ++i)
+    {
+        int k = (int)(rnd() * clusters) % clusters;
+        float cx = 20.0f + (float)((k * 7919) % 1880) + 12.0f * rnd();
+        float cy = 20.0f + (float)((k * 104729) % 1040) + 12.0f * rnd();
+        float w = 24.0f + 40.0f * rnd(), h = 40.0f + 80.0f * rnd();
+        Detection d{cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, scores[i], (int)(rnd() * num_classes) % num_classes};
+        buf.push(d.x1, d.y1, d.x2, d.y2, d.score, d.class_id);
+        list.push_back(d);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+struct Detection
+{
+    float x1, y1, x2, y2, score;
+    int class_id;
+    int track_id = -1; // set by ObjectTracker
+};
+
+// Structure-of-arrays candidate list filled by the output decoder and consumed by NMS.
+// Storage is sized once (e.g. to the anchor count) so push() never allocates per frame.
+struct DetectionBuffer
+{
+    std::vector<float> x1, y1, x2, y2, score;
+    std::vector<int> class_id;
+    size_t count = 0;
+
+    size_t capacity() const { return x1.size(); }
+
+    void reserve(size_t n)
+    {
+        if (n <= capacity())
+            return;
+        x1.resize(n);
+        y1.resize(n);
+        x2.resize(n);
+        y2.resize(n);
+        score.resize(n);
+        class_id.resize(n);
+    }
+
+    void clear() { count = 0; }
+
+    // caller guarantees count < capacity()
+    void push(float bx1, float by1, float bx2, float by2, float s, int cls)
+    {
+        x1[count] = bx1;
+        y1[count] = by1;
+        x2[count] = bx2;
+        y2[count] = by2;
+        score[count] = s;
+        class_id[count] = cls;
+        ++count;
+    }
+
+    Detection at(size_t i) const { return Detection{x1[i], y1[i], x2[i], y2[i], score[i], class_id[i]}; }
+};
@@ -0,0 +1,276 @@
+#pragma once
+// Detection log (--det-log): everything trt_batch_infer reported for one input,
+// kept so the annotated video or alarm clips can be rendered again later
+// (trt_render) with other label styling, alarm classes or output size, without
+// running the model.
+//
+// Two append-only files, both read by mapping them into memory:
+//   <log>      DetLogHeader, the source path and the class names ('\n'-separated),
+//              padded to 8 bytes, then one record per output frame, in frame
+//              order: exactly the --results bin record (ResultRecordHeader +
+//              `count` ResultBox), boxes in original frame coordinates
+//   <log>.idx  DetLogIndexHeader, then one DetLogIndexEntry per record (frame
+//              index, time, byte offset in <log>); fixed size, so a frame is
+//              found by binary search without touching the records
+// Both are written by background threads (ResultSink) in large chunks. A log
+// cut short by a crash is read up to the last record that both files hold.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "detection.hpp"
+#include "result_sink.hpp"
+
+constexpr uint32_t kDetLogMagic = 0x474c4448;   // "HDLG" little-endian
+constexpr uint32_t kDetIndexMagic = 0x58494448; // "HDIX"
+
+#pragma pack(push, 1)
+struct DetLogHeader
+{
+    uint32_t magic = kDetLogMagic;
+    uint16_t version = 1;
+    uint16_t reserved = 0;
+    uint32_t header_bytes = 0;  // up to the first record
+    uint32_t source_length = 0; // bytes of the source path after this header
+    uint32_t names_length = 0;  // then the class names
+    uint32_t reserved2 = 0;
+    double fps = 0.0;           // frame rate of the input (image directories: --img-fps)
+    int64_t created_us = 0;     // wall clock, microseconds since the epoch
+};
+
+struct DetLogIndexHeader
+{
+    uint32_t magic = kDetIndexMagic;
+    uint16_t version = 1;
+    uint16_t entry_bytes = 24;
+    uint64_t reserved = 0;
+};
+
+struct DetLogIndexEntry
+{
+    uint64_t frame;  // frame index in the input
+    uint64_t offset; // of the record in the log
+    double time_sec; // stream time
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DetLogHeader) == 40, "DetLogHeader layout");
+static_assert(sizeof(DetLogIndexHeader) == 16, "DetLogIndexHeader layout");
+static_assert(sizeof(DetLogIndexEntry) == 24, "DetLogIndexEntry layout");
+
+// Written on the output thread, one call per output frame.
+class DetectionLogWriter
+{
+public:
+    bool open(const std::string &path, const std::string &source, double fps, const std::vector<std::string> &class_names, int log_level)
+    {
+        path_ = path;
+        log_level_ = log_level;
+        frames_ = detected_ = 0;
+        if (!log_.open(path, ResultFormat::Binary, 0) || !index_.open(path + ".idx", ResultFormat::Binary, 0))
+        {
+            log_.close();
+            return false;
+        }
+        std::string names;
+        for (const std::string &n : class_names)
+            names += n + "\n";
+        DetLogHeader h;
+        h.source_length = (uint32_t)source.size();
+        h.names_length = (uint32_t)names.size();
+        h.header_bytes = (uint32_t)((sizeof(h) + source.size() + names.size() + 7) & ~(size_t)7);
+        h.fps = fps;
+        h.created_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record_.assign((const char *)&h, sizeof(h));
+        record_ += source;
+        record_ += names;
+        record_.resize(h.header_bytes, '\0');
+        log_.write_raw(record_);
+        offset_ = h.header_bytes;
+        DetLogIndexHeader ih;
+        index_.write_raw(std::string((const char *)&ih, sizeof(ih)));
+        return true;
+    }
+
+    bool is_open() const { return log_.is_open(); }
+
+    void write(size_t frame_idx, double time_sec, bool detected, const std::vector<Detection> &dets)
+    {
+        if (!log_.is_open())
+            return;
+        int64_t wall_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record_.clear();
+        encoder_.binary(record_, 0, frame_idx, time_sec, wall_us, detected, dets);
+        // a file target never drops; after a write error both files stop growing
+        if (!log_.write_raw(record_))
+            return;
+        DetLogIndexEntry e{(uint64_t)frame_idx, offset_, time_sec};
+        entry_.assign((const char *)&e, sizeof(e));
+        index_.write_raw(entry_);
+        offset_ += record_.size();
+        ++frames_;
+        detected_ += detected ? 1 : 0;
+    }
+
+    void close()
+    {
+        if (!log_.is_open())
+            return;
+        log_.close();
+        index_.close();
+        if (log_level_ >= 1)
+            std::cout << "Detection log: " << frames_ << " frames (" << detected_ << " inferred), " << offset_ / 1024 << " KiB to " << path_ << std::endl;
+    }
+
+private:
+    ResultSink log_, index_;
+    ResultEncoder encoder_;
+    std::string path_, record_, entry_;
+    uint64_t offset_ = 0, frames_ = 0, detected_ = 0;
+    int log_level_ = 1;
+};
+
+// Read side: both files mapped, records decoded on demand.
+class DetectionLog
+{
+public:
+    DetectionLog() = default;
+    ~DetectionLog() { close(); }
+
+    DetectionLog(const DetectionLog &) = delete;
+    DetectionLog &operator=(const DetectionLog &) = delete;
+
+    // False with a message in `error` when either file is missing or not a log.
+    bool open(const std::string &path, std::string &error)
+    {
+        close();
+        if (!map(path, log_, log_size_) || !map(path + ".idx", idx_, idx_size_))
+        {
+            error = "cannot map " + path + " / " + path + ".idx: " + strerror(errno);
+            return false;
+        }
+        DetLogHeader h;
+        DetLogIndexHeader ih;
+        if (log_size_ < sizeof(h) || idx_size_ < sizeof(ih))
+        {
+            error = path + ": truncated header";
+            return false;
+        }
+        memcpy(&h, log_, sizeof(h));
+        memcpy(&ih, idx_, sizeof(ih));
+        if (h.magic != kDetLogMagic || ih.magic != kDetIndexMagic || ih.entry_bytes != sizeof(DetLogIndexEntry) ||
+            h.header_bytes > log_size_ || sizeof(h) + (uint64_t)h.source_length + h.names_length > h.header_bytes)
+        {
+            error = path + ": not a detection log";
+            return false;
+        }
+        fps_ = h.fps;
+        source_.assign((const char *)log_ + sizeof(h), h.source_length);
+        std::string names((const char *)log_ + sizeof(h) + h.source_length, h.names_length);
+        size_t start = 0;
+        for (size_t nl; (nl = names.find('\n', start)) != std::string::npos; start = nl + 1)
+            class_names_.push_back(names.substr(start, nl - start));
+
+        // entries whose record is complete (a crash can leave either file ahead)
+        entries_ = (const DetLogIndexEntry *)(idx_ + sizeof(ih));
+        count_ = (idx_size_ - sizeof(ih)) / sizeof(DetLogIndexEntry);
+        while (count_ > 0 && !record_complete(entries_[count_ - 1].offset))
+            --count_;
+        return true;
+    }
+
+    void close()
+    {
+        if (log_)
+            ::munmap((void *)log_, log_size_);
+        if (idx_)
+            ::munmap((void *)idx_, idx_size_);
+        log_ = idx_ = nullptr;
+        log_size_ = idx_size_ = 0;
+        count_ = 0;
+        entries_ = nullptr;
+        class_names_.clear();
+    }
+
+    size_t size() const { return count_; }
+    double fps() const { return fps_; }
+    const std::string &source() const { return source_; }
+    const std::vector<std::string> &class_names() const { return class_names_; }
+    const DetLogIndexEntry &entry(size_t i) const { return entries_[i]; }
+
+    // Position of `frame` in the index, or size() when the log has no record for it.
+    size_t find(uint64_t frame) const
+    {
+        const DetLogIndexEntry *end = entries_ + count_;
+        const DetLogIndexEntry *it = std::lower_bound(entries_, end, frame, [](const DetLogIndexEntry &e, uint64_t f)
+                                                      { return e.frame < f; });
+        return it != end && it->frame == frame ? (size_t)(it - entries_) : count_;
+    }
+
+    // Header of record i; its boxes go to `dets` (cleared first).
+    ResultRecordHeader record(size_t i, std::vector<Detection> &dets) const
+    {
+        ResultRecordHeader h;
+        const uint8_t *p = log_ + entries_[i].offset;
+        memcpy(&h, p, sizeof(h));
+        dets.resize(h.count);
+        for (uint32_t k = 0; k < h.count; ++k)
+        {
+            ResultBox b;
+            memcpy(&b, p + sizeof(h) + (size_t)k * sizeof(ResultBox), sizeof(b));
+            dets[k] = Detection{b.x1, b.y1, b.x2, b.y2, b.score, b.class_id};
+            dets[k].track_id = b.track_id;
+        }
+        return h;
+    }
+
+private:
+    static bool map(const std::string &path, const uint8_t *&data, size_t &size)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && st.st_size == 0)
+        {
+            ok = false;
+            errno = EINVAL; // nothing to map: not even a header
+        }
+        void *m = ok ? ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (m == MAP_FAILED)
+            return false;
+        ::madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t *)m;
+        size = (size_t)st.st_size;
+        return true;
+    }
+
+    bool record_complete(uint64_t offset) const
+    {
+        ResultRecordHeader h;
+        if (offset + sizeof(h) > log_size_)
+            return false;
+        memcpy(&h, log_ + offset, sizeof(h));
+        return h.magic == kResultMagic && offset + sizeof(h) + (uint64_t)h.count * sizeof(ResultBox) <= log_size_;
+    }
+
+    const uint8_t *log_ = nullptr, *idx_ = nullptr;
+    size_t log_size_ = 0, idx_size_ = 0;
+    const DetLogIndexEntry *entries_ = nullptr;
+    size_t count_ = 0;
+    double fps_ = 0.0;
+    std::string source_;
+    std::vector<std::string> class_names_;
+};
@@ -0,0 +1,134 @@
+#pragma once
+// CPU implementation of InferenceBackend using OpenCV DNN on the ONNX file
+// produced by pt_to_onnx.py. Slow compared to TensorRT, but runs anywhere
+// OpenCV does, so everything around the model can be measured without a GPU.
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+
+#include "inference_backend.hpp"
+
+class DnnBackend : public InferenceBackend
+{
+public:
+    const char *name() const override { return "opencv-dnn"; }
+    int output_channels() const override { return out_C_; }
+    int output_anchors() const override { return out_L_; }
+
+    int load(const BackendConfig &cfg) override
+    {
+        // parse from the mapped file rather than letting OpenCV read it into a buffer
+        auto t0 = StartupTimes::clock::now();
+        MappedFile model;
+        std::string error;
+        if (!model.open(cfg.model_path, error))
+        {
+            std::cerr << "Failed to load ONNX model: " << error << std::endl;
+            return 4;
+        }
+        startup_.add("map", t0);
+        startup_.note(model.mapped() ? "mmap" : "read");
+        t0 = StartupTimes::clock::now();
+        try
+        {
+            net_ = cv::dnn::readNetFromONNX(model.data(), model.size());
+        }
+        catch (const cv::Exception &e)
+        {
+            std::cerr << "Failed to load ONNX model: " << cfg.model_path << " " << e.what() << std::endl;
+            return 4;
+        }
+        if (net_.empty())
+        {
+            std::cerr << "Failed to load ONNX model: " << cfg.model_path << std::endl;
+            return 4;
+        }
+        model.close();
+        startup_.add("parse", t0);
+        net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        input_w_ = cfg.input_w;
+        input_h_ = cfg.input_h;
+
+        // prefer the combined head named "output" (same as the TensorRT path), else the first output
+        out_names_ = net_.getUnconnectedOutLayersNames();
+        for (size_t i = 0; i < out_names_.size(); ++i)
+            if (out_names_[i] == "output")
+                out_index_ = (int)i;
+        log_level_ = cfg.log_level;
+        if (log_level_ >= 1)
+            for (size_t i = 0; i < out_names_.size(); ++i)
+                std::cout << "ONNX output[" << i << "] name='" << out_names_[i] << "'" << std::endl;
+
+        // one warm-up forward pass resolves the output shape ([1, C, L] or [C, L])
+        t0 = StartupTimes::clock::now();
+        std::vector<float> zeros(3 * (size_t)input_w_ * input_h_, 0.0f);
+        std::vector<cv::Mat> outs;
+        if (!forward(zeros.data(), outs))
+        {
+            std::cerr << "Failed to run ONNX model on a " << input_w_ << "x" << input_h_ << " input\n";
+            return 5;
+        }
+        const cv::Mat &o = outs[out_index_];
+        if (o.dims == 3)
+        {
+            out_C_ = o.size[1];
+            out_L_ = o.size[2];
+        }
+        else if (o.dims == 2)
+        {
+            out_C_ = o.size[0];
+            out_L_ = o.size[1];
+        }
+        if (out_C_ <= 4 || out_L_ <= 0)
+            out_C_ = out_L_ = 0;
+        startup_.add("warm-up", t0);
+        if (log_level_ >= 1)
+            std::cout << "Using ONNX output '" << out_names_[out_index_] << "' C=" << out_C_ << " L=" << out_L_ << std::endl;
+        return 0;
+    }
+
+    bool infer(const float *input, float *output) override
+    {
+        if (!forward(input, outs_))
+            return false;
+        if (out_C_ > 0)
+        {
+            const cv::Mat &o = outs_[out_index_];
+            if (o.type() != CV_32F || !o.isContinuous() || o.total() < (size_t)out_C_ * out_L_)
+                return false;
+            std::memcpy(output, o.data, (size_t)out_C_ * out_L_ * sizeof(float));
+        }
+        return true;
+    }
+
+private:
+    bool forward(const float *input, std::vector<cv::Mat> &outs)
+    {
+        // wrap the planar input as an NCHW blob without copying
+        const int shape[4] = {1, 3, input_h_, input_w_};
+        cv::Mat blob(4, shape, CV_32F, const_cast<float *>(input));
+        try
+        {
+            net_.setInput(blob);
+            net_.forward(outs, out_names_);
+        }
+        catch (const cv::Exception &e)
+        {
+            std::cerr << "OpenCV DNN forward failed: " << e.what() << std::endl;
+            return false;
+        }
+        return !outs.empty() && out_index_ < (int)outs.size();
+    }
+
+    cv::dnn::Net net_;
+    std::vector<std::string> out_names_;
+    std::vector<cv::Mat> outs_;
+    int out_index_ = 0;
+    int input_w_ = 640, input_h_ = 640;
+    int out_C_ = 0, out_L_ = 0;
+    int log_level_ = 1;
+};
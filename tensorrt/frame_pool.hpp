@@ -0,0 +1,81 @@
+#pragma once
+// Recycled frame buffers for the capture threads.
+//
+// Frames travel through the pipeline and on to the background writers (frame
+// files, RTMP push, live video) as cv::Mat headers that share one buffer, not
+// as copies. The pool keeps a reference to every buffer it hands out; a buffer
+// whose only remaining reference is the pool's own is free again, whichever
+// thread dropped the last one. Once the pool has grown to the number of frames
+// alive at a time (pipeline depth plus what the writers hold), acquire() does
+// not allocate.
+//
+// acquire() is meant for a single thread (the stream's capture thread); the
+// frames may be released on any thread.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+class FramePool
+{
+public:
+    // max_buffers caps the pool (0 = grow as needed); past the cap acquire() returns
+    // an unpooled buffer rather than waiting.
+    explicit FramePool(size_t max_buffers = 0) : max_buffers_(max_buffers) {}
+
+    // A rows x cols buffer of `type` that nobody else references. The contents are
+    // whatever the previous frame left. An empty size returns an empty Mat (let the
+    // reader allocate; the next acquire() uses the size it produced).
+    cv::Mat acquire(int rows, int cols, int type)
+    {
+        if (rows <= 0 || cols <= 0)
+            return cv::Mat();
+        size_t n = buffers_.size();
+        for (size_t k = 0; k < n; ++k)
+        {
+            size_t i = (next_ + k) % n;
+            cv::Mat &b = buffers_[i];
+            if (!is_free(b))
+                continue;
+            if (b.rows != rows || b.cols != cols || b.type() != type)
+            {
+                // resolution change: free buffers of the old size are replaced
+                b.release();
+                b.create(rows, cols, type);
+                ++allocated_;
+            }
+            next_ = (i + 1) % n;
+            return b;
+        }
+        ++allocated_;
+        if (max_buffers_ > 0 && n >= max_buffers_)
+            return cv::Mat(rows, cols, type);
+        buffers_.emplace_back(rows, cols, type);
+        return buffers_.back();
+    }
+
+    size_t size() const { return buffers_.size(); }
+    // buffers allocated so far (grows during warm-up and on resolution changes only)
+    uint64_t allocated() const { return allocated_; }
+
+    size_t in_use() const
+    {
+        size_t n = 0;
+        for (const cv::Mat &b : buffers_)
+            n += !is_free(b);
+        return n;
+    }
+
+private:
+    static bool is_free(const cv::Mat &b)
+    {
+        // atomic read of the reference count (OpenCV updates it with CV_XADD)
+        return b.u && CV_XADD(&b.u->refcount, 0) == 1;
+    }
+
+    size_t max_buffers_;
+    std::vector<cv::Mat> buffers_;
+    size_t next_ = 0;
+    uint64_t allocated_ = 0;
+};
@@ -0,0 +1,213 @@
+#pragma once
+// Per-frame image dumps written by a pool of background threads.
+//
+// The output thread only queues a reference to the frame; encoding (the
+// expensive part for PNG) and the file write happen on the writer threads. The
+// queue is a fixed ring of reused jobs, bounded: when the disk cannot keep up,
+// write() blocks instead of dropping frames or growing memory.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "metrics.hpp"
+
+struct FrameFormat
+{
+    enum Kind
+    {
+        None, // no per-frame files (video / RTMP output only)
+        Jpeg,
+        Png,
+        Raw // uncompressed BMP: largest files, cheapest to write
+    };
+    Kind kind = Png;
+    int level = 1; // JPEG quality (0-100) or PNG compression (0-9)
+};
+
+// none | jpg | png | raw; returns false for anything else.
+inline bool parse_frame_format(const std::string &s, FrameFormat &fmt)
+{
+    if (s == "none")
+        fmt.kind = FrameFormat::None;
+    else if (s == "jpg" || s == "jpeg")
+        fmt.kind = FrameFormat::Jpeg;
+    else if (s == "png")
+        fmt.kind = FrameFormat::Png;
+    else if (s == "raw" || s == "bmp")
+        fmt.kind = FrameFormat::Raw;
+    else
+        return false;
+    return true;
+}
+
+inline const char *frame_format_ext(const FrameFormat &fmt)
+{
+    switch (fmt.kind)
+    {
+    case FrameFormat::Jpeg:
+        return ".jpg";
+    case FrameFormat::Png:
+        return ".png";
+    case FrameFormat::Raw:
+        return ".bmp";
+    default:
+        return "";
+    }
+}
+
+inline std::vector<int> frame_format_params(const FrameFormat &fmt)
+{
+    if (fmt.kind == FrameFormat::Jpeg)
+        return {cv::IMWRITE_JPEG_QUALITY, fmt.level};
+    if (fmt.kind == FrameFormat::Png)
+        return {cv::IMWRITE_PNG_COMPRESSION, fmt.level};
+    return {};
+}
+
+class FrameWriter
+{
+public:
+    explicit FrameWriter(int threads = 2, size_t max_queue = 16) : ring_(std::max<size_t>(1, max_queue))
+    {
+        for (int i = 0; i < std::max(1, threads); ++i)
+            threads_.emplace_back([this]
+                                  { writer_loop(); });
+    }
+
+    ~FrameWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        not_empty_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+    }
+
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    // Queue `frame` to be written as `path_no_ext` + extension of `fmt`. The frame
+    // is referenced, not copied: don't draw into it afterwards (capture the next
+    // frame into a new buffer, see FramePool). No-op for FrameFormat::None.
+    void write(const cv::Mat &frame, const char *path_no_ext, const FrameFormat &fmt)
+    {
+        if (fmt.kind == FrameFormat::None || frame.empty())
+            return;
+        std::unique_lock<std::mutex> lock(mu_);
+        not_full_.wait(lock, [this]
+                       { return count_ < ring_.size(); });
+        Job &job = ring_[(head_ + count_) % ring_.size()];
+        job.image = frame;
+        job.path.assign(path_no_ext).append(frame_format_ext(fmt)); // keeps the slot's string capacity
+        job.fmt = fmt;
+        ++count_;
+        lock.unlock();
+        not_empty_.notify_one();
+    }
+
+    void write(const cv::Mat &frame, const std::string &path_no_ext, const FrameFormat &fmt)
+    {
+        write(frame, path_no_ext.c_str(), fmt);
+    }
+
+    // Block until every queued frame has been written.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        idle_.wait(lock, [this]
+                   { return count_ == 0 && busy_ == 0; });
+    }
+
+    // frames queued or being written
+    size_t queued()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return count_ + busy_;
+    }
+
+    // encode+write time of every file (null: off); set before the first write()
+    void set_latency_histogram(LatencyHistogram *h) { hist_ = h; }
+
+    uint64_t written() const { return written_.load(); }
+    uint64_t failed() const { return failed_.load(); }
+    // total encode+write time across writer threads
+    double busy_ms() const { return busy_ns_.load() / 1e6; }
+
+private:
+    struct Job
+    {
+        cv::Mat image;
+        std::string path;
+        FrameFormat fmt;
+    };
+
+    void writer_loop()
+    {
+        Job job; // swapped with ring slots, so path strings keep their capacity
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                not_empty_.wait(lock, [this]
+                                { return stop_ || count_ > 0; });
+                if (count_ == 0)
+                    return; // stop_ and drained
+                std::swap(job, ring_[head_]);
+                head_ = (head_ + 1) % ring_.size();
+                --count_;
+                ++busy_;
+            }
+            not_full_.notify_one();
+
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = false;
+            try
+            {
+                ok = cv::imwrite(job.path, job.image, frame_format_params(job.fmt));
+            }
+            catch (const cv::Exception &e)
+            {
+                std::cerr << "imwrite exception for " << job.path << ": " << e.what() << std::endl;
+            }
+            if (!ok)
+            {
+                std::cerr << "Failed to write: " << job.path << std::endl;
+                failed_++;
+            }
+            else
+                written_++;
+            job.image.release(); // hand the buffer back (FramePool) before the next wait
+            uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+            busy_ns_ += ns;
+            if (hist_)
+                hist_->record_ns(ns);
+
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                --busy_;
+                if (count_ == 0 && busy_ == 0)
+                    idle_.notify_all();
+            }
+        }
+    }
+
+    std::mutex mu_;
+    std::condition_variable not_empty_, not_full_, idle_;
+    std::vector<Job> ring_; // queued jobs: count_ entries from head_
+    size_t head_ = 0, count_ = 0;
+    int busy_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+    std::atomic<uint64_t> written_{0}, failed_{0}, busy_ns_{0};
+    LatencyHistogram *hist_ = nullptr;
+};
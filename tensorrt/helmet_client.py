@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Client for the inference daemon (trt_batch_infer <model> --serve <socket> ...).
+
+The protocol is described in infer_daemon.hpp. Frames go through a shared
+memory ring handed out by the daemon: write a BGR frame into slot(k) (or let
+detect() copy it there) and the daemon letterboxes it straight from that
+memory. Only the standard library is needed; numpy arrays are accepted where
+available.
+
+    client = HelmetClient('/tmp/helmet.sock')
+    for box in client.detect(frame_bgr):            # HxWx3 uint8 array
+        print(client.names[box.class_id], box.score, box.x1, box.y1, box.x2, box.y2)
+    boxes = client.detect_encoded(open('a.jpg', 'rb').read())
+"""
+import array
+import json
+import mmap
+import os
+import socket
+import struct
+from collections import namedtuple
+
+MAGIC = 0x4e4d4448
+VERSION = 1
+HELLO, WELCOME, REQUEST, REPLY = 1, 2, 3, 4
+FRAME_BGR, FRAME_ENCODED = 0, 1
+REPLY_BIN, REPLY_JSONL = 0, 1
+STATUS = {0: 'ok', 1: 'bad request', 2: 'decode failed', 3: 'inference failed', 4: 'refused'}
+
+_HELLO = struct.Struct('<IHHIIQ')
+_WELCOME = struct.Struct('<IHHiIQiiiI')
+_REQUEST = struct.Struct('<IHHIIIIiiiIfIQd')
+_REPLY = struct.Struct('<IHHIiIIfff')
+_RECORD = struct.Struct('<IHHIIQdq')  # ResultRecordHeader
+_BOX = struct.Struct('<fffffii')      # ResultBox
+RESULT_MAGIC = 0x54454448
+
+Box = namedtuple('Box', 'x1 y1 x2 y2 score class_id track_id')
+Reply = namedtuple('Reply', 'id status count queue_ms infer_ms total_ms payload')
+
+
+class DaemonError(RuntimeError):
+    pass
+
+
+def parse_record(payload):
+    """Boxes of one bin record (ResultRecordHeader + ResultBox entries)."""
+    magic, _, _, _, count, _, _, _ = _RECORD.unpack_from(payload, 0)
+    if magic != RESULT_MAGIC or len(payload) != _RECORD.size + count * _BOX.size:
+        raise DaemonError('bad record')
+    return [Box(*_BOX.unpack_from(payload, _RECORD.size + i * _BOX.size)) for i in range(count)]
+
+
+class HelmetClient:
+    def __init__(self, path, slots=2, slot_bytes=1920 * 1080 * 3):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.sock.sendall(_HELLO.pack(MAGIC, VERSION, HELLO, slots, 0, slot_bytes))
+        head, fd = self._recv_with_fd(_WELCOME.size)
+        magic, _, kind, status, self.slots, self.slot_bytes, self.input_w, self.input_h, _, names_len = _WELCOME.unpack(head)
+        names = self._recv(names_len)
+        if magic != MAGIC or kind != WELCOME or status != 0 or fd < 0:
+            if fd >= 0:
+                os.close(fd)
+            self.sock.close()
+            raise DaemonError('daemon refused the connection: %s' % STATUS.get(status, status))
+        self.names = names.decode('utf-8').split('\n')[:-1]
+        try:
+            self.ring = mmap.mmap(fd, self.slots * self.slot_bytes, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        self._next_id = 0
+
+    def close(self):
+        if self.sock is not None:
+            self.sock.close()
+            self.ring.close()
+            self.sock = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def slot(self, k):
+        """Writable memoryview of slot k; np.ndarray((h, w, 3), np.uint8, buffer=client.slot(k)) maps a frame onto it."""
+        return memoryview(self.ring)[k * self.slot_bytes:(k + 1) * self.slot_bytes]
+
+    def submit(self, slot, width=0, height=0, stride=0, length=0, encoded=False, conf=0.0, jsonl=False,
+               stream=0, frame=0, time_sec=0.0, request_id=None):
+        """Asks for detections on the frame already in `slot`; returns the request id."""
+        if request_id is None:
+            self._next_id = (self._next_id + 1) & 0xffffffff
+            request_id = self._next_id
+        self.sock.sendall(_REQUEST.pack(MAGIC, VERSION, REQUEST, request_id, slot,
+                                        FRAME_ENCODED if encoded else FRAME_BGR, REPLY_JSONL if jsonl else REPLY_BIN,
+                                        width, height, stride, length, conf, stream, frame, time_sec))
+        return request_id
+
+    def receive(self):
+        """Next reply, in request order. `payload` is the bin record (bytes) or the jsonl line (str)."""
+        magic, _, kind, rid, status, length, count, queue_ms, infer_ms, total_ms = _REPLY.unpack(self._recv(_REPLY.size))
+        if magic != MAGIC or kind != REPLY:
+            raise DaemonError('out of sync with the daemon')
+        payload = self._recv(length)
+        return Reply(rid, status, count, queue_ms, infer_ms, total_ms, payload)
+
+    def boxes(self, reply):
+        if reply.status != 0:
+            raise DaemonError('request %d: %s' % (reply.id, STATUS.get(reply.status, reply.status)))
+        if reply.payload[:1] == b'{':
+            return json.loads(reply.payload)
+        return parse_record(reply.payload)
+
+    def detect(self, image, conf=0.0, slot=0):
+        """Detections on a BGR image (HxWx3 uint8 numpy array), in image coordinates."""
+        h, w = image.shape[:2]
+        if image.ndim != 3 or image.shape[2] != 3 or w * h * 3 > self.slot_bytes:
+            raise DaemonError('expected a BGR image of at most %d bytes' % self.slot_bytes)
+        data = image.tobytes() if not image.flags['C_CONTIGUOUS'] else memoryview(image).cast('B')
+        self.slot(slot)[:w * h * 3] = data
+        self.submit(slot, w, h, w * 3, conf=conf)
+        return self.boxes(self.receive())
+
+    def detect_encoded(self, data, conf=0.0, slot=0, jsonl=False):
+        """Detections on an encoded image file (JPEG, PNG, ...), decoded by the daemon."""
+        if len(data) > self.slot_bytes:
+            raise DaemonError('encoded image larger than a slot')
+        self.slot(slot)[:len(data)] = data
+        self.submit(slot, length=len(data), encoded=True, conf=conf, jsonl=jsonl)
+        return self.boxes(self.receive())
+
+    def _recv(self, n):
+        buf = bytearray()
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise DaemonError('connection closed by the daemon')
+            buf += chunk
+        return bytes(buf)
+
+    def _recv_with_fd(self, n):
+        fds = array.array('i')
+        data, anc, _, _ = self.sock.recvmsg(n, socket.CMSG_SPACE(fds.itemsize))
+        if not data:
+            raise DaemonError('connection closed by the daemon')
+        for level, kind, cdata in anc:
+            if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+                fds.frombytes(cdata[:len(cdata) - len(cdata) % fds.itemsize])
+        return data + self._recv(n - len(data)), (fds[0] if fds else -1)
+
+
+if __name__ == '__main__':
+    import sys
+    if len(sys.argv) < 3:
+        print('Usage: helmet_client.py <socket> <image> [image...]')
+        sys.exit(1)
+    with HelmetClient(sys.argv[1], slots=1, slot_bytes=64 << 20) as client:
+        for path in sys.argv[2:]:
+            with open(path, 'rb') as f:
+                boxes = client.detect_encoded(f.read())
+            print(path)
+            for b in boxes:
+                name = client.names[b.class_id] if 0 <= b.class_id < len(client.names) else str(b.class_id)
+                print('  %s %.2f [%.0f,%.0f,%.0f,%.0f]' % (name, b.score, b.x1, b.y1, b.x2, b.y2))
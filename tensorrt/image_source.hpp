@@ -0,0 +1,218 @@
+#pragma once
+// Image-list input decoded ahead of the pipeline by a pool of threads.
+//
+// Directory mode reads, decodes and hands out the files in list order, but the
+// decoding (the bulk of the per-image CPU cost for large JPEG photos) runs on
+// `threads` workers, up to `ahead` images in front of the consumer. Each worker
+// decodes into buffers from its own FramePool, so photos of one camera size are
+// not reallocated.
+//
+// With reduced decoding, a JPEG that is at least twice the model input in both
+// directions is decoded by libjpeg at 1/2, 1/4 or 1/8 scale (the largest that
+// still leaves at least the letterboxed resolution), which is several times
+// cheaper than a full decode followed by the letterbox downscale.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.hpp"
+
+// Whole file into `bytes` (capacity is reused from file to file).
+inline bool read_file_bytes(const std::string &path, std::vector<uchar> &bytes)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = fseek(f, 0, SEEK_END) == 0;
+    long size = ok ? ftell(f) : -1;
+    ok = size > 0 && fseek(f, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize((size_t)size);
+        ok = fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+// Width and height from a JPEG's SOF header; false if `bytes` is not a JPEG or has none.
+inline bool jpeg_dimensions(const std::vector<uchar> &bytes, int &w, int &h)
+{
+    size_t n = bytes.size(), i = 2;
+    if (n < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+        return false;
+    while (i + 4 <= n)
+    {
+        if (bytes[i] != 0xFF)
+            return false;
+        uint8_t marker = bytes[i + 1];
+        if (marker == 0xFF)
+        {
+            ++i; // fill byte
+            continue;
+        }
+        size_t len = ((size_t)bytes[i + 2] << 8) | bytes[i + 3];
+        // SOF0..SOF15 carry the frame size; C4 (DHT), C8 (JPG) and CC (DAC) share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            if (i + 9 > n)
+                return false;
+            h = (bytes[i + 5] << 8) | bytes[i + 6];
+            w = (bytes[i + 7] << 8) | bytes[i + 8];
+            return w > 0 && h > 0;
+        }
+        if (marker == 0xD9 || marker == 0xDA)
+            return false; // end of image / start of scan before any SOF
+        i += 2 + len;
+    }
+    return false;
+}
+
+// Largest libjpeg downscale (1, 2, 4 or 8) for a w x h image that keeps at least
+// the size the letterbox would shrink it to for a model_w x model_h input.
+inline int reduced_decode_factor(int w, int h, int model_w, int model_h)
+{
+    if (w <= 0 || h <= 0 || model_w <= 0 || model_h <= 0)
+        return 1;
+    double r = std::min((double)model_w / w, (double)model_h / h);
+    for (int f : {8, 4, 2})
+        if (f * r <= 1.0)
+            return f;
+    return 1;
+}
+
+class ImagePrefetcher
+{
+public:
+    // model_w / model_h > 0 enable reduced JPEG decoding for that input size.
+    ImagePrefetcher(const std::vector<std::string> &files, int threads, size_t ahead, int model_w = 0, int model_h = 0)
+        : files_(files), slots_(std::max<size_t>(1, ahead)), model_w_(model_w), model_h_(model_h)
+    {
+        for (int i = 0; i < std::max(1, threads); ++i)
+            threads_.emplace_back([this]
+                                  { decode_loop(); });
+    }
+
+    ~ImagePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        space_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+    }
+
+    ImagePrefetcher(const ImagePrefetcher &) = delete;
+    ImagePrefetcher &operator=(const ImagePrefetcher &) = delete;
+
+    // Next image in list order; false after the last one. An unreadable file gives
+    // an empty frame. `scale` maps decoded coordinates to the original image (1, or
+    // the reduced-decode factor).
+    bool next(cv::Mat &frame, float &scale)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        if (consumed_ >= files_.size())
+            return false;
+        Slot &slot = slots_[consumed_ % slots_.size()];
+        ready_.wait(lock, [&slot]
+                    { return slot.ready; });
+        frame = slot.frame;
+        scale = slot.scale;
+        slot.frame.release();
+        slot.ready = false;
+        ++consumed_;
+        lock.unlock();
+        space_.notify_all();
+        return true;
+    }
+
+    // images decoded at reduced resolution so far
+    uint64_t reduced() const { return reduced_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot
+    {
+        cv::Mat frame;
+        float scale = 1.0f;
+        bool ready = false;
+    };
+
+    void decode_loop()
+    {
+        FramePool pool;
+        std::vector<uchar> bytes;
+        cv::Size last;
+        for (;;)
+        {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                space_.wait(lock, [this]
+                            { return stop_ || claimed_ >= files_.size() || claimed_ < consumed_ + slots_.size(); });
+                if (stop_ || claimed_ >= files_.size())
+                    return;
+                i = claimed_++;
+            }
+
+            cv::Mat frame;
+            int factor = 1;
+            if (read_file_bytes(files_[i], bytes))
+            {
+                int w = 0, h = 0, flags = cv::IMREAD_COLOR;
+                bool jpeg = jpeg_dimensions(bytes, w, h);
+                if (jpeg && model_w_ > 0)
+                    factor = reduced_decode_factor(w, h, model_w_, model_h_);
+                if (factor > 1)
+                {
+                    flags = factor == 8 ? cv::IMREAD_REDUCED_COLOR_8 : factor == 4 ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_COLOR_2;
+                    last = cv::Size((w + factor - 1) / factor, (h + factor - 1) / factor);
+                }
+                else if (jpeg)
+                    last = cv::Size(w, h);
+                frame = pool.acquire(last.height, last.width, CV_8UC3);
+                try
+                {
+                    cv::imdecode(bytes, flags, &frame);
+                }
+                catch (const cv::Exception &)
+                {
+                    frame.release();
+                }
+                if (!frame.empty())
+                    last = frame.size();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                Slot &slot = slots_[i % slots_.size()];
+                slot.frame = frame;
+                slot.scale = (float)factor;
+                slot.ready = true;
+            }
+            if (factor > 1)
+                reduced_.fetch_add(1, std::memory_order_relaxed);
+            frame.release();
+            ready_.notify_all();
+        }
+    }
+
+    const std::vector<std::string> &files_;
+    std::vector<Slot> slots_; // image i waits in slot i % ahead
+    const int model_w_, model_h_;
+    std::mutex mu_;
+    std::condition_variable ready_, space_;
+    size_t claimed_ = 0, consumed_ = 0;
+    bool stop_ = false;
+    std::atomic<uint64_t> reduced_{0};
+    std::vector<std::thread> threads_;
+};
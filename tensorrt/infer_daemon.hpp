@@ -0,0 +1,905 @@
+#pragma once
+// Inference daemon (trt_batch_infer <model> --serve <socket> ...) and its client.
+//
+// Loading an engine takes seconds, so tools that need detections on a few
+// frames (make_annotated_video.py, infer_helmet_vest.py --daemon, other
+// services) talk to one long-lived process instead of starting their own.
+//
+// Protocol, over a SOCK_STREAM unix socket, native byte order (same host):
+//   client -> DaemonHello      how many frame slots it wants and how large
+//   server -> DaemonWelcome    model input size, class names ('\n'-separated),
+//                              and a memfd of slots * slot_bytes (SCM_RIGHTS)
+//   client -> DaemonRequest    "the frame in slot k": raw BGR (width, height,
+//                              row stride) or an encoded image (length bytes)
+//   server -> DaemonReply      status, timings, then `length` payload bytes: one
+//                              bin record (ResultRecordHeader + ResultBox) or
+//                              one jsonl line, exactly as --results writes them
+// Both sides map the memfd, so a frame is written once by the client and
+// letterboxed straight out of the shared mapping by the server (zero-copy).
+// The memfd is sealed against shrinking: a client that truncated it would make
+// the server's reads from the mapping fault (SIGBUS) and take every client down.
+// A client may have one request in flight per slot; replies come back in
+// request order, and a slot is reusable once its reply has arrived.
+//
+// Server threads: one accept loop, one thread per client (reads requests,
+// letterboxes, decodes + NMS, replies) and one batcher that runs the model on
+// whatever frames the clients have ready, up to max_batch per call and waiting
+// at most max_wait_ms for a batch to fill.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection.hpp"
+#include "inference_backend.hpp"
+#include "letterbox.hpp"
+#include "nms.hpp"
+#include "result_sink.hpp"
+#include "yolo_decoder.hpp"
+
+constexpr uint32_t kDaemonMagic = 0x4e4d4448; // "HDMN" little-endian
+constexpr uint16_t kDaemonVersion = 1;
+
+enum DaemonMsgType : uint16_t
+{
+    kDaemonHello = 1,
+    kDaemonWelcome = 2,
+    kDaemonRequest = 3,
+    kDaemonReply = 4,
+};
+
+enum DaemonFrameFormat : uint32_t
+{
+    kDaemonFrameBgr = 0,     // width x height BGR8, rows `stride` bytes apart
+    kDaemonFrameEncoded = 1, // `length` bytes of a JPEG/PNG/... file
+};
+
+enum DaemonReplyFormat : uint32_t
+{
+    kDaemonReplyBin = 0,
+    kDaemonReplyJsonl = 1,
+};
+
+enum DaemonStatus : int32_t
+{
+    kDaemonOk = 0,
+    kDaemonBadRequest = 1,   // slot / size out of range, unknown format
+    kDaemonDecodeFailed = 2, // encoded image could not be decoded
+    kDaemonInferFailed = 3,
+    kDaemonRefused = 4,      // welcome only: ring too large or shared memory unavailable
+};
+
+#pragma pack(push, 1)
+struct DaemonHello
+{
+    uint32_t magic = kDaemonMagic;
+    uint16_t version = kDaemonVersion;
+    uint16_t type = kDaemonHello;
+    uint32_t slots = 2;
+    uint32_t reserved = 0;
+    uint64_t slot_bytes = 0;
+};
+
+struct DaemonWelcome
+{
+    uint32_t magic = kDaemonMagic;
+    uint16_t version = kDaemonVersion;
+    uint16_t type = kDaemonWelcome;
+    int32_t status = kDaemonOk;
+    uint32_t slots = 0;
+    uint64_t slot_bytes = 0;
+    int32_t input_w = 0, input_h = 0;
+    int32_t num_classes = 0;
+    uint32_t names_length = 0; // bytes of class names following this header
+};
+
+struct DaemonRequest
+{
+    uint32_t magic = kDaemonMagic;
+    uint16_t version = kDaemonVersion;
+    uint16_t type = kDaemonRequest;
+    uint32_t id = 0;     // echoed in the reply
+    uint32_t slot = 0;
+    uint32_t format = kDaemonFrameBgr;
+    uint32_t reply = kDaemonReplyBin;
+    int32_t width = 0, height = 0, stride = 0; // raw frames
+    uint32_t length = 0;                       // encoded frames
+    float conf = 0.0f;                         // <= 0: the daemon's --conf
+    uint32_t stream = 0;                       // copied into the record
+    uint64_t frame = 0;
+    double time_sec = 0.0;
+};
+
+struct DaemonReply
+{
+    uint32_t magic = kDaemonMagic;
+    uint16_t version = kDaemonVersion;
+    uint16_t type = kDaemonReply;
+    uint32_t id = 0;
+    int32_t status = kDaemonOk;
+    uint32_t length = 0;     // payload bytes following this header
+    uint32_t count = 0;      // detections in the payload
+    float queue_ms = 0.0f;   // waiting for / sharing a batch
+    float infer_ms = 0.0f;   // the model call the frame was part of
+    float total_ms = 0.0f;   // request read to reply sent
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DaemonHello) == 24, "DaemonHello layout");
+static_assert(sizeof(DaemonWelcome) == 40, "DaemonWelcome layout");
+static_assert(sizeof(DaemonRequest) == 64, "DaemonRequest layout");
+static_assert(sizeof(DaemonReply) == 36, "DaemonReply layout");
+
+namespace daemon_detail
+{
+    // whole-buffer send / receive; false on error or EOF
+    inline bool send_all(int fd, const void *buf, size_t len)
+    {
+        const char *p = (const char *)buf;
+        while (len > 0)
+        {
+            ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+
+    inline bool recv_all(int fd, void *buf, size_t len)
+    {
+        char *p = (char *)buf;
+        while (len > 0)
+        {
+            ssize_t n = ::recv(fd, p, len, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+
+    // `len` bytes with `pass_fd` attached (SCM_RIGHTS) on the first chunk
+    inline bool send_with_fd(int fd, const void *buf, size_t len, int pass_fd)
+    {
+        iovec iov{(void *)buf, len};
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &pass_fd, sizeof(int));
+        ssize_t n;
+        do
+            n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        return send_all(fd, (const char *)buf + n, len - (size_t)n);
+    }
+
+    // receives exactly `len` bytes; a descriptor passed along lands in `got_fd` (else -1)
+    inline bool recv_with_fd(int fd, void *buf, size_t len, int &got_fd)
+    {
+        got_fd = -1;
+        iovec iov{buf, len};
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n;
+        do
+            n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+                memcpy(&got_fd, CMSG_DATA(c), sizeof(int));
+        return recv_all(fd, (char *)buf + n, len - (size_t)n);
+    }
+
+    // anonymous shared memory of `bytes`, sealed so it cannot shrink, as a
+    // descriptor; -1 on failure (also where memfd sealing is unavailable)
+    inline int make_shared_memory(size_t bytes)
+    {
+#if defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+        int fd = ::memfd_create("helmet-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd >= 0 && (::ftruncate(fd, (off_t)bytes) != 0 || ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0))
+        {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            fd = -1;
+        }
+        return fd;
+#else
+        (void)bytes;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    inline bool make_unix_address(const std::string &path, sockaddr_un &addr)
+    {
+        addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            return false;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    inline double ms_since(std::chrono::steady_clock::time_point t0)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+} // namespace daemon_detail
+
+struct DaemonConfig
+{
+    float conf_thresh = 0.25f;
+    NmsConfig nms;
+    int max_batch = 1;            // frames per model call (capped by the backend)
+    double max_wait_ms = 2.0;     // how long a partial batch waits for more frames
+    uint32_t max_slots = 64;      // per client
+    uint64_t max_ring_bytes = 1ull << 30; // per client
+    int max_clients = 64;
+    int log_level = 1;
+};
+
+class InferServer
+{
+public:
+    InferServer(InferenceBackend &backend, const DaemonConfig &cfg, int input_w, int input_h, std::vector<std::string> class_names)
+        : backend_(backend), cfg_(cfg), input_w_(input_w), input_h_(input_h), class_names_(std::move(class_names))
+    {
+        for (const std::string &n : class_names_)
+            names_blob_ += n + "\n";
+    }
+
+    ~InferServer() { stop(); }
+
+    InferServer(const InferServer &) = delete;
+    InferServer &operator=(const InferServer &) = delete;
+
+    // Listens on `path` (a stale socket file left by a crashed daemon is replaced)
+    // and starts serving. False (and logged) when the socket cannot be created.
+    bool start(const std::string &path)
+    {
+        sockaddr_un addr;
+        if (!daemon_detail::make_unix_address(path, addr))
+        {
+            std::cerr << "Invalid daemon socket path: " << path << std::endl;
+            return false;
+        }
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool bound = listen_fd_ >= 0 && ::bind(listen_fd_, (const sockaddr *)&addr, sizeof(addr)) == 0;
+        if (!bound && listen_fd_ >= 0 && errno == EADDRINUSE)
+        {
+            // take over the file only when nobody answers on it any more
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool alive = probe >= 0 && ::connect(probe, (const sockaddr *)&addr, sizeof(addr)) == 0;
+            if (probe >= 0)
+                ::close(probe);
+            if (!alive && ::unlink(path.c_str()) == 0)
+                bound = ::bind(listen_fd_, (const sockaddr *)&addr, sizeof(addr)) == 0;
+            else
+                errno = EADDRINUSE;
+        }
+        if (!bound || ::listen(listen_fd_, 16) != 0)
+        {
+            std::cerr << "Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+            if (listen_fd_ >= 0)
+                ::close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        path_ = path;
+        stop_ = false;
+        batcher_ = std::thread([this]
+                               { batch_loop(); });
+        acceptor_ = std::thread([this]
+                                { accept_loop(); });
+        return true;
+    }
+
+    // Disconnects every client, joins all threads and removes the socket file.
+    void stop()
+    {
+        if (!acceptor_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+            for (auto &c : clients_)
+                ::shutdown(c->fd, SHUT_RDWR); // wakes a client thread blocked in recv
+        }
+        queued_.notify_all();
+        done_.notify_all();
+        acceptor_.join();
+        std::list<std::unique_ptr<Client>> clients;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            clients.swap(clients_);
+        }
+        for (auto &c : clients)
+        {
+            c->thread.join();
+            ::close(c->fd);
+        }
+        batcher_.join();
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        ::unlink(path_.c_str());
+        if (cfg_.log_level >= 1)
+        {
+            uint64_t n = requests_.load(), b = batches_.load();
+            std::cout << "Daemon: " << clients_seen_.load() << " clients, " << n << " requests, " << b << " model calls";
+            if (b > 0)
+                std::cout << " (" << (double)frames_inferred_.load() / b << " frames per call)";
+            std::cout << std::endl;
+        }
+    }
+
+    uint64_t requests() const { return requests_.load(); }
+    uint64_t batches() const { return batches_.load(); }
+
+private:
+    // one frame waiting for / in a model call
+    struct Job
+    {
+        float *input = nullptr;
+        float *output = nullptr;
+        bool done = false, ok = false;
+        std::chrono::steady_clock::time_point queued;
+        double queue_ms = 0.0, infer_ms = 0.0;
+    };
+
+    struct Client
+    {
+        int fd = -1;
+        uint32_t id = 0;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    // per-slot state of a connected client
+    struct Pending
+    {
+        DaemonRequest req;
+        std::shared_ptr<const LetterboxPlan> plan;
+        Job job;
+        int32_t status = kDaemonOk;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    void accept_loop()
+    {
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                if (stop_)
+                    return;
+                reap_locked();
+            }
+            pollfd p{listen_fd_, POLLIN, 0};
+            if (::poll(&p, 1, 200) <= 0 || !(p.revents & POLLIN))
+                continue;
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+                continue;
+            std::lock_guard<std::mutex> lock(mu_);
+            if (stop_ || (int)clients_.size() >= cfg_.max_clients)
+            {
+                if (cfg_.log_level >= 1 && !stop_)
+                    std::cerr << "Daemon: refusing client, " << clients_.size() << " already connected" << std::endl;
+                ::close(fd);
+                continue;
+            }
+            clients_.push_back(std::make_unique<Client>());
+            Client *c = clients_.back().get();
+            c->fd = fd;
+            c->id = clients_seen_++;
+            c->thread = std::thread([this, c]
+                                    { serve(*c); });
+        }
+    }
+
+    // joins the threads of clients that have disconnected (mu_ held)
+    void reap_locked()
+    {
+        for (auto it = clients_.begin(); it != clients_.end();)
+        {
+            if ((*it)->finished.load())
+            {
+                (*it)->thread.join();
+                ::close((*it)->fd);
+                it = clients_.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void serve(Client &c)
+    {
+        serve_client(c);
+        ::shutdown(c.fd, SHUT_RDWR); // closed when the thread is joined, so stop() never sees a reused descriptor
+        if (cfg_.log_level >= 2)
+            std::cout << "Daemon: client " << c.id << " disconnected" << std::endl;
+        c.finished.store(true);
+    }
+
+    void serve_client(Client &c)
+    {
+        using daemon_detail::recv_all;
+        using daemon_detail::send_all;
+        DaemonHello hello;
+        if (!recv_all(c.fd, &hello, sizeof(hello)) || hello.magic != kDaemonMagic || hello.type != kDaemonHello)
+            return;
+        DaemonWelcome welcome;
+        welcome.input_w = input_w_;
+        welcome.input_h = input_h_;
+        welcome.num_classes = (int32_t)class_names_.size();
+        welcome.names_length = (uint32_t)names_blob_.size();
+        uint64_t ring_bytes = (uint64_t)hello.slots * hello.slot_bytes;
+        int shm = -1;
+        uint8_t *ring = nullptr;
+        if (hello.version != kDaemonVersion || hello.slots == 0 || hello.slots > cfg_.max_slots || hello.slot_bytes == 0 ||
+            ring_bytes / hello.slots != hello.slot_bytes || ring_bytes > cfg_.max_ring_bytes)
+            welcome.status = kDaemonRefused;
+        else if ((shm = daemon_detail::make_shared_memory(ring_bytes)) < 0 ||
+                 (ring = (uint8_t *)::mmap(nullptr, ring_bytes, PROT_READ, MAP_SHARED, shm, 0)) == (uint8_t *)MAP_FAILED)
+        {
+            std::cerr << "Daemon: shared memory of " << ring_bytes << " bytes failed: " << strerror(errno) << std::endl;
+            ring = nullptr;
+            welcome.status = kDaemonRefused;
+        }
+        if (welcome.status == kDaemonOk)
+        {
+            welcome.slots = hello.slots;
+            welcome.slot_bytes = hello.slot_bytes;
+        }
+        std::string msg((const char *)&welcome, sizeof(welcome));
+        msg += names_blob_;
+        bool sent = shm >= 0 ? daemon_detail::send_with_fd(c.fd, msg.data(), msg.size(), shm) : send_all(c.fd, msg.data(), msg.size());
+        if (shm >= 0)
+            ::close(shm); // the mapping (and the client's descriptor) keep it alive
+        if (!sent || welcome.status != kDaemonOk)
+        {
+            if (ring)
+                ::munmap(ring, ring_bytes);
+            return;
+        }
+        if (cfg_.log_level >= 2)
+            std::cout << "Daemon: client " << c.id << " connected, " << hello.slots << " slots of " << hello.slot_bytes << " bytes" << std::endl;
+
+        const size_t in_elems = (size_t)3 * input_w_ * input_h_;
+        const int C = backend_.output_channels(), L = backend_.output_anchors();
+        std::vector<Pending> slots(hello.slots);
+        std::vector<float *> buffers;
+        for (uint32_t i = 0; i < hello.slots; ++i)
+        {
+            slots[i].job.input = buffers.emplace_back(backend_.alloc_host(in_elems));
+            slots[i].job.output = buffers.emplace_back(backend_.alloc_host((size_t)C * L));
+        }
+        std::vector<bool> busy(hello.slots, false);
+        std::deque<uint32_t> order; // slots in request order
+        LetterboxScratch lb_scratch;
+        YoloDecodeScratch decode_scratch;
+        DetectionBuffer candidates;
+        NmsScratch nms_scratch;
+        std::vector<int> keep;
+        std::vector<Detection> dets;
+        cv::Mat decoded;
+        std::shared_ptr<const LetterboxPlan> plan;
+        ResultEncoder encoder;
+        std::string reply;
+        const std::string stream_name = "client" + std::to_string(c.id);
+
+        for (;;)
+        {
+            // read another request while slots are free and one is already waiting;
+            // otherwise (or when nothing is pending) answer the oldest
+            bool read = order.empty();
+            if (!read && order.size() < hello.slots)
+            {
+                pollfd p{c.fd, POLLIN, 0};
+                read = ::poll(&p, 1, 0) > 0;
+            }
+            if (read)
+            {
+                DaemonRequest req;
+                if (!recv_all(c.fd, &req, sizeof(req)))
+                    break;
+                auto received = std::chrono::steady_clock::now();
+                requests_.fetch_add(1, std::memory_order_relaxed);
+                if (req.magic != kDaemonMagic || req.type != kDaemonRequest || req.slot >= hello.slots || busy[req.slot])
+                {
+                    // out of sync or reusing a slot before its reply: no answer would keep the order
+                    if (cfg_.log_level >= 1)
+                        std::cerr << "Daemon: protocol error from client " << c.id << ", disconnecting" << std::endl;
+                    break;
+                }
+                Pending &p = slots[req.slot];
+                p.req = req;
+                p.received = received;
+                p.status = kDaemonOk;
+                const uint8_t *src = ring + (size_t)req.slot * hello.slot_bytes;
+                const uint8_t *pixels = src;
+                int w = req.width, h = req.height;
+                size_t step = (size_t)req.stride;
+                if (req.format == kDaemonFrameEncoded)
+                {
+                    if (req.length == 0 || req.length > hello.slot_bytes)
+                        p.status = kDaemonBadRequest;
+                    else
+                    {
+                        decoded = cv::imdecode(cv::Mat(1, (int)req.length, CV_8UC1, (void *)src), cv::IMREAD_COLOR);
+                        if (decoded.empty() || decoded.type() != CV_8UC3)
+                            p.status = kDaemonDecodeFailed;
+                        else
+                        {
+                            pixels = decoded.data;
+                            w = decoded.cols;
+                            h = decoded.rows;
+                            step = decoded.step;
+                        }
+                    }
+                }
+                else if (req.format != kDaemonFrameBgr || w <= 0 || h <= 0 || step < (size_t)w * 3 ||
+                         (uint64_t)step * (h - 1) + (uint64_t)w * 3 > hello.slot_bytes)
+                    p.status = kDaemonBadRequest;
+                if (p.status == kDaemonOk)
+                {
+                    if (!plan || plan->src_w != w || plan->src_h != h)
+                        plan = std::make_shared<const LetterboxPlan>(make_letterbox_plan(w, h, input_w_, input_h_));
+                    p.plan = plan;
+                    letterbox_bgr_to_planar(pixels, step, *plan, lb_scratch, p.job.input);
+                    enqueue(p.job);
+                }
+                busy[req.slot] = true;
+                order.push_back(req.slot);
+                continue;
+            }
+
+            uint32_t slot = order.front();
+            order.pop_front();
+            Pending &p = slots[slot];
+            if (p.status == kDaemonOk)
+            {
+                wait(p.job);
+                if (!p.job.ok)
+                    p.status = kDaemonInferFailed;
+            }
+            dets.clear();
+            if (p.status == kDaemonOk)
+            {
+                float conf = p.req.conf > 0.0f ? p.req.conf : cfg_.conf_thresh;
+                decode_yolo_output(p.job.output, C, L, *p.plan, conf, decode_scratch, candidates);
+                nms_boxes(candidates, cfg_.nms, nms_scratch, keep);
+                for (int k : keep)
+                    dets.push_back(candidates.at(k));
+            }
+            reply.assign(sizeof(DaemonReply), '\0');
+            if (p.status == kDaemonOk)
+            {
+                int64_t wall_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                if (p.req.reply == kDaemonReplyJsonl)
+                    encoder.jsonl(reply, stream_name, p.req.frame, p.req.time_sec, wall_us, true, dets, class_names_);
+                else
+                    encoder.binary(reply, p.req.stream, p.req.frame, p.req.time_sec, wall_us, true, dets);
+            }
+            DaemonReply r;
+            r.id = p.req.id;
+            r.status = p.status;
+            r.length = (uint32_t)(reply.size() - sizeof(DaemonReply));
+            r.count = (uint32_t)dets.size();
+            r.queue_ms = (float)p.job.queue_ms;
+            r.infer_ms = (float)p.job.infer_ms;
+            r.total_ms = (float)daemon_detail::ms_since(p.received);
+            memcpy(&reply[0], &r, sizeof(r));
+            busy[slot] = false;
+            if (!send_all(c.fd, reply.data(), reply.size()))
+                break;
+        }
+
+        // the batcher may still hold jobs of this client: wait them out before freeing the buffers
+        for (uint32_t slot : order)
+            if (slots[slot].status == kDaemonOk)
+                wait(slots[slot].job);
+        for (float *b : buffers)
+            backend_.free_host(b);
+        ::munmap(ring, ring_bytes);
+    }
+
+    void enqueue(Job &job)
+    {
+        job.done = false;
+        job.ok = false;
+        job.queued = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (stop_)
+            {
+                job.done = true; // the batcher is gone or going: fail it
+                return;
+            }
+            queue_.push_back(&job);
+        }
+        queued_.notify_one();
+    }
+
+    // Every queued job ends up done: run by the batcher, or failed when it stops.
+    void wait(Job &job)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        done_.wait(lock, [&]
+                   { return job.done; });
+    }
+
+    void batch_loop()
+    {
+        const int B = std::max(1, std::min(cfg_.max_batch, backend_.max_batch()));
+        std::vector<Job *> batch;
+        std::vector<const float *> inputs;
+        std::vector<float *> outputs;
+        std::unique_lock<std::mutex> lock(mu_);
+        for (;;)
+        {
+            queued_.wait(lock, [this]
+                         { return stop_ || !queue_.empty(); });
+            if (stop_)
+                break;
+            // a partial batch waits a little for frames of other clients
+            if ((int)queue_.size() < B && cfg_.max_wait_ms > 0.0)
+            {
+                auto deadline = queue_.front()->queued + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                             std::chrono::duration<double, std::milli>(cfg_.max_wait_ms));
+                queued_.wait_until(lock, deadline, [this, B]
+                                   { return stop_ || (int)queue_.size() >= B; });
+                if (stop_)
+                    break;
+            }
+            batch.clear();
+            while (!queue_.empty() && (int)batch.size() < B)
+            {
+                batch.push_back(queue_.front());
+                queue_.pop_front();
+            }
+            lock.unlock();
+            inputs.clear();
+            outputs.clear();
+            auto t0 = std::chrono::steady_clock::now();
+            for (Job *j : batch)
+            {
+                inputs.push_back(j->input);
+                outputs.push_back(j->output);
+                j->queue_ms = std::chrono::duration<double, std::milli>(t0 - j->queued).count();
+            }
+            bool ok = backend_.infer_batch(inputs.data(), outputs.data(), (int)batch.size());
+            double infer_ms = daemon_detail::ms_since(t0);
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            frames_inferred_.fetch_add(batch.size(), std::memory_order_relaxed);
+            if (!ok)
+                std::cerr << "Daemon: inference failed on a batch of " << batch.size() << std::endl;
+            lock.lock();
+            for (Job *j : batch)
+            {
+                j->ok = ok;
+                j->infer_ms = infer_ms;
+                j->done = true;
+            }
+            done_.notify_all();
+        }
+        // nobody takes jobs any more: fail what is left so drains finish
+        for (Job *j : queue_)
+            j->done = true;
+        queue_.clear();
+        done_.notify_all();
+    }
+
+    InferenceBackend &backend_;
+    const DaemonConfig cfg_;
+    const int input_w_, input_h_;
+    const std::vector<std::string> class_names_;
+    std::string names_blob_;
+    std::string path_;
+    int listen_fd_ = -1;
+
+    std::mutex mu_;
+    std::condition_variable queued_, done_;
+    std::deque<Job *> queue_;
+    std::list<std::unique_ptr<Client>> clients_;
+    bool stop_ = false;
+    std::thread acceptor_, batcher_;
+    std::atomic<uint32_t> clients_seen_{0};
+    std::atomic<uint64_t> requests_{0}, batches_{0}, frames_inferred_{0};
+};
+
+// Client side. Frames go into slot(k) (directly, for zero-copy, or via detect()),
+// then submit(); receive() returns the replies in order.
+class InferClient
+{
+public:
+    InferClient() = default;
+    ~InferClient() { close(); }
+
+    InferClient(const InferClient &) = delete;
+    InferClient &operator=(const InferClient &) = delete;
+
+    // `slot_bytes`: largest frame (raw: stride * height) the client will send.
+    bool connect(const std::string &path, uint32_t slots = 2, uint64_t slot_bytes = 1920ull * 1080 * 3)
+    {
+        close();
+        sockaddr_un addr;
+        if (!daemon_detail::make_unix_address(path, addr))
+        {
+            error_ = "invalid socket path";
+            return false;
+        }
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0 || ::connect(fd_, (const sockaddr *)&addr, sizeof(addr)) != 0)
+            return fail(std::string("connect: ") + strerror(errno));
+        DaemonHello hello;
+        hello.slots = slots;
+        hello.slot_bytes = slot_bytes;
+        DaemonWelcome w;
+        int shm = -1;
+        if (!daemon_detail::send_all(fd_, &hello, sizeof(hello)) || !daemon_detail::recv_with_fd(fd_, &w, sizeof(w), shm))
+            return fail("handshake failed");
+        std::string names(w.names_length, '\0');
+        bool ok = w.magic == kDaemonMagic && w.type == kDaemonWelcome && daemon_detail::recv_all(fd_, &names[0], names.size());
+        if (!ok || w.status != kDaemonOk || shm < 0)
+        {
+            if (shm >= 0)
+                ::close(shm);
+            return fail(ok ? "daemon refused the frame ring (" + std::to_string(slots) + " x " + std::to_string(slot_bytes) + " bytes)" : "bad welcome");
+        }
+        welcome_ = w;
+        ring_bytes_ = w.slots * w.slot_bytes;
+        void *m = ::mmap(nullptr, ring_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        ::close(shm);
+        if (m == MAP_FAILED)
+            return fail(std::string("mmap: ") + strerror(errno));
+        ring_ = (uint8_t *)m;
+        class_names_.clear();
+        size_t start = 0;
+        for (size_t nl; (nl = names.find('\n', start)) != std::string::npos; start = nl + 1)
+            class_names_.push_back(names.substr(start, nl - start));
+        return true;
+    }
+
+    void close()
+    {
+        if (ring_)
+            ::munmap(ring_, ring_bytes_);
+        ring_ = nullptr;
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool connected() const { return fd_ >= 0 && ring_; }
+    const std::string &error() const { return error_; }
+    uint32_t slots() const { return welcome_.slots; }
+    uint64_t slot_bytes() const { return welcome_.slot_bytes; }
+    int input_w() const { return welcome_.input_w; }
+    int input_h() const { return welcome_.input_h; }
+    const std::vector<std::string> &class_names() const { return class_names_; }
+    uint8_t *slot(uint32_t k) const { return ring_ + (size_t)k * welcome_.slot_bytes; }
+
+    // Sends a request for the frame already in `req.slot`.
+    bool submit(const DaemonRequest &req)
+    {
+        return daemon_detail::send_all(fd_, &req, sizeof(req)) || fail("send failed");
+    }
+
+    // Next reply (in request order); `payload` holds its record.
+    bool receive(DaemonReply &reply, std::string &payload)
+    {
+        if (!daemon_detail::recv_all(fd_, &reply, sizeof(reply)) || reply.magic != kDaemonMagic || reply.type != kDaemonReply)
+            return fail("connection lost");
+        payload.resize(reply.length);
+        return reply.length == 0 || daemon_detail::recv_all(fd_, &payload[0], payload.size()) || fail("connection lost");
+    }
+
+    // One synchronous round trip through slot 0: copies `bgr` in (rows packed) and
+    // returns its detections in frame coordinates.
+    bool detect(const cv::Mat &bgr, std::vector<Detection> &dets, float conf = 0.0f, DaemonReply *info = nullptr)
+    {
+        dets.clear();
+        if (!connected() || bgr.empty() || bgr.type() != CV_8UC3)
+            return fail("not connected or not a BGR image");
+        size_t row = (size_t)bgr.cols * 3;
+        if (row * bgr.rows > welcome_.slot_bytes)
+            return fail("frame larger than a slot");
+        for (int y = 0; y < bgr.rows; ++y)
+            memcpy(slot(0) + y * row, bgr.ptr(y), row);
+        DaemonRequest req;
+        req.id = ++next_id_;
+        req.width = bgr.cols;
+        req.height = bgr.rows;
+        req.stride = (int32_t)row;
+        req.conf = conf;
+        DaemonReply reply;
+        if (!submit(req) || !receive(reply, payload_))
+            return false;
+        if (info)
+            *info = reply;
+        if (reply.status != kDaemonOk)
+            return fail("daemon status " + std::to_string(reply.status));
+        return parse_boxes(payload_, dets) || fail("bad record");
+    }
+
+    // Boxes of one bin record (ResultRecordHeader + ResultBox entries).
+    static bool parse_boxes(const std::string &record, std::vector<Detection> &dets)
+    {
+        dets.clear();
+        ResultRecordHeader h;
+        if (record.size() < sizeof(h))
+            return false;
+        memcpy(&h, record.data(), sizeof(h));
+        if (h.magic != kResultMagic || record.size() != sizeof(h) + (size_t)h.count * sizeof(ResultBox))
+            return false;
+        for (uint32_t i = 0; i < h.count; ++i)
+        {
+            ResultBox b;
+            memcpy(&b, record.data() + sizeof(h) + i * sizeof(ResultBox), sizeof(b));
+            Detection d{b.x1, b.y1, b.x2, b.y2, b.score, b.class_id};
+            d.track_id = b.track_id;
+            dets.push_back(d);
+        }
+        return true;
+    }
+
+private:
+    bool fail(const std::string &what)
+    {
+        error_ = what;
+        return false;
+    }
+
+    int fd_ = -1;
+    uint8_t *ring_ = nullptr;
+    size_t ring_bytes_ = 0;
+    DaemonWelcome welcome_;
+    std::vector<std::string> class_names_;
+    std::string error_, payload_;
+    uint32_t next_id_ = 0;
+};
@@ -1,17 +1,39 @@
 ## 3. 推理代码 infer_helmet_vest.py
 import argparse
-from ultralytics import YOLO
 from pathlib import Path
 import os
 
+IMAGE_EXTS = {'.jpg', '.jpeg', '.png', '.bmp', '.webp', '.tif', '.tiff'}
+
+def predict_daemon(args):
+    # 模型已由常驻进程加载（trt_batch_infer <engine> --serve <socket> ...），图片原样发送，由它解码
+    from helmet_client import HelmetClient
+    src = Path(args.source)
+    files = sorted(p for p in src.iterdir() if p.suffix.lower() in IMAGE_EXTS) if src.is_dir() else [src]
+    with HelmetClient(args.daemon, slots=1, slot_bytes=64 << 20) as client:
+        for f in files:
+            print(f'文件: {f}')
+            for b in client.detect_encoded(f.read_bytes(), conf=args.conf):
+                name = client.names[b.class_id] if 0 <= b.class_id < len(client.names) else str(b.class_id)
+                print(f'  类别: {name}, 置信度: {b.score:.2f}, 坐标: {[b.x1, b.y1, b.x2, b.y2]}')
+
 def main():
     parser = argparse.ArgumentParser()
-    parser.add_argument('--weights', type=str, required=True, help='模型权重路径')
+    parser.add_argument('--weights', type=str, default=None, help='模型权重路径（--daemon 时不需要）')
     parser.add_argument('--source', type=str, required=True, help='待检测图片/文件夹/视频/视频文件夹')
     parser.add_argument('--save-dir', type=str, default='outputs', help='检测结果保存目录')
     parser.add_argument('--conf', type=float, default=0.25, help='置信度阈值')
+    parser.add_argument('--daemon', type=str, default=None, help='推理守护进程的 unix socket（不加载模型，只输出检测结果，支持图片/图片文件夹）')
     args = parser.parse_args()
 
+    if args.daemon:
+        predict_daemon(args)
+        return
+
+    if not args.weights:
+        parser.error('--weights 或 --daemon 必须指定一个')
+    from ultralytics import YOLO
+
     # 加载模型
     model = YOLO(args.weights)
 
@@ -0,0 +1,195 @@
+#pragma once
+// Interface between the processing pipeline and whatever runs the model.
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model_file.hpp"
+
+struct BackendConfig
+{
+    std::string model_path; // .engine for TensorRT, .onnx for OpenCV DNN, unused by the stub
+    int input_w = 640, input_h = 640;
+    int num_classes = 0;     // used by the stub to size its output
+    int max_batch = 1;       // upper bound for dynamic-batch models
+    int async_slots = 1;     // batches that may be in flight at once (1 = synchronous)
+    int log_level = 1;
+    double stub_latency_ms = 0.0;
+    // TensorRT given an .onnx: engines are built once and kept in this directory ("" = off)
+    std::string engine_cache_dir;
+    std::string engine_build_args = "--fp16"; // trtexec options for cache builds
+};
+
+class InferenceBackend
+{
+public:
+    virtual ~InferenceBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    // Load the model and bind IO buffers. Returns 0 on success, otherwise the
+    // exit code trt_batch_infer reports (the message has already been printed).
+    virtual int load(const BackendConfig &cfg) = 0;
+
+    // Time spent in each step of load(), for the startup report.
+    const StartupTimes &startup_times() const { return startup_; }
+
+    // Combined head output is [C, L] with C = 4 + num_classes (0 if the model has none).
+    virtual int output_channels() const = 0;
+    virtual int output_anchors() const = 0;
+
+    // Host buffers passed to infer(); a GPU backend may hand out pinned memory.
+    virtual float *alloc_host(size_t elems) { return new float[elems]; }
+    virtual void free_host(float *p) { delete[] p; }
+
+    // Run the model on one frame and fetch its output.
+    // input: 3 x input_h x input_w planar RGB in [0,1]; output: C x L floats.
+    virtual bool infer(const float *input, float *output) = 0;
+
+    // Largest n accepted by infer_batch().
+    virtual int max_batch() const { return 1; }
+
+    // Run n frames in one call; inputs[i] / outputs[i] are per-frame buffers as for infer().
+    virtual bool infer_batch(const float *const *inputs, float *const *outputs, int n)
+    {
+        for (int i = 0; i < n; ++i)
+            if (!infer(inputs[i], outputs[i]))
+                return false;
+        return true;
+    }
+
+    // Asynchronous execution: up to async_slots() batches can be submitted, each in
+    // its own slot; the buffers must stay untouched until wait(slot) returns, after
+    // which the outputs are valid. The default runs synchronously in submit().
+    virtual int async_slots() const { return 1; }
+    virtual bool submit(int slot, const float *const *inputs, float *const *outputs, int n)
+    {
+        (void)slot;
+        return infer_batch(inputs, outputs, n);
+    }
+    virtual bool wait(int slot)
+    {
+        (void)slot;
+        return true;
+    }
+
+protected:
+    StartupTimes startup_;
+};
+
+// Anchor count of a YOLOv8-style head (strides 8/16/32) for a given input size.
+inline int yolo_anchor_count(int input_w, int input_h)
+{
+    int n = 0;
+    for (int s : {8, 16, 32})
+        n += ((input_w + s - 1) / s) * ((input_h + s - 1) / s);
+    return n;
+}
+
+// CPU stand-in for the model so the pipeline can run end-to-end without a GPU.
+// Emits one fixed box per class (cycling through classes frame by frame) and can
+// simulate inference latency; the latency is paid once per call, so batching
+// amortizes it the way it amortizes launch overhead on a real engine. With more
+// than one async slot, submissions run on a background "device" (one at a time,
+// like a GPU) so the caller overlaps with them.
+class StubBackend : public InferenceBackend
+{
+public:
+    StubBackend() : StubBackend(640, 640, 1) {}
+    StubBackend(int input_w, int input_h, int num_classes, double latency_ms = 0.0, int max_batch = 1, int async_slots = 1)
+        : input_w_(input_w), input_h_(input_h), num_classes_(std::max(1, num_classes)),
+          anchors_(yolo_anchor_count(input_w, input_h)), max_batch_(std::max(1, max_batch)), latency_ms_(latency_ms),
+          pending_(std::max(1, async_slots))
+    {
+    }
+
+    const char *name() const override { return "stub"; }
+
+    int load(const BackendConfig &cfg) override
+    {
+        input_w_ = cfg.input_w;
+        input_h_ = cfg.input_h;
+        num_classes_ = std::max(1, cfg.num_classes);
+        anchors_ = yolo_anchor_count(input_w_, input_h_);
+        max_batch_ = std::max(1, cfg.max_batch);
+        latency_ms_ = cfg.stub_latency_ms;
+        pending_ = std::vector<std::future<void>>(std::max(1, cfg.async_slots));
+        return 0;
+    }
+
+    int max_batch() const override { return max_batch_; }
+    int async_slots() const override { return (int)pending_.size(); }
+    size_t calls() const { return calls_; }
+    int output_channels() const override { return 4 + num_classes_; }
+    int output_anchors() const override { return anchors_; }
+
+    bool infer(const float *input, float *output) override
+    {
+        return infer_batch(&input, &output, 1);
+    }
+
+    bool infer_batch(const float *const * /*inputs*/, float *const *outputs, int n) override
+    {
+        if (n <= 0 || n > max_batch_)
+            return false;
+        ++calls_;
+        run(outputs, n);
+        return true;
+    }
+
+    bool submit(int slot, const float *const *inputs, float *const *outputs, int n) override
+    {
+        (void)inputs;
+        if (pending_.size() == 1)
+            return infer_batch(inputs, outputs, n);
+        if (n <= 0 || n > max_batch_ || slot < 0 || slot >= (int)pending_.size() || pending_[slot].valid())
+            return false;
+        ++calls_;
+        std::vector<float *> outs(outputs, outputs + n);
+        pending_[slot] = std::async(std::launch::async, [this, outs]
+                                    {
+                                        std::lock_guard<std::mutex> device(device_);
+                                        run(outs.data(), (int)outs.size()); });
+        return true;
+    }
+
+    bool wait(int slot) override
+    {
+        if (slot < 0 || slot >= (int)pending_.size())
+            return false;
+        if (pending_[slot].valid())
+            pending_[slot].get();
+        return true;
+    }
+
+private:
+    void run(float *const *outputs, int n)
+    {
+        if (latency_ms_ > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(latency_ms_));
+        size_t L = (size_t)anchors_;
+        for (int i = 0; i < n; ++i)
+        {
+            float *output = outputs[i];
+            std::memset(output, 0, sizeof(float) * L * output_channels());
+            int cls = (int)(frames_++ % num_classes_);
+            output[0 * L] = input_w_ * 0.5f;
+            output[1 * L] = input_h_ * 0.5f;
+            output[2 * L] = input_w_ * 0.25f;
+            output[3 * L] = input_h_ * 0.25f;
+            output[(4 + cls) * L] = 0.9f;
+        }
+    }
+
+    int input_w_, input_h_, num_classes_, anchors_, max_batch_;
+    double latency_ms_;
+    size_t calls_ = 0, frames_ = 0;
+    std::vector<std::future<void>> pending_; // one per async slot
+    std::mutex device_;                      // submissions execute one at a time
+};
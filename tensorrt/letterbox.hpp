@@ -0,0 +1,257 @@
+#pragma once
+// Fused letterbox preprocessing: BGR uint8 frame -> normalized planar RGB float.
+//
+// One pass over the source replaces cvtColor -> resize -> copyMakeBorder ->
+// convertTo -> split -> memcpy. Interpolation follows OpenCV's INTER_LINEAR
+// fixed-point scheme (11-bit coefficients, same sample positions and edge
+// clamping, same rounding as its vectorized vertical pass), so the output
+// matches preprocess() bit for bit except for the few tail pixels cv::resize
+// finishes with its scalar formula, and builds using IPP/Carotene resize,
+// where values may differ by 1/255.
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Geometry and interpolation tables for one (source size -> model size) pair.
+// Built once per input resolution and shared read-only between threads.
+struct LetterboxPlan
+{
+    int src_w = 0, src_h = 0;
+    int dst_w = 0, dst_h = 0;
+    float r = 1.0f; // scale from source to model space
+    int new_w = 0, new_h = 0;
+    int left = 0, top = 0;            // integer pad used when writing the input tensor
+    float pad_x = 0.0f, pad_y = 0.0f; // dw / 2.0f, dh / 2.0f used when mapping boxes back
+    float pad_value = 0.0f;           // 114 / 255
+
+    // per resized column: byte offsets of the two source pixels and their weights
+    std::vector<int> xofs0, xofs1, xw0, xw1;
+    // per resized row: the two source rows and their weights
+    std::vector<int> yofs0, yofs1, yw0, yw1;
+    // columns [0, simd_cols) can use 32-bit gathers without reading past the row end
+    int simd_cols = 0;
+
+    bool matches(int w, int h, int in_w, int in_h) const
+    {
+        return src_w == w && src_h == h && dst_w == in_w && dst_h == in_h;
+    }
+};
+
+// Per-thread working rows (horizontally resampled source rows, planar RGB).
+struct LetterboxScratch
+{
+    std::vector<int> rows[2];
+    int row_src[2] = {-1, -1};
+};
+
+namespace letterbox_detail
+{
+    constexpr int kCoefBits = 11;
+    constexpr int kCoefScale = 1 << kCoefBits;
+
+    inline void build_axis(int src_len, int dst_len, std::vector<int> &i0, std::vector<int> &i1,
+                           std::vector<int> &w0, std::vector<int> &w1)
+    {
+        i0.resize(dst_len);
+        i1.resize(dst_len);
+        w0.resize(dst_len);
+        w1.resize(dst_len);
+        double scale = 1.0 / ((double)dst_len / src_len);
+        for (int d = 0; d < dst_len; ++d)
+        {
+            float f = (float)((d + 0.5) * scale - 0.5);
+            int s = (int)std::floor(f);
+            f -= s;
+            if (s < 0)
+            {
+                f = 0.0f;
+                s = 0;
+            }
+            if (s >= src_len - 1)
+            {
+                f = 0.0f;
+                s = src_len - 1;
+            }
+            i0[d] = s;
+            i1[d] = std::min(s + 1, src_len - 1);
+            w0[d] = (int)std::lrintf((1.0f - f) * kCoefScale);
+            w1[d] = (int)std::lrintf(f * kCoefScale);
+        }
+    }
+
+    // Horizontal pass for one source row into three planar int rows (R, G, B).
+    inline void hresize_row(const uint8_t *src, const LetterboxPlan &p, int *out)
+    {
+        int n = p.new_w;
+        int *out_r = out, *out_g = out + n, *out_b = out + 2 * n;
+        int dx = 0;
+#if defined(__AVX2__)
+        const __m256i mask = _mm256_set1_epi32(0xFF);
+        for (; dx + 8 <= p.simd_cols; dx += 8)
+        {
+            __m256i i0 = _mm256_loadu_si256((const __m256i *)(p.xofs0.data() + dx));
+            __m256i i1 = _mm256_loadu_si256((const __m256i *)(p.xofs1.data() + dx));
+            __m256i w0 = _mm256_loadu_si256((const __m256i *)(p.xw0.data() + dx));
+            __m256i w1 = _mm256_loadu_si256((const __m256i *)(p.xw1.data() + dx));
+            int *dst[3] = {out_r, out_g, out_b};
+            for (int c = 0; c < 3; ++c)
+            {
+                const int *base = (const int *)(src + 2 - c); // plane c (RGB) reads BGR byte 2 - c
+                __m256i a = _mm256_and_si256(_mm256_i32gather_epi32(base, i0, 1), mask);
+                __m256i b = _mm256_and_si256(_mm256_i32gather_epi32(base, i1, 1), mask);
+                __m256i s = _mm256_add_epi32(_mm256_mullo_epi32(a, w0), _mm256_mullo_epi32(b, w1));
+                _mm256_storeu_si256((__m256i *)(dst[c] + dx), s);
+            }
+        }
+#endif
+        for (; dx < n; ++dx)
+        {
+            const uint8_t *a = src + p.xofs0[dx];
+            const uint8_t *b = src + p.xofs1[dx];
+            int w0 = p.xw0[dx], w1 = p.xw1[dx];
+            out_r[dx] = a[2] * w0 + b[2] * w1;
+            out_g[dx] = a[1] * w0 + b[1] * w1;
+            out_b[dx] = a[0] * w0 + b[0] * w1;
+        }
+    }
+
+    // Vertical blend of two horizontally resampled rows, rounding to uint8 the way
+    // cv::resize does ((S >> 4) * beta >> 16, then a rounding shift by 2) and
+    // scaling to [0,1] exactly like convertTo(CV_32F, 1/255).
+    inline void vresize_row(const int *s0, const int *s1, int b0, int b1, int n, float scale, float *dst)
+    {
+        int x = 0;
+#if defined(__AVX2__)
+        const __m256i vb0 = _mm256_set1_epi32(b0), vb1 = _mm256_set1_epi32(b1);
+        const __m256i two = _mm256_set1_epi32(2);
+        const __m256 vscale = _mm256_set1_ps(scale);
+        for (; x + 8 <= n; x += 8)
+        {
+            __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(s0 + x)), 4);
+            __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(s1 + x)), 4);
+            a = _mm256_srai_epi32(_mm256_mullo_epi32(a, vb0), 16);
+            b = _mm256_srai_epi32(_mm256_mullo_epi32(b, vb1), 16);
+            __m256i v = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(a, b), two), 2);
+            _mm256_storeu_ps(dst + x, _mm256_mul_ps(_mm256_cvtepi32_ps(v), vscale));
+        }
+#elif defined(__ARM_NEON)
+        const int32x4_t vb0 = vdupq_n_s32(b0), vb1 = vdupq_n_s32(b1);
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; x + 4 <= n; x += 4)
+        {
+            int32x4_t a = vshrq_n_s32(vmulq_s32(vshrq_n_s32(vld1q_s32(s0 + x), 4), vb0), 16);
+            int32x4_t b = vshrq_n_s32(vmulq_s32(vshrq_n_s32(vld1q_s32(s1 + x), 4), vb1), 16);
+            int32x4_t v = vrshrq_n_s32(vaddq_s32(a, b), 2);
+            vst1q_f32(dst + x, vmulq_f32(vcvtq_f32_s32(v), vscale));
+        }
+#endif
+        for (; x < n; ++x)
+        {
+            int v = ((((s0[x] >> 4) * b0) >> 16) + (((s1[x] >> 4) * b1) >> 16) + 2) >> 2;
+            dst[x] = (float)v * scale;
+        }
+    }
+} // namespace letterbox_detail
+
+inline LetterboxPlan make_letterbox_plan(int src_w, int src_h, int input_w, int input_h)
+{
+    LetterboxPlan p;
+    p.src_w = src_w;
+    p.src_h = src_h;
+    p.dst_w = input_w;
+    p.dst_h = input_h;
+    p.r = std::min((float)input_w / src_w, (float)input_h / src_h);
+    p.new_w = (int)std::round(src_w * p.r);
+    p.new_h = (int)std::round(src_h * p.r);
+    int dw = input_w - p.new_w;
+    int dh = input_h - p.new_h;
+    p.left = dw / 2;
+    p.top = dh / 2;
+    p.pad_x = dw / 2.0f;
+    p.pad_y = dh / 2.0f;
+    p.pad_value = 114.0f * static_cast<float>(1.0 / 255.0);
+
+    letterbox_detail::build_axis(src_w, p.new_w, p.xofs0, p.xofs1, p.xw0, p.xw1);
+    letterbox_detail::build_axis(src_h, p.new_h, p.yofs0, p.yofs1, p.yw0, p.yw1);
+    p.simd_cols = 0;
+    for (int dx = 0; dx < p.new_w; ++dx)
+    {
+        // a 4-byte gather at byte (x1 * 3 + 2) must stay inside the row
+        if (p.xofs1[dx] * 3 + 6 > src_w * 3)
+            break;
+        p.simd_cols = dx + 1;
+    }
+    for (int dx = 0; dx < p.new_w; ++dx)
+    {
+        p.xofs0[dx] *= 3;
+        p.xofs1[dx] *= 3;
+    }
+    return p;
+}
+
+// Write one letterboxed frame as planar RGB float (C x input_h x input_w) into dst.
+// src is a BGR uint8 image of plan.src_w x plan.src_h with row stride src_step bytes;
+// dst may be pinned host memory and is fully overwritten, including the 114 pad.
+inline void letterbox_bgr_to_planar(const uint8_t *src, size_t src_step, const LetterboxPlan &p,
+                                    LetterboxScratch &scratch, float *dst)
+{
+    const size_t plane = (size_t)p.dst_w * p.dst_h;
+    const float scale = static_cast<float>(1.0 / 255.0);
+    for (int k = 0; k < 2; ++k)
+    {
+        if (scratch.rows[k].size() != 3 * (size_t)p.new_w)
+            scratch.rows[k].assign(3 * (size_t)p.new_w, 0);
+        scratch.row_src[k] = -1; // cached rows belong to the previous frame
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        float *pl = dst + c * plane;
+        std::fill(pl, pl + (size_t)p.top * p.dst_w, p.pad_value);
+        std::fill(pl + (size_t)(p.top + p.new_h) * p.dst_w, pl + plane, p.pad_value);
+    }
+
+    for (int dy = 0; dy < p.new_h; ++dy)
+    {
+        // consecutive output rows mostly share source rows; keep the last two resampled
+        int sy0 = p.yofs0[dy], sy1 = p.yofs1[dy];
+        if (scratch.row_src[0] != sy0)
+        {
+            if (scratch.row_src[1] == sy0)
+            {
+                std::swap(scratch.rows[0], scratch.rows[1]);
+                std::swap(scratch.row_src[0], scratch.row_src[1]);
+            }
+            else
+            {
+                letterbox_detail::hresize_row(src + (size_t)sy0 * src_step, p, scratch.rows[0].data());
+                scratch.row_src[0] = sy0;
+            }
+        }
+        if (sy1 != sy0 && scratch.row_src[1] != sy1)
+        {
+            letterbox_detail::hresize_row(src + (size_t)sy1 * src_step, p, scratch.rows[1].data());
+            scratch.row_src[1] = sy1;
+        }
+        const int *row0 = scratch.rows[0].data();
+        const int *row1 = (sy1 == sy0) ? row0 : scratch.rows[1].data();
+
+        size_t y = (size_t)(p.top + dy);
+        for (int c = 0; c < 3; ++c)
+        {
+            float *line = dst + c * plane + y * p.dst_w;
+            std::fill(line, line + p.left, p.pad_value);
+            letterbox_detail::vresize_row(row0 + c * p.new_w, row1 + c * p.new_w,
+                                          p.yw0[dy], p.yw1[dy], p.new_w, scale, line + p.left);
+            std::fill(line + p.left + p.new_w, line + p.dst_w, p.pad_value);
+        }
+    }
+}
@@ -1,82 +1,126 @@
 #!/usr/bin/env python3
-import os, sys, subprocess, cv2, shutil
+# Annotated copy of a video, with detections from the inference daemon.
+#
+# Frames are decoded here, written straight into the daemon's shared-memory
+# slots and drawn on as the replies come back; two slots keep the daemon busy
+# while the next frame is decoded. Without --socket a daemon is started for the
+# run (and the model loaded once for the whole video).
+import os, sys, subprocess, tempfile, time, argparse
+import cv2
+import numpy as np
 from pathlib import Path
 
-if len(sys.argv) < 5:
-    print("Usage: make_annotated_video.py <engine> <video> <input_w> <input_h> [out_video]")
-    sys.exit(1)
+from helmet_client import HelmetClient, DaemonError
 
-engine = sys.argv[1]
-video = sys.argv[2]
-input_w = int(sys.argv[3])
-input_h = int(sys.argv[4])
-out_video = sys.argv[5] if len(sys.argv) > 5 else 'trt_result_video_from_frames.avi'
+parser = argparse.ArgumentParser(usage='make_annotated_video.py <engine> <video> <input_w> <input_h> [out_video] [--socket path] [--names names.txt]')
+parser.add_argument('engine')
+parser.add_argument('video')
+parser.add_argument('input_w', type=int)
+parser.add_argument('input_h', type=int)
+parser.add_argument('out_video', nargs='?', default='trt_result_video_from_frames.avi')
+parser.add_argument('--socket', help='use a running daemon (trt_batch_infer <engine> --serve <socket> ...)')
+parser.add_argument('--names', default='names.txt')
+parser.add_argument('--conf', type=float, default=0.25)
+parser.add_argument('--backend', default=None, help='--backend passed to a daemon started here')
+args = parser.parse_args()
 
 workdir = Path(__file__).resolve().parent
-tmp_in = workdir / 'tmp_in_frames'
-tmp_out = workdir / 'tmp_out_frames'
-shutil.rmtree(tmp_in, ignore_errors=True)
-shutil.rmtree(tmp_out, ignore_errors=True)
-tmp_in.mkdir(parents=True, exist_ok=True)
-tmp_out.mkdir(parents=True, exist_ok=True)
-
-cap = cv2.VideoCapture(video)
+cap = cv2.VideoCapture(args.video)
 if not cap.isOpened():
-    print('Failed to open video:', video); sys.exit(2)
+    print('Failed to open video:', args.video); sys.exit(2)
 fps = cap.get(cv2.CAP_PROP_FPS) or 25.0
 w = int(cap.get(cv2.CAP_PROP_FRAME_WIDTH))
 h = int(cap.get(cv2.CAP_PROP_FRAME_HEIGHT))
-print('Video opened:', video, 'fps=', fps, 'size=', w, 'x', h)
-
-frame_idx = 0
-frames = []
-while True:
-    ret, frame = cap.read()
-    if not ret: break
-    frame_idx += 1
-    fname = tmp_in / f'frame_{frame_idx:06d}.png'
-    cv2.imwrite(str(fname), frame)
-    frames.append(fname)
-    if frame_idx % 100 == 0:
-        print('Saved', frame_idx, 'frames')
-cap.release()
-print('Total frames extracted:', len(frames))
+print('Video opened:', args.video, 'fps=', fps, 'size=', w, 'x', h)
 
-# Run trt_infer_video_fix on each frame
-bin_path = workdir / 'trt_infer_video_fix'
-if not bin_path.exists():
-    print('Binary not found:', bin_path); sys.exit(3)
+daemon = None
+sock_path = args.socket
+if sock_path is None:
+    bin_path = workdir / 'trt_batch_infer'
+    if not bin_path.exists():
+        print('Binary not found:', bin_path); sys.exit(3)
+    sock_path = os.path.join(tempfile.gettempdir(), 'helmet_annotate_%d.sock' % os.getpid())
+    cmd = [str(bin_path), args.engine, '--serve', sock_path, str(args.input_w), str(args.input_h), args.names, '--conf', str(args.conf)]
+    if args.backend:
+        cmd += ['--backend', args.backend]
+    daemon = subprocess.Popen(cmd)
 
-for i, f in enumerate(frames, start=1):
-    outf = tmp_out / f.name
-    cmd = [str(bin_path), str(engine), str(f), str(input_w), str(input_h), '--names', 'names.txt', '--out', str(outf), '--conf', '0.25']
-    # call and wait
-    ret = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-    if ret.returncode != 0:
-        print('Frame', i, 'failed:', ret.returncode)
-        print(ret.stdout.decode())
-        print(ret.stderr.decode())
-        sys.exit(4)
-    if i % 50 == 0:
-        print('Processed', i, 'frames')
+def connect():
+    # a daemon started here needs the model loaded before it listens
+    deadline = time.time() + 300
+    while True:
+        try:
+            return HelmetClient(sock_path, slots=2, slot_bytes=max(1, w * h * 3))
+        except (FileNotFoundError, ConnectionRefusedError):
+            if daemon is None or daemon.poll() is not None or time.time() > deadline:
+                raise
+            time.sleep(0.2)
 
-# assemble annotated frames into video
-annot_files = sorted(tmp_out.glob('frame_*.png'))
-if not annot_files:
-    print('No annotated frames found'); sys.exit(5)
+try:
+    client = connect()
+except (OSError, DaemonError) as e:
+    print('Cannot reach the inference daemon at', sock_path, ':', e)
+    sys.exit(4)
 
 fourcc = cv2.VideoWriter_fourcc('M','J','P','G')
-outp = cv2.VideoWriter(str(workdir / out_video), fourcc, fps, (w,h))
+outp = cv2.VideoWriter(str(workdir / args.out_video), fourcc, fps, (w, h))
 if not outp.isOpened():
-    print('Failed to open output video writer for', out_video); sys.exit(6)
+    print('Failed to open output video writer for', args.out_video); sys.exit(6)
+
+colors = [(0, 200, 0), (0, 0, 255), (255, 128, 0), (0, 128, 255)]
+def annotate(frame, boxes):
+    for b in boxes:
+        c = colors[b.class_id % len(colors)]
+        p1, p2 = (int(round(b.x1)), int(round(b.y1))), (int(round(b.x2)), int(round(b.y2)))
+        cv2.rectangle(frame, p1, p2, c, 2)
+        name = client.names[b.class_id] if 0 <= b.class_id < len(client.names) else str(b.class_id)
+        cv2.putText(frame, '%s %.2f' % (name, b.score), (p1[0], max(0, p1[1] - 5)), cv2.FONT_HERSHEY_SIMPLEX, 0.6, c, 2)
+
+# each slot holds the frame until its reply has been drawn on it
+slots = [np.ndarray((h, w, 3), np.uint8, buffer=client.slot(k)) for k in range(client.slots)]
+in_flight = []  # slots, in submission order
+frame_idx = 0
+written = 0
+t0 = time.time()
+try:
+    while True:
+        if len(in_flight) < len(slots):
+            k = frame_idx % len(slots)
+            ret, img = cap.read(slots[k])
+            if ret and img is not slots[k]:
+                # OpenCV decoded into a new array instead of the slot (e.g. a rotated or
+                # resized stream): copy it in, the slot is laid out for w x h only
+                if img.shape != slots[k].shape:
+                    print('Frame', frame_idx, 'decoded as', 'x'.join(map(str, img.shape[1::-1])), 'but the video reports', w, 'x', h)
+                    sys.exit(7)
+                slots[k][...] = img
+            if ret:
+                client.submit(k, w, h, w * 3, conf=args.conf, frame=frame_idx)
+                in_flight.append(k)
+                frame_idx += 1
+                continue
+        if not in_flight:
+            break
+        k = in_flight.pop(0)
+        boxes = client.boxes(client.receive())
+        frame = slots[k].copy()
+        annotate(frame, boxes)
+        outp.write(frame)
+        written += 1
+        if written % 100 == 0:
+            print('Wrote', written, 'frames to video')
+except DaemonError as e:
+    print('Frame', written + 1, 'failed:', e)
+    sys.exit(4)
+finally:
+    cap.release()
+    outp.release()
+    client.close()
+    if daemon is not None:
+        daemon.terminate()
+        daemon.wait()
 
-for i, af in enumerate(annot_files, start=1):
-    img = cv2.imread(str(af))
-    if img is None:
-        print('Failed to read annotated frame', af); sys.exit(7)
-    outp.write(img)
-    if i % 100 == 0:
-        print('Wrote', i, 'frames to video')
-outp.release()
-print('Annotated video written to', workdir / out_video)
+if written == 0:
+    print('No frames annotated'); sys.exit(5)
+print('Annotated video written to', workdir / args.out_video, '(%d frames, %.1f fps)' % (written, written / max(1e-9, time.time() - t0)))
 print('Done')
@@ -0,0 +1,445 @@
+#pragma once
+// Runtime metrics: per-stage latency histograms, counters and gauges
+// (--metrics-interval, --metrics-port).
+//
+// Durations go into LatencyHistogram, a fixed-size log-linear (HDR-style)
+// histogram of nanoseconds with 32 linear sub-buckets per power of two, so
+// every percentile is within ~3% of the exact value. Recording is two relaxed
+// atomic adds from any thread, with no lock and no allocation.
+// Instrumented code holds a Metrics pointer (or a histogram pointer) that is
+// null when metrics are off and skips everything after one branch.
+//
+// MetricsService prints a summary line every interval (percentiles over that
+// interval) and serves all metrics in the Prometheus text format on
+// http://127.0.0.1:<port>/metrics, both from one background thread.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBits = 5, kSub = 1 << kSubBits;
+    static constexpr int kMaxShift = 38; // values up to 2^44 ns (~4.9 h); longer ones land in the last bucket
+    static constexpr int kBuckets = (kMaxShift + 2) * kSub;
+
+    struct Snapshot
+    {
+        std::vector<uint64_t> counts;
+        uint64_t count = 0, sum_ns = 0;
+
+        // q in [0, 1]; representative value of the bucket holding the q-th sample
+        double percentile_ms(double q) const
+        {
+            if (count == 0)
+                return 0.0;
+            uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * count));
+            uint64_t seen = 0;
+            for (int b = 0; b < (int)counts.size(); ++b)
+            {
+                seen += counts[b];
+                if (seen >= rank)
+                    return bucket_mid(b) / 1e6;
+            }
+            return bucket_mid((int)counts.size() - 1) / 1e6;
+        }
+
+        double mean_ms() const { return count ? sum_ns / 1e6 / count : 0.0; }
+
+        double max_ms() const
+        {
+            for (int b = (int)counts.size() - 1; b >= 0; --b)
+                if (counts[b])
+                    return bucket_mid(b) / 1e6;
+            return 0.0;
+        }
+
+        // samples recorded after `prev` was taken
+        Snapshot since(const Snapshot &prev) const
+        {
+            Snapshot d = *this;
+            if (prev.counts.size() == counts.size())
+                for (size_t b = 0; b < counts.size(); ++b)
+                    d.counts[b] -= prev.counts[b];
+            d.count -= std::min(count, prev.count);
+            d.sum_ns -= std::min(sum_ns, prev.sum_ns);
+            return d;
+        }
+    };
+
+    void record_ns(uint64_t ns)
+    {
+        counts_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void record(std::chrono::steady_clock::duration d)
+    {
+        record_ns((uint64_t)std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()));
+    }
+
+    uint64_t count() const { return snapshot().count; }
+
+    Snapshot snapshot() const
+    {
+        Snapshot s;
+        s.counts.resize(kBuckets);
+        for (int b = 0; b < kBuckets; ++b)
+        {
+            s.counts[b] = counts_[b].load(std::memory_order_relaxed);
+            s.count += s.counts[b]; // consistent with the buckets even while others record
+        }
+        s.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    static int bucket(uint64_t v)
+    {
+        v = std::min<uint64_t>(v, (2ull * kSub << kMaxShift) - 1);
+        int shift = v < kSub ? 0 : 63 - __builtin_clzll(v) - kSubBits;
+        return shift * kSub + (int)(v >> shift);
+    }
+
+    // middle of bucket b's value range
+    static double bucket_mid(int b)
+    {
+        int shift = b < 2 * kSub ? 0 : b / kSub - 1;
+        uint64_t lower = (uint64_t)(b - shift * kSub) << shift;
+        return lower + ((1ull << shift) - 1) / 2.0;
+    }
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+class Metrics
+{
+public:
+    // The first five match DetectionPipeline::Stage.
+    enum Timer
+    {
+        kCapture,     // read + decode one frame
+        kPreprocess,  // letterbox + planar conversion
+        kInfer,       // one batch, submit to results ready
+        kPostprocess, // decode + NMS
+        kOutput,      // whole output stage of a frame (draw, alarms, queueing to the writers)
+        kDraw,        // boxes and labels
+        kFrameWrite,  // per-frame image encode + write (background writers)
+        kPush,        // RTMP encode + send of one frame (encoder thread)
+        kLatency,     // capture to end of output, per frame
+        kTimers
+    };
+
+    static const char *timer_name(Timer t)
+    {
+        static const char *names[kTimers] = {"capture", "preprocess", "infer", "postprocess", "output",
+                                             "draw", "frame_write", "push", "capture_to_output"};
+        return names[t];
+    }
+
+    // Written by the output thread, read by the metrics thread.
+    struct StreamCounters
+    {
+        std::string name;
+        std::atomic<uint64_t> frames{0}, detected{0}, alarms{0};
+        std::atomic<uint64_t> push_dropped{0}, video_dropped{0};
+        std::atomic<uint64_t> push_queue{0};
+        std::atomic<uint64_t> capture_dropped{0}, reconnects{0}; // live inputs (capture thread counts, copied on output)
+    };
+
+    explicit Metrics(const std::vector<std::string> &stream_names)
+    {
+        for (const std::string &n : stream_names)
+        {
+            streams_.push_back(std::make_unique<StreamCounters>());
+            streams_.back()->name = n;
+        }
+        start_ = last_ = std::chrono::steady_clock::now();
+    }
+
+    LatencyHistogram &timer(Timer t) { return timers_[t]; }
+    StreamCounters &stream(int k) { return *streams_[k]; }
+    int streams() const { return (int)streams_.size(); }
+
+    // Values sampled when the metrics are read, e.g. queue depths. `labels` is
+    // the inside of the braces (`queue="infer"`), `fn` must be thread-safe.
+    // Register everything before MetricsService starts.
+    void add_gauge(std::string name, std::string labels, std::string help, std::function<double()> fn)
+    {
+        extras_.push_back(Extra{std::move(name), std::move(labels), std::move(help), "gauge", std::move(fn)});
+    }
+
+    void add_counter(std::string name, std::string labels, std::string help, std::function<double()> fn)
+    {
+        extras_.push_back(Extra{std::move(name), std::move(labels), std::move(help), "counter", std::move(fn)});
+    }
+
+    // Prometheus text exposition format 0.0.4.
+    std::string prometheus() const
+    {
+        std::string out;
+        char buf[256];
+        out += "# HELP helmet_stage_latency_seconds Time per item in each processing stage.\n"
+               "# TYPE helmet_stage_latency_seconds summary\n";
+        for (int t = 0; t < kTimers; ++t)
+        {
+            LatencyHistogram::Snapshot s = timers_[t].snapshot();
+            if (s.count == 0)
+                continue;
+            const char *name = timer_name((Timer)t);
+            for (double q : {0.5, 0.95, 0.99})
+            {
+                snprintf(buf, sizeof(buf), "helmet_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.6g\n", name, q, s.percentile_ms(q) / 1e3);
+                out += buf;
+            }
+            snprintf(buf, sizeof(buf), "helmet_stage_latency_seconds_sum{stage=\"%s\"} %.6g\nhelmet_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                     name, s.sum_ns / 1e9, name, (unsigned long long)s.count);
+            out += buf;
+        }
+        auto per_stream = [&](const char *metric, const char *type, const char *help, std::atomic<uint64_t> StreamCounters::*field)
+        {
+            out += std::string("# HELP ") + metric + " " + help + "\n# TYPE " + metric + " " + type + "\n";
+            for (const auto &sc : streams_)
+                out += std::string(metric) + "{stream=\"" + label_escape(sc->name) + "\"} " + std::to_string((sc.get()->*field).load(std::memory_order_relaxed)) + "\n";
+        };
+        per_stream("helmet_frames_total", "counter", "Frames output.", &StreamCounters::frames);
+        per_stream("helmet_detected_frames_total", "counter", "Frames the model ran on.", &StreamCounters::detected);
+        per_stream("helmet_alarm_events_total", "counter", "Alarm events raised.", &StreamCounters::alarms);
+        per_stream("helmet_push_dropped_frames_total", "counter", "Frames dropped from the RTMP push queue.", &StreamCounters::push_dropped);
+        per_stream("helmet_video_dropped_frames_total", "counter", "Frames dropped by the live video writer (arrived faster than the measured rate).", &StreamCounters::video_dropped);
+        per_stream("helmet_capture_dropped_frames_total", "counter", "Live frames dropped by the capture thread because a newer one arrived first.", &StreamCounters::capture_dropped);
+        per_stream("helmet_reconnects_total", "counter", "Live input reconnects.", &StreamCounters::reconnects);
+        per_stream("helmet_push_queue_frames", "gauge", "Frames waiting for the RTMP encoder.", &StreamCounters::push_queue);
+        double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        snprintf(buf, sizeof(buf), "# HELP helmet_uptime_seconds Time since start.\n# TYPE helmet_uptime_seconds gauge\nhelmet_uptime_seconds %.3f\n", uptime);
+        out += buf;
+        for (size_t i = 0; i < extras_.size(); ++i)
+        {
+            const Extra &e = extras_[i];
+            if (i == 0 || extras_[i - 1].name != e.name)
+                out += "# HELP " + e.name + " " + e.help + "\n# TYPE " + e.name + " " + e.type + "\n";
+            snprintf(buf, sizeof(buf), " %.6g\n", e.fn());
+            out += e.name + (e.labels.empty() ? std::string() : "{" + e.labels + "}") + buf;
+        }
+        return out;
+    }
+
+    // One line over the time since the previous call: fps, p50/p95/p99 per
+    // stage, gauges, drops and alarms. Called from one thread only.
+    std::string summary()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double dt = std::max(1e-6, std::chrono::duration<double>(now - last_).count());
+        last_ = now;
+        uint64_t frames = 0, alarms = 0, dropped = 0;
+        for (const auto &sc : streams_)
+        {
+            frames += sc->frames.load(std::memory_order_relaxed);
+            alarms += sc->alarms.load(std::memory_order_relaxed);
+            dropped += sc->push_dropped.load(std::memory_order_relaxed) + sc->video_dropped.load(std::memory_order_relaxed);
+        }
+        char buf[256];
+        snprintf(buf, sizeof(buf), "[metrics] %.1fs fps %.1f | ms p50/p95/p99", dt, (frames - last_frames_) / dt);
+        std::string out = buf;
+        last_frames_ = frames;
+        if (prev_.empty())
+            prev_.resize(kTimers);
+        for (int t = 0; t < kTimers; ++t)
+        {
+            LatencyHistogram::Snapshot s = timers_[t].snapshot();
+            LatencyHistogram::Snapshot d = s.since(prev_[t]);
+            prev_[t] = std::move(s);
+            if (d.count == 0)
+                continue;
+            snprintf(buf, sizeof(buf), " %s %.2f/%.2f/%.2f", timer_name((Timer)t), d.percentile_ms(0.5), d.percentile_ms(0.95), d.percentile_ms(0.99));
+            out += buf;
+        }
+        // gauges as "| queue_frames preprocess=0 infer=2 ..."
+        const std::string *group = nullptr;
+        for (const Extra &e : extras_)
+        {
+            if (e.type != "gauge")
+                continue;
+            if (!group || *group != e.name)
+            {
+                group = &e.name;
+                out += " | " + e.name.substr(e.name.rfind("helmet_", 0) == 0 ? 7 : 0);
+            }
+            size_t q0 = e.labels.find('"'), q1 = e.labels.rfind('"');
+            std::string key = q0 != std::string::npos && q1 > q0 ? e.labels.substr(q0 + 1, q1 - q0 - 1) : e.labels;
+            snprintf(buf, sizeof(buf), "%.6g", e.fn());
+            out += " " + (key.empty() ? std::string() : key + "=") + buf;
+        }
+        snprintf(buf, sizeof(buf), " | dropped %llu | alarms %llu", (unsigned long long)dropped, (unsigned long long)alarms);
+        out += buf;
+        return out;
+    }
+
+    static std::string label_escape(const std::string &s)
+    {
+        std::string out;
+        for (char c : s)
+        {
+            if (c == '\\' || c == '"')
+                out += '\\';
+            if (c == '\n')
+            {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+private:
+    struct Extra
+    {
+        std::string name, labels, help, type;
+        std::function<double()> fn;
+    };
+
+    LatencyHistogram timers_[kTimers];
+    std::vector<std::unique_ptr<StreamCounters>> streams_;
+    std::vector<Extra> extras_;
+    std::chrono::steady_clock::time_point start_, last_;
+    uint64_t last_frames_ = 0;
+    std::vector<LatencyHistogram::Snapshot> prev_;
+};
+
+// Background thread for the periodic summary line and the /metrics endpoint.
+class MetricsService
+{
+public:
+    ~MetricsService() { stop(); }
+
+    // `port` 0: no HTTP endpoint; `interval_sec` 0: no summary line.
+    bool start(Metrics &metrics, int port, double interval_sec, std::ostream &log)
+    {
+        metrics_ = &metrics;
+        interval_sec_ = interval_sec;
+        log_ = &log;
+        if (port > 0)
+        {
+            listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int one = 1;
+            setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons((uint16_t)port);
+            if (listen_fd_ < 0 || ::bind(listen_fd_, (const sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(listen_fd_, 8) != 0)
+            {
+                std::cerr << "Failed to listen on 127.0.0.1:" << port << " for /metrics: " << strerror(errno) << std::endl;
+                if (listen_fd_ >= 0)
+                    ::close(listen_fd_);
+                listen_fd_ = -1;
+                return false;
+            }
+        }
+        stop_ = false;
+        thread_ = std::thread([this]
+                              { loop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (!thread_.joinable())
+            return;
+        stop_ = true;
+        thread_.join();
+        if (listen_fd_ >= 0)
+            ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+private:
+    void loop()
+    {
+        auto next = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval_sec_));
+        while (!stop_)
+        {
+            if (listen_fd_ >= 0)
+            {
+                pollfd p{listen_fd_, POLLIN, 0};
+                if (::poll(&p, 1, 100) > 0 && (p.revents & POLLIN))
+                    serve_one();
+            }
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (interval_sec_ > 0.0 && std::chrono::steady_clock::now() >= next)
+            {
+                *log_ << metrics_->summary() + "\n" << std::flush;
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval_sec_));
+            }
+        }
+    }
+
+    // One request per connection; anything but GET /metrics is a 404.
+    void serve_one()
+    {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        timeval tv{1, 0}; // a client that connects and sends nothing must not block the summary
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        std::string req;
+        char buf[1024];
+        while (req.find("\r\n\r\n") == std::string::npos && req.size() < 8192)
+        {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            req.append(buf, (size_t)n);
+        }
+        std::string body, status = "200 OK", type = "text/plain; version=0.0.4";
+        if (req.rfind("GET /metrics", 0) == 0 && (req.size() == 12 || req[12] == ' ' || req[12] == '?'))
+            body = metrics_->prometheus();
+        else
+        {
+            status = "404 Not Found";
+            type = "text/plain";
+            body = "only /metrics\n";
+        }
+        std::string resp = "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+        const char *p = resp.data();
+        size_t left = resp.size();
+        while (left > 0)
+        {
+            ssize_t n = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            p += n;
+            left -= (size_t)n;
+        }
+        ::close(fd);
+    }
+
+    Metrics *metrics_ = nullptr;
+    double interval_sec_ = 0.0;
+    std::ostream *log_ = nullptr;
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
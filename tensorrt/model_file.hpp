@@ -0,0 +1,302 @@
+#pragma once
+// Model files for the backends: memory-mapped loading, a content hash, the
+// on-disk engine cache and the timings of each startup step.
+//
+// MappedFile maps an engine or ONNX file read-only (MADV_SEQUENTIAL |
+// MADV_WILLNEED: the deserializer streams through it once) instead of copying
+// it into a heap buffer. Pages come from the page cache, so processes restarted
+// by the watchdog, or several processes loading the same model, read it from
+// memory and share one copy.
+//
+// EngineCache turns an ONNX file into a TensorRT engine once: the engine is
+// stored as <dir>/<model>-<key>.engine, where the key hashes the ONNX contents together
+// with everything else the engine depends on (build options, TensorRT version,
+// GPU). The build runs trtexec (as onnx_to_trt.sh does) into a temporary file
+// that is renamed into place, under a lock file, so concurrent processes build
+// an engine once and never see a partial file.
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Map `path`; falls back to reading it into memory where mmap is not possible.
+    bool open(const std::string &path, std::string &error)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            error = "Failed to open file: " + path + " (" + strerror(errno) + ")";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            error = "Empty or unreadable file: " + path;
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            madvise(p, size_, MADV_SEQUENTIAL);
+            madvise(p, size_, MADV_WILLNEED);
+            map_ = p;
+            data_ = (const char *)p;
+        }
+        else
+        {
+            copy_.resize(size_);
+            size_t got = 0;
+            while (got < size_)
+            {
+                ssize_t n = ::read(fd, copy_.data() + got, size_ - got);
+                if (n <= 0)
+                    break;
+                got += (size_t)n;
+            }
+            if (got != size_)
+            {
+                ::close(fd);
+                close();
+                error = "Failed to read file: " + path;
+                return false;
+            }
+            data_ = copy_.data();
+        }
+        ::close(fd);
+        return true;
+    }
+
+    // Unmap early, e.g. once the engine has been deserialized into its own memory.
+    void close()
+    {
+        if (map_)
+            munmap(map_, size_);
+        map_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+        std::vector<char>().swap(copy_);
+    }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool mapped() const { return map_ != nullptr; }
+
+private:
+    void *map_ = nullptr;
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> copy_; // read fallback
+};
+
+// 64-bit content hash for cache keys (four independent multiply-rotate lanes, so
+// hashing runs near memory bandwidth; not cryptographic).
+inline uint64_t content_hash(const void *data, size_t size, uint64_t seed = 0)
+{
+    const uint64_t k1 = 0x9E3779B185EBCA87ULL, k2 = 0xC2B2AE3D27D4EB4FULL;
+    auto rotl = [](uint64_t x, int r)
+    { return (x << r) | (x >> (64 - r)); };
+    auto round = [&](uint64_t acc, uint64_t v)
+    { return rotl(acc + v * k2, 31) * k1; };
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t lane[4] = {seed + k1 + k2, seed + k2, seed, seed - k1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+        for (int l = 0; l < 4; ++l)
+        {
+            uint64_t v;
+            memcpy(&v, p + i + 8 * l, 8);
+            lane[l] = round(lane[l], v);
+        }
+    uint64_t h = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18) + size;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        h = rotl(h ^ round(0, v), 27) * k1 + k2;
+    }
+    for (; i < size; ++i)
+        h = rotl(h ^ (p[i] * k2), 11) * k1;
+    h ^= h >> 33;
+    h *= k2;
+    h ^= h >> 29;
+    h *= k1;
+    return h ^ (h >> 32);
+}
+
+// Wall time of each step of loading a model, printed once at startup.
+class StartupTimes
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    void add(const std::string &step, double ms) { steps_.emplace_back(step, ms); }
+    void add(const std::string &step, clock::time_point since)
+    {
+        add(step, std::chrono::duration<double, std::milli>(clock::now() - since).count());
+    }
+    // free-form facts shown with the times ("cache hit", "mmap")
+    void note(const std::string &text) { notes_.push_back(text); }
+
+    double total_ms() const
+    {
+        double t = 0.0;
+        for (const auto &s : steps_)
+            t += s.second;
+        return t;
+    }
+
+    // "hash 3.1 ms, map 0.1 ms, deserialize 210.4 ms (cache hit, mmap)"
+    std::string str() const
+    {
+        std::string out;
+        char buf[128];
+        for (const auto &s : steps_)
+        {
+            snprintf(buf, sizeof(buf), "%s%s %.1f ms", out.empty() ? "" : ", ", s.first.c_str(), s.second);
+            out += buf;
+        }
+        for (size_t i = 0; i < notes_.size(); ++i)
+            out += (i == 0 ? " (" : ", ") + notes_[i] + (i + 1 == notes_.size() ? ")" : "");
+        return out;
+    }
+
+private:
+    std::vector<std::pair<std::string, double>> steps_;
+    std::vector<std::string> notes_;
+};
+
+inline std::string default_engine_cache_dir()
+{
+    if (const char *d = getenv("HELMET_ENGINE_CACHE"))
+        return d;
+    if (const char *x = getenv("XDG_CACHE_HOME"); x && *x)
+        return std::string(x) + "/helmet/engines";
+    if (const char *home = getenv("HOME"); home && *home)
+        return std::string(home) + "/.cache/helmet/engines";
+    return "/tmp/helmet-engines";
+}
+
+class EngineCache
+{
+public:
+    explicit EngineCache(std::string dir) : dir_(std::move(dir)) {}
+
+    // Engine path for an ONNX file and the build-dependent `context` (TensorRT
+    // version, GPU, ...). Builds the engine with `trtexec <build_args>` on a miss.
+    // Returns "" on failure with the reason in `error`.
+    std::string resolve(const std::string &onnx_path, const std::string &build_args, const std::string &context,
+                        int log_level, StartupTimes &times, std::string &error)
+    {
+        auto t0 = StartupTimes::clock::now();
+        MappedFile onnx;
+        if (!onnx.open(onnx_path, error))
+            return "";
+        std::string salt = build_args + '\n' + context;
+        uint64_t h = content_hash(onnx.data(), onnx.size(), content_hash(salt.data(), salt.size()));
+        onnx.close();
+        times.add("hash", t0);
+        char key[32];
+        snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+        std::string stem = std::filesystem::path(onnx_path).stem().string();
+        std::string engine = dir_ + "/" + stem + "-" + key + ".engine";
+        if (exists(engine))
+        {
+            times.note("engine cache hit");
+            return engine;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        if (ec)
+        {
+            error = "Failed to create engine cache " + dir_ + ": " + ec.message();
+            return "";
+        }
+        // one builder per key; the others wait here and then find the engine
+        t0 = StartupTimes::clock::now();
+        std::string lock_path = engine + ".lock";
+        int lock = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock >= 0)
+            flock(lock, LOCK_EX);
+        std::string result = engine;
+        if (!exists(engine))
+        {
+            if (log_level >= 1)
+                std::cout << "Engine cache miss, building " << engine << " from " << onnx_path << " (this takes a while)" << std::endl;
+            std::string tmp = engine + ".tmp" + std::to_string(getpid());
+            std::string cmd = trtexec() + " --onnx=" + quote(onnx_path) + " --saveEngine=" + quote(tmp) + " " + build_args;
+            if (log_level < 2)
+                cmd += " > " + quote(engine + ".log") + " 2>&1";
+            if (log_level >= 2)
+                std::cout << cmd << std::endl;
+            int rc = std::system(cmd.c_str());
+            if (rc != 0 || !exists(tmp) || rename(tmp.c_str(), engine.c_str()) != 0)
+            {
+                unlink(tmp.c_str());
+                error = "Engine build failed (exit " + std::to_string(rc) + "): " + cmd + (log_level < 2 ? ", see " + engine + ".log" : "");
+                result.clear();
+            }
+            else
+                times.note("engine built");
+        }
+        else
+            times.note("engine built by another process");
+        // the zero-byte lock file stays: unlinking it while held would let a
+        // waiter lock the old inode while a newcomer locks a fresh one
+        if (lock >= 0)
+            ::close(lock);
+        times.add("build", t0);
+        return result;
+    }
+
+private:
+    static bool exists(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+    }
+
+    static std::string quote(const std::string &s)
+    {
+        std::string out = "'";
+        for (char c : s)
+            out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        return out + "'";
+    }
+
+    static std::string trtexec()
+    {
+        if (const char *t = getenv("TRTEXEC"))
+            return quote(t);
+        // JetPack installs it outside PATH
+        if (access("/usr/src/tensorrt/bin/trtexec", X_OK) == 0)
+            return "/usr/src/tensorrt/bin/trtexec";
+        return "trtexec";
+    }
+
+    std::string dir_;
+};
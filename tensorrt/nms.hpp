@@ -0,0 +1,199 @@
+#pragma once
+// Greedy class-aware NMS over a DetectionBuffer.
+//
+// Same result as the classic O(n^2) loop (sort by score, keep a box unless a
+// previously kept box of the same class overlaps it with IoU > threshold), but:
+//  - areas are precomputed once per candidate (SoA),
+//  - kept boxes are bucketed into a uniform grid whose cell index is offset by
+//    class, so all classes are handled in one pass and a candidate is only
+//    compared with kept boxes of its own class sharing a cell,
+//  - an optional max-detections cap stops the scan early.
+// The class offset lives in grid space rather than being added to the box
+// coordinates, which keeps every IoU bit-identical to the original loop.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "detection.hpp"
+
+struct NmsConfig
+{
+    float iou_thresh = 0.45f;
+    int max_det = 0; // 0 = no cap
+};
+
+// Reusable working memory; sized on first use, no allocations once warmed up.
+struct NmsScratch
+{
+    std::vector<int> order;
+    std::vector<float> area;
+    std::vector<int> visited; // last candidate rank that compared against this box
+    std::vector<int> cell_head;
+    std::vector<uint32_t> cell_stamp;
+    std::vector<int> node_next, node_box;
+    std::vector<int> large; // kept boxes spanning too many cells, checked directly
+    uint32_t stamp = 0;
+};
+
+namespace nms_detail
+{
+    constexpr int kMaxGridDim = 64;      // per axis
+    constexpr int kMaxCellsPerBox = 16;  // larger boxes go to the `large` list
+    constexpr size_t kMaxGridCells = 1 << 20;
+
+    inline float iou(const DetectionBuffer &b, const float *area, size_t a, size_t c)
+    {
+        float inter_x1 = std::max(b.x1[a], b.x1[c]);
+        float inter_y1 = std::max(b.y1[a], b.y1[c]);
+        float inter_x2 = std::min(b.x2[a], b.x2[c]);
+        float inter_y2 = std::min(b.y2[a], b.y2[c]);
+        float inter_w = std::max(0.0f, inter_x2 - inter_x1);
+        float inter_h = std::max(0.0f, inter_y2 - inter_y1);
+        float inter = inter_w * inter_h;
+        return inter / (area[a] + area[c] - inter + 1e-6f);
+    }
+} // namespace nms_detail
+
+// Writes indices into `cand` of the surviving boxes to `keep`, highest score first.
+inline void nms_boxes(const DetectionBuffer &cand, const NmsConfig &cfg, NmsScratch &s, std::vector<int> &keep)
+{
+    keep.clear();
+    const size_t n = cand.count;
+    if (n == 0)
+        return;
+
+    s.order.resize(n);
+    s.area.resize(n);
+    s.visited.assign(n, -1);
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY, size_sum = 0.0f;
+    int min_cls = cand.class_id[0], max_cls = cand.class_id[0];
+    for (size_t i = 0; i < n; ++i)
+    {
+        s.order[i] = (int)i;
+        float w = cand.x2[i] - cand.x1[i], h = cand.y2[i] - cand.y1[i];
+        s.area[i] = w * h;
+        if (!(w > 0.0f && h > 0.0f) || !std::isfinite(w + h))
+            continue; // empty or invalid boxes never overlap anything
+        min_x = std::min(min_x, cand.x1[i]);
+        min_y = std::min(min_y, cand.y1[i]);
+        max_x = std::max(max_x, cand.x2[i]);
+        max_y = std::max(max_y, cand.y2[i]);
+        size_sum += std::max(w, h);
+        min_cls = std::min(min_cls, cand.class_id[i]);
+        max_cls = std::max(max_cls, cand.class_id[i]);
+    }
+    std::sort(s.order.begin(), s.order.end(), [&cand](int a, int b)
+              { return cand.score[a] > cand.score[b] || (cand.score[a] == cand.score[b] && a < b); });
+
+    // grid: cell edge ~ mean box size, bounded per axis; class offset along a third axis
+    bool have_grid = max_x > min_x && max_y > min_y;
+    int gx = 1, gy = 1, ncls = max_cls - min_cls + 1;
+    float inv_cx = 0.0f, inv_cy = 0.0f;
+    if (have_grid)
+    {
+        float cell = std::max(1.0f, size_sum / (float)n);
+        gx = std::min(nms_detail::kMaxGridDim, std::max(1, (int)((max_x - min_x) / cell)));
+        gy = std::min(nms_detail::kMaxGridDim, std::max(1, (int)((max_y - min_y) / cell)));
+        while ((size_t)gx * gy * ncls > nms_detail::kMaxGridCells && (gx > 1 || gy > 1))
+        {
+            gx = std::max(1, gx / 2);
+            gy = std::max(1, gy / 2);
+        }
+        inv_cx = gx / (max_x - min_x);
+        inv_cy = gy / (max_y - min_y);
+    }
+    size_t ncells = (size_t)gx * gy * ncls;
+    if (s.cell_head.size() < ncells)
+    {
+        s.cell_head.resize(ncells);
+        s.cell_stamp.resize(ncells, 0);
+    }
+    if (++s.stamp == 0)
+    {
+        std::fill(s.cell_stamp.begin(), s.cell_stamp.end(), 0);
+        s.stamp = 1;
+    }
+    s.node_next.clear();
+    s.node_box.clear();
+    s.large.clear();
+
+    auto cell_x = [&](float v)
+    { return std::min(gx - 1, std::max(0, (int)((v - min_x) * inv_cx))); };
+    auto cell_y = [&](float v)
+    { return std::min(gy - 1, std::max(0, (int)((v - min_y) * inv_cy))); };
+
+    const float *area = s.area.data();
+    for (size_t rank = 0; rank < n; ++rank)
+    {
+        int i = s.order[rank];
+        float w = cand.x2[i] - cand.x1[i], h = cand.y2[i] - cand.y1[i];
+        bool valid = have_grid && w > 0.0f && h > 0.0f && std::isfinite(w + h);
+        bool suppressed = false;
+        int x0 = 0, x1 = -1, y0 = 0, y1 = -1;
+        size_t cls_base = 0;
+        if (valid)
+        {
+            x0 = cell_x(cand.x1[i]);
+            x1 = cell_x(cand.x2[i]);
+            y0 = cell_y(cand.y1[i]);
+            y1 = cell_y(cand.y2[i]);
+            cls_base = (size_t)(cand.class_id[i] - min_cls) * gx * gy;
+            for (int cy = y0; cy <= y1 && !suppressed; ++cy)
+            {
+                for (int cx = x0; cx <= x1 && !suppressed; ++cx)
+                {
+                    size_t cell = cls_base + (size_t)cy * gx + cx;
+                    if (s.cell_stamp[cell] != s.stamp)
+                        continue;
+                    for (int node = s.cell_head[cell]; node >= 0; node = s.node_next[node])
+                    {
+                        int j = s.node_box[node];
+                        if (s.visited[j] == (int)rank)
+                            continue;
+                        s.visited[j] = (int)rank;
+                        if (nms_detail::iou(cand, area, j, i) > cfg.iou_thresh)
+                        {
+                            suppressed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            for (size_t k = 0; k < s.large.size() && !suppressed; ++k)
+            {
+                int j = s.large[k];
+                if (cand.class_id[j] == cand.class_id[i] && nms_detail::iou(cand, area, j, i) > cfg.iou_thresh)
+                    suppressed = true;
+            }
+        }
+        if (suppressed)
+            continue;
+
+        keep.push_back(i);
+        if (cfg.max_det > 0 && (int)keep.size() >= cfg.max_det)
+            break;
+        if (!valid)
+            continue;
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) > nms_detail::kMaxCellsPerBox)
+        {
+            s.large.push_back(i);
+            continue;
+        }
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+                size_t cell = cls_base + (size_t)cy * gx + cx;
+                if (s.cell_stamp[cell] != s.stamp)
+                {
+                    s.cell_stamp[cell] = s.stamp;
+                    s.cell_head[cell] = -1;
+                }
+                s.node_next.push_back(s.cell_head[cell]);
+                s.node_box.push_back(i);
+                s.cell_head[cell] = (int)s.node_next.size() - 1;
+            }
+        }
+    }
+}
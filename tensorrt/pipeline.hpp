@@ -0,0 +1,760 @@
+#pragma once
+// Staged frame pipeline: capture -> preprocess -> infer -> postprocess -> output.
+//
+// Each stage runs on its own thread; preprocess and postprocess are pools of
+// workers. There can be several inputs (cameras): each source is read on its
+// own capture thread with its own set of tasks, and a dispatcher takes one
+// ready frame from each source in turn, so all inputs share the model fairly
+// and a stalled camera does not hold up the others. Stages are connected by bounded SPSC queues and tasks are dealt to
+// pool workers round-robin by sequence number, so the next stage collects them
+// round-robin in the same order and the output stage sees frames in input
+// order without a reorder buffer. A fixed number of FrameTask objects per source
+// circulate (output returns them to their source), which bounds memory and
+// provides backpressure: a source blocks when all of its tasks are in flight.
+//
+// The inference stage groups up to max_batch detection frames into one backend
+// call, flushing a partial batch after max_wait_ms; frames that skip detection
+// ride along in order without being sent to the model. Batches are submitted
+// asynchronously into the backend's slots (SlotRing) and only waited for when
+// all slots are busy or no new frames are ready, so the next batch is gathered
+// and uploaded while the previous one runs.
+//
+// With tiling (tiling.hpp) a detection frame is several model inputs (units):
+// preprocess letterboxes each tile, the units of the batched frames go to the
+// backend in calls of up to max_batch, and postprocess merges the units' boxes.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection.hpp"
+#include "inference_backend.hpp"
+#include "letterbox.hpp"
+#include "metrics.hpp"
+#include "nms.hpp"
+#include "slot_ring.hpp"
+#include "spsc_queue.hpp"
+#include "tiling.hpp"
+#include "yolo_decoder.hpp"
+
+struct FrameTask
+{
+    int stream = 0;   // which source produced the frame
+    size_t index = 0; // frame index in the input (frame number / file index)
+    bool do_detect = false;
+    cv::Mat frame;
+    double time_sec = 0.0; // media time (video) or index / img_fps (images)
+    double pos_msec = 0.0; // CAP_PROP_POS_MSEC when the frame was read (video)
+    std::string file;      // source path in image-list mode
+    float scale = 1.0f;    // decoded frame -> original image coordinates (reduced JPEG decode)
+    std::chrono::steady_clock::time_point captured; // when the source returned (live inputs: grabbed) the frame
+
+    std::shared_ptr<const LetterboxPlan> plan; // plan used to build `input`
+    float *input = nullptr;                    // 3 x input_h x input_w
+    float *output = nullptr;                   // C x L raw model output
+    std::vector<Detection> dets;               // final detections (after NMS)
+
+    // tiled frames: unit 0 uses input / output, units 1.. these (allocated on first use)
+    std::shared_ptr<const TileLayout> tiles;
+    std::vector<float *> tile_input, tile_output;
+
+    int units() const { return tiles ? (int)tiles->units.size() : 1; }
+    float *unit_input(int u) const { return u == 0 ? input : tile_input[u - 1]; }
+    float *unit_output(int u) const { return u == 0 ? output : tile_output[u - 1]; }
+
+    // pipeline bookkeeping
+    size_t seq = 0;
+    bool eos = false;
+};
+
+struct PipelineConfig
+{
+    int input_w = 640, input_h = 640;
+    float conf_thresh = 0.25f;
+    NmsConfig nms;
+    int pre_threads = 2;
+    int post_threads = 1;
+    int depth = 8; // frames in flight per source
+    // per-source override of `depth` (missing or <= 0: depth); live inputs keep it small
+    // so that frames wait in their capture thread, where stale ones are dropped
+    std::vector<int> source_depth;
+    int max_batch = 1;        // frames per inference call (capped by the backend)
+    double max_wait_ms = 2.0; // how long a partial batch may wait for more frames
+    TileConfig tiles;         // sliced inference (max_batch then counts tiles)
+};
+
+class DetectionPipeline
+{
+public:
+    // Fill the next frame (index, frame, do_detect, timestamps); false at end of input.
+    using Source = std::function<bool(FrameTask &)>;
+    // Consume a finished frame; called on the calling thread, in input order per source.
+    // FrameTask::stream tells which source it came from.
+    using Sink = std::function<void(FrameTask &)>;
+
+    enum Stage
+    {
+        kCapture,
+        kPreprocess,
+        kInfer,
+        kPostprocess,
+        kOutput,
+        kStageCount
+    };
+    static_assert((int)kOutput == (int)Metrics::kOutput, "pipeline stages index the first Metrics timers");
+
+    DetectionPipeline(const PipelineConfig &cfg, InferenceBackend &backend)
+        : cfg_(cfg), backend_(backend)
+    {
+        cfg_.pre_threads = std::max(1, cfg_.pre_threads);
+        cfg_.post_threads = std::max(1, cfg_.post_threads);
+        cfg_.max_batch = std::max(1, std::min(cfg_.max_batch, backend_.max_batch()));
+        // enough frames in flight to fill a batch while the submitted ones are still running;
+        // with tiles max_batch counts units, and a frame is up to max_tiles of them plus the
+        // full frame, each holding its own pinned buffers
+        int frame_units = cfg_.tiles.enabled ? std::max(1, cfg_.tiles.max_tiles + (cfg_.tiles.full_frame ? 1 : 0)) : 1;
+        int batch_frames = (cfg_.max_batch + frame_units - 1) / frame_units;
+        cfg_.depth = std::max({2, cfg_.depth, (backend_.async_slots() + 1) * batch_frames});
+    }
+
+    const PipelineConfig &config() const { return cfg_; }
+
+    // Per-stage latency histograms (null: off). Set before run().
+    void set_metrics(Metrics *metrics) { metrics_ = metrics; }
+
+    // Frames waiting in front of `s` (capture: read but not yet dispatched),
+    // summed over workers / sources. Safe to call from any thread while run() is active.
+    size_t queue_depth(Stage s) const
+    {
+        if (!running_.load(std::memory_order_acquire))
+            return 0;
+        auto sum = [](const std::vector<std::unique_ptr<SpscQueue<FrameTask *>>> &qs)
+        {
+            size_t n = 0;
+            for (const auto &q : qs)
+                n += q->size_approx();
+            return n;
+        };
+        switch (s)
+        {
+        case kCapture:
+            return sum(src_ready_);
+        case kPreprocess:
+            return sum(pre_in_);
+        case kInfer:
+            return sum(pre_out_);
+        case kPostprocess:
+            return sum(post_in_);
+        default:
+            return sum(post_out_);
+        }
+    }
+
+    // Frames of source k between capture and the end of output.
+    size_t in_flight(int k) const
+    {
+        if (!running_.load(std::memory_order_acquire) || k >= num_sources_)
+            return 0;
+        return (size_t)src_depth_[k] - std::min<size_t>(src_depth_[k], src_free_[k]->size_approx());
+    }
+
+    ~DetectionPipeline() { release_tasks(); }
+
+    // Runs until the source is exhausted. Returns false if inference failed; frames
+    // before the failing one have been delivered to the sink.
+    bool run(const Source &source, const Sink &sink)
+    {
+        return run(std::vector<Source>{source}, sink);
+    }
+
+    // Runs until every source is exhausted. May be called again; the tasks and
+    // buffers of the previous run are released first.
+    bool run(const std::vector<Source> &sources, const Sink &sink)
+    {
+        const int N = cfg_.pre_threads, M = cfg_.post_threads, S = (int)sources.size();
+        if (S == 0)
+            return true;
+        release_tasks();
+        const size_t in_elems = 3 * (size_t)cfg_.input_w * cfg_.input_h;
+        const size_t out_elems = (size_t)backend_.output_channels() * backend_.output_anchors();
+        const size_t qcap = (size_t)cfg_.depth * S + 1; // a queue can hold every task plus an EOS marker
+
+        num_sources_ = S;
+        src_free_.clear();
+        src_ready_.clear();
+        src_depth_.assign(S, cfg_.depth);
+        src_done_ = std::make_unique<std::atomic<bool>[]>(S);
+        for (int k = 0; k < S; ++k)
+        {
+            if (k < (int)cfg_.source_depth.size() && cfg_.source_depth[k] > 0)
+                src_depth_[k] = std::min(cfg_.depth, std::max(1, cfg_.source_depth[k]));
+            src_free_.push_back(std::make_unique<SpscQueue<FrameTask *>>(cfg_.depth + 1));
+            src_ready_.push_back(std::make_unique<SpscQueue<FrameTask *>>(cfg_.depth + 1));
+            src_done_[k] = false;
+            for (int i = 0; i < src_depth_[k]; ++i)
+            {
+                auto t = std::make_unique<FrameTask>();
+                t->stream = k;
+                t->input = backend_.alloc_host(in_elems);
+                if (out_elems > 0)
+                    t->output = backend_.alloc_host(out_elems);
+                if (!t->input || (out_elems > 0 && !t->output))
+                {
+                    tasks_.push_back(std::move(t));
+                    throw std::runtime_error("Failed to allocate pipeline host buffers");
+                }
+                src_free_[k]->try_push(t.get());
+                tasks_.push_back(std::move(t));
+            }
+        }
+        for (int i = 0; i < N + M; ++i)
+        {
+            eos_tasks_.push_back(std::make_unique<FrameTask>());
+            eos_tasks_.back()->eos = true;
+        }
+        pre_in_.clear();
+        pre_out_.clear();
+        post_in_.clear();
+        post_out_.clear();
+        for (int i = 0; i < N; ++i)
+        {
+            pre_in_.push_back(std::make_unique<SpscQueue<FrameTask *>>(qcap));
+            pre_out_.push_back(std::make_unique<SpscQueue<FrameTask *>>(qcap));
+        }
+        for (int i = 0; i < M; ++i)
+        {
+            post_in_.push_back(std::make_unique<SpscQueue<FrameTask *>>(qcap));
+            post_out_.push_back(std::make_unique<SpscQueue<FrameTask *>>(qcap));
+        }
+        tile_workers_.reset();
+        if (cfg_.tiles.enabled)
+        {
+            int helpers = cfg_.tiles.threads >= 0 ? cfg_.tiles.threads : std::min(4, (int)std::thread::hardware_concurrency() / 2);
+            tile_workers_ = std::make_unique<TileWorkers>(helpers);
+        }
+        abort_input_ = false;
+        infer_failed_ = false;
+        batch_frames_ = 0;
+        start_ = std::chrono::steady_clock::now();
+        running_.store(true, std::memory_order_release);
+
+        std::vector<std::thread> threads;
+        for (int k = 0; k < S; ++k)
+            threads.emplace_back([this, k, &sources]
+                                 { source_loop(k, sources[k]); });
+        threads.emplace_back([this]
+                             { dispatch_loop(); });
+        for (int i = 0; i < N; ++i)
+            threads.emplace_back([this, i]
+                                 { preprocess_loop(i); });
+        threads.emplace_back([this]
+                             { infer_loop(); });
+        for (int i = 0; i < M; ++i)
+            threads.emplace_back([this, i]
+                                 { postprocess_loop(i); });
+
+        output_loop(sink);
+        abort_input_ = true; // release capture/preprocess if they are still waiting
+        for (auto &t : threads)
+            t.join();
+        running_.store(false, std::memory_order_release);
+        tile_workers_.reset();
+        end_ = std::chrono::steady_clock::now();
+        return !infer_failed_;
+    }
+
+    void print_stats(std::ostream &os) const
+    {
+        static const char *names[kStageCount] = {"capture", "preprocess", "infer", "postprocess", "output"};
+        const int workers[kStageCount] = {std::max(1, num_sources_), cfg_.pre_threads, 1, cfg_.post_threads, 1};
+        double wall = std::chrono::duration<double>(end_ - start_).count();
+        os << "Pipeline stats (" << backend_.name() << ", wall " << std::fixed << std::setprecision(2) << wall << "s):" << std::endl;
+        for (int s = 0; s < kStageCount; ++s)
+        {
+            uint64_t items = stats_[s].items.load();
+            double busy = stats_[s].busy_ns.load() / 1e9;
+            os << "  " << std::left << std::setw(12) << names[s] << std::right
+               << " items=" << items
+               << " fps=" << (wall > 0 ? items / wall : 0.0)
+               << " avg_ms=" << (items ? busy * 1000.0 / items : 0.0)
+               << " util=" << (wall > 0 ? 100.0 * busy / (wall * workers[s]) : 0.0) << "%"
+               << " workers=" << workers[s];
+            if (s == kInfer && items > 0)
+                os << " avg_batch=" << (double)batch_frames_.load() / items << " max_batch=" << cfg_.max_batch;
+            os << std::endl;
+        }
+        os << std::defaultfloat;
+    }
+
+private:
+    // pinned buffers of every task, then the tasks and EOS markers themselves
+    void release_tasks()
+    {
+        for (auto &t : tasks_)
+        {
+            if (t->input)
+                backend_.free_host(t->input);
+            if (t->output)
+                backend_.free_host(t->output);
+            for (float *p : t->tile_input)
+                backend_.free_host(p);
+            for (float *p : t->tile_output)
+                if (p)
+                    backend_.free_host(p);
+        }
+        tasks_.clear();
+        eos_tasks_.clear();
+    }
+
+    struct StageStats
+    {
+        std::atomic<uint64_t> items{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    struct ScopedTimer
+    {
+        DetectionPipeline &p;
+        Stage s;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        ScopedTimer(DetectionPipeline &pl, Stage st) : p(pl), s(st) {}
+        ~ScopedTimer() { p.add_stat(s, t0); }
+    };
+
+    void add_stat(Stage s, std::chrono::steady_clock::time_point t0)
+    {
+        uint64_t ns = add_busy(s, t0);
+        stats_[s].items.fetch_add(1, std::memory_order_relaxed);
+        if (metrics_)
+            metrics_->timer((Metrics::Timer)s).record_ns(ns);
+    }
+
+    // busy time without counting an item (work split over several calls)
+    uint64_t add_busy(Stage s, std::chrono::steady_clock::time_point t0)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        stats_[s].busy_ns.fetch_add((uint64_t)ns, std::memory_order_relaxed);
+        return (uint64_t)ns;
+    }
+
+    void source_loop(int k, const Source &source)
+    {
+        for (;;)
+        {
+            FrameTask *t = nullptr;
+            if (!src_free_[k]->pop(t, abort_input_))
+                break;
+            t->do_detect = false;
+            t->file.clear();
+            t->scale = 1.0f;
+            t->plan.reset();
+            t->tiles.reset();
+            t->dets.clear();
+            t->captured = {};
+            auto t0 = std::chrono::steady_clock::now();
+            if (!source(*t))
+                break;
+            if (t->captured == std::chrono::steady_clock::time_point())
+                t->captured = std::chrono::steady_clock::now(); // unless the source knows when it was grabbed
+            add_stat(kCapture, t0);
+            t->stream = k;
+            if (!src_ready_[k]->push(t, abort_input_))
+                break;
+        }
+        src_done_[k].store(true, std::memory_order_release);
+    }
+
+    // Round-robin over the sources, one ready frame each, into the preprocess workers.
+    void dispatch_loop()
+    {
+        const int N = cfg_.pre_threads, S = num_sources_;
+        std::vector<bool> finished(S, false);
+        int active = S;
+        size_t seq = 0;
+        Backoff backoff;
+        while (active > 0 && !abort_input_)
+        {
+            bool moved = false;
+            for (int k = 0; k < S; ++k)
+            {
+                if (finished[k])
+                    continue;
+                bool done = src_done_[k].load(std::memory_order_acquire);
+                FrameTask *t = nullptr;
+                if (!src_ready_[k]->try_pop(t))
+                {
+                    // checked `done` before the pop, so an empty queue now means nothing more will come
+                    if (done)
+                    {
+                        finished[k] = true;
+                        --active;
+                    }
+                    continue;
+                }
+                t->seq = seq;
+                if (!pre_in_[seq % N]->push(t, abort_input_))
+                    break;
+                ++seq;
+                moved = true;
+            }
+            if (moved)
+                backoff.reset();
+            else
+                backoff.pause();
+        }
+        // one end marker per preprocess worker, continuing the round-robin
+        for (int k = 0; k < N; ++k)
+        {
+            FrameTask *e = eos_tasks_[k].get();
+            e->seq = seq + k;
+            if (!pre_in_[(seq + k) % N]->push(e, abort_input_))
+                break;
+        }
+    }
+
+    // Tile layout for the task's frame size (cached like the plans) with a host buffer
+    // per unit; null when the buffers cannot be allocated (the frame then goes untiled).
+    std::shared_ptr<const TileLayout> tile_layout(FrameTask &t, std::vector<std::shared_ptr<TileLayout>> &layouts)
+    {
+        const cv::Mat &f = t.frame;
+        std::shared_ptr<TileLayout> layout;
+        for (const auto &l : layouts)
+            if (l->matches(f.cols, f.rows, cfg_.input_w, cfg_.input_h))
+                layout = l;
+        if (!layout)
+        {
+            layout = std::make_shared<TileLayout>(make_tile_layout(f.cols, f.rows, cfg_.input_w, cfg_.input_h, cfg_.tiles));
+            if (layouts.size() >= kMaxCachedPlans)
+                layouts.erase(layouts.begin());
+            layouts.push_back(layout);
+        }
+        const size_t in_elems = 3 * (size_t)cfg_.input_w * cfg_.input_h;
+        const size_t out_elems = (size_t)backend_.output_channels() * backend_.output_anchors();
+        while (t.tile_input.size() + 1 < layout->units.size())
+        {
+            float *in = backend_.alloc_host(in_elems);
+            float *out = out_elems > 0 ? backend_.alloc_host(out_elems) : nullptr;
+            if (in)
+            {
+                t.tile_input.push_back(in);
+                t.tile_output.push_back(out);
+            }
+            if (!in || (out_elems > 0 && !out))
+            {
+                std::cerr << "Failed to allocate tile buffers (" << layout->units.size() << " units), frame " << t.index << " not tiled\n";
+                return nullptr;
+            }
+        }
+        return layout;
+    }
+
+    void preprocess_loop(int w)
+    {
+        LetterboxScratch scratch;
+        // letterbox tables depend only on the frame size; keep one per size seen (cameras differ)
+        std::vector<std::shared_ptr<LetterboxPlan>> plans;
+        std::vector<std::shared_ptr<TileLayout>> layouts;
+        for (;;)
+        {
+            FrameTask *t = nullptr;
+            if (!pre_in_[w]->pop(t, abort_input_))
+                return;
+            if (!t->eos && t->do_detect && cfg_.tiles.enabled && (t->tiles = tile_layout(*t, layouts)))
+            {
+                ScopedTimer timer(*this, kPreprocess);
+                // the tiles of one frame are letterboxed in parallel (helpers plus this worker)
+                tile_workers_->run(t->units(), [t](int u, LetterboxScratch &s)
+                                   {
+                                       const TileLayout::Unit &unit = t->tiles->units[u];
+                                       const cv::Mat &f = t->frame;
+                                       letterbox_bgr_to_planar(f.data + unit.y * f.step + unit.x * 3, f.step, t->tiles->plan(unit), s, t->unit_input(u)); },
+                                   scratch);
+            }
+            else if (!t->eos && t->do_detect)
+            {
+                ScopedTimer timer(*this, kPreprocess);
+                const cv::Mat &f = t->frame;
+                std::shared_ptr<LetterboxPlan> plan;
+                for (const auto &p : plans)
+                    if (p->matches(f.cols, f.rows, cfg_.input_w, cfg_.input_h))
+                        plan = p;
+                if (!plan)
+                {
+                    plan = std::make_shared<LetterboxPlan>(make_letterbox_plan(f.cols, f.rows, cfg_.input_w, cfg_.input_h));
+                    if (plans.size() >= kMaxCachedPlans)
+                        plans.erase(plans.begin());
+                    plans.push_back(plan);
+                }
+                letterbox_bgr_to_planar(f.data, f.step, *plan, scratch, t->input);
+                t->plan = plan;
+            }
+            if (!pre_out_[w]->push(t, abort_input_) || t->eos)
+                return;
+        }
+    }
+
+    void infer_loop()
+    {
+        const int N = cfg_.pre_threads, M = cfg_.post_threads, B = cfg_.max_batch;
+        const auto max_wait = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(cfg_.max_wait_ms));
+        size_t in_seq = 0, out_seq = 0;
+        std::vector<FrameTask *> pending; // in input order, their units to detect reach B at most once
+        std::vector<const float *> inputs;
+        std::vector<float *> outputs;
+        int pending_detect = 0;
+        std::chrono::steady_clock::time_point deadline;
+        bool ok = true;
+        // entries: every task once, plus the frameless leading calls of a split tile batch
+        SlotRing<std::vector<FrameTask *>> ring(backend_.async_slots(), (size_t)cfg_.depth * num_sources_ + backend_.async_slots() + 1);
+        std::vector<std::chrono::steady_clock::time_point> submitted(ring.slots()); // per slot, for the latency histogram
+
+        // wait for the oldest submission (if it has device work) and pass its frames on
+        auto retire = [&]() -> bool
+        {
+            int slot = ring.front_slot();
+            if (slot >= 0)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                if (!backend_.wait(slot))
+                {
+                    std::cerr << "Inference (" << backend_.name() << ") failed";
+                    if (!ring.front().empty())
+                        std::cerr << " on frame " << ring.front().front()->index;
+                    std::cerr << "\n";
+                    return false;
+                }
+                // busy = time blocked here; the histogram gets the whole submit-to-ready time of the batch
+                add_busy(kInfer, t0);
+                stats_[kInfer].items.fetch_add(1, std::memory_order_relaxed);
+                if (metrics_)
+                    metrics_->timer(Metrics::kInfer).record(std::chrono::steady_clock::now() - submitted[slot]);
+            }
+            for (FrameTask *t : ring.front())
+            {
+                post_in_[out_seq % M]->push(t, never_abort_);
+                ++out_seq;
+            }
+            ring.pop();
+            return true;
+        };
+
+        auto flush = [&]() -> bool
+        {
+            int slot = -1;
+            if (pending_detect > 0)
+            {
+                inputs.clear();
+                outputs.clear();
+                for (FrameTask *t : pending)
+                    if (t->do_detect)
+                        for (int u = 0; u < t->units(); ++u)
+                        {
+                            inputs.push_back(t->unit_input(u));
+                            outputs.push_back(t->unit_output(u));
+                        }
+                // more units than max_batch (tiles): several calls, the frames ride with the last
+                for (size_t c0 = 0; c0 < inputs.size(); c0 += B)
+                {
+                    if (c0 > 0)
+                        ring.push(slot).clear();
+                    while (ring.full())
+                        if (!retire())
+                            return false;
+                    slot = ring.acquire();
+                    int n = (int)std::min<size_t>(B, inputs.size() - c0);
+                    auto t0 = std::chrono::steady_clock::now();
+                    submitted[slot] = t0;
+                    if (!backend_.submit(slot, inputs.data() + c0, outputs.data() + c0, n))
+                    {
+                        std::cerr << "Inference (" << backend_.name() << ") submit failed on frame " << pending.front()->index
+                                  << " (batch of " << n << ")\n";
+                        return false;
+                    }
+                    add_busy(kInfer, t0);
+                    batch_frames_.fetch_add(n, std::memory_order_relaxed);
+                }
+            }
+            std::vector<FrameTask *> &entry = ring.push(slot);
+            entry.swap(pending);
+            pending.clear();
+            pending_detect = 0;
+            // frames without device work can go as soon as nothing is in front of them
+            while (!ring.empty() && ring.front_slot() < 0)
+                retire();
+            return true;
+        };
+
+        Backoff backoff;
+        for (;;)
+        {
+            FrameTask *t = nullptr;
+            if (pending_detect == 0)
+            {
+                if (ring.empty())
+                {
+                    if (!pre_out_[in_seq % N]->pop(t, abort_input_))
+                        break;
+                }
+                else if (!pre_out_[in_seq % N]->try_pop(t))
+                {
+                    // nothing new to submit: finish the oldest batch in flight
+                    if (!(ok = retire()))
+                        break;
+                    continue;
+                }
+            }
+            else if (!pre_out_[in_seq % N]->try_pop(t))
+            {
+                // partial batch: wait for more frames until the deadline
+                if (std::chrono::steady_clock::now() >= deadline || abort_input_)
+                {
+                    if (!(ok = flush()))
+                        break;
+                    backoff.reset();
+                }
+                else
+                    backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            if (t->eos)
+            {
+                ok = flush();
+                while (ok && !ring.empty())
+                    ok = retire();
+                break;
+            }
+            ++in_seq;
+            pending.push_back(t);
+            if (t->do_detect)
+            {
+                if (pending_detect == 0)
+                    deadline = std::chrono::steady_clock::now() + max_wait;
+                pending_detect += t->units();
+            }
+            if (pending_detect >= B || pending_detect == 0)
+            {
+                if (!(ok = flush()))
+                    break;
+            }
+        }
+        if (!ok)
+        {
+            infer_failed_ = true;
+            abort_input_ = true;
+        }
+        for (int k = 0; k < M; ++k)
+        {
+            FrameTask *e = eos_tasks_[cfg_.pre_threads + k].get();
+            e->seq = out_seq + k;
+            post_in_[(out_seq + k) % M]->push(e, never_abort_);
+        }
+    }
+
+    void postprocess_loop(int w)
+    {
+        YoloDecodeScratch decode_scratch;
+        DetectionBuffer candidates, unit_candidates;
+        NmsScratch nms_scratch;
+        std::vector<int> keep;
+        std::vector<char> cut, kept_cut; // tiled frames: candidate touches an inner tile edge
+        const int C = backend_.output_channels(), L = backend_.output_anchors();
+        for (;;)
+        {
+            FrameTask *t = nullptr;
+            post_in_[w]->pop(t, never_abort_);
+            if (!t->eos && t->do_detect)
+            {
+                ScopedTimer timer(*this, kPostprocess);
+                candidates.clear();
+                // box coordinates are in model input space (with letterbox pad); the decoder maps them back
+                if (t->tiles && t->output)
+                    decode_tiles(*t, C, L, decode_scratch, unit_candidates, candidates, cut);
+                else if (t->output && t->plan)
+                    decode_yolo_output(t->output, C, L, *t->plan, cfg_.conf_thresh, decode_scratch, candidates);
+                nms_boxes(candidates, cfg_.nms, nms_scratch, keep);
+                t->dets.clear();
+                kept_cut.clear();
+                for (int k : keep)
+                {
+                    t->dets.push_back(candidates.at(k));
+                    if (t->tiles)
+                        kept_cut.push_back(cut[k]);
+                }
+                // halves of a box cut by a tile edge survive NMS; join them
+                if (t->tiles)
+                    fuse_tile_boxes(t->dets, kept_cut, cfg_.tiles.fuse_ios);
+            }
+            post_out_[w]->push(t, never_abort_);
+            if (t->eos)
+                return;
+        }
+    }
+
+    // All units of a tiled frame into one candidate list in frame coordinates.
+    void decode_tiles(const FrameTask &t, int C, int L, YoloDecodeScratch &scratch, DetectionBuffer &unit,
+                      DetectionBuffer &all, std::vector<char> &cut)
+    {
+        const TileLayout &layout = *t.tiles;
+        all.reserve((size_t)L * layout.units.size());
+        cut.resize(all.capacity());
+        for (int u = 0; u < t.units(); ++u)
+        {
+            const TileLayout::Unit &r = layout.units[u];
+            decode_yolo_output(t.unit_output(u), C, L, layout.plan(r), cfg_.conf_thresh, scratch, unit);
+            for (size_t i = 0; i < unit.count; ++i)
+            {
+                float x1 = unit.x1[i] + r.x, y1 = unit.y1[i] + r.y, x2 = unit.x2[i] + r.x, y2 = unit.y2[i] + r.y;
+                cut[all.count] = layout.cut_at_edge(r, x1, y1, x2, y2);
+                all.push(x1, y1, x2, y2, unit.score[i], unit.class_id[i]);
+            }
+        }
+    }
+
+    void output_loop(const Sink &sink)
+    {
+        const int M = cfg_.post_threads;
+        size_t seq = 0;
+        for (;;)
+        {
+            FrameTask *t = nullptr;
+            post_out_[seq % M]->pop(t, never_abort_);
+            if (t->eos)
+                break;
+            {
+                ScopedTimer timer(*this, kOutput);
+                sink(*t);
+            }
+            src_free_[t->stream]->push(t, never_abort_);
+            ++seq;
+        }
+    }
+
+    PipelineConfig cfg_;
+    InferenceBackend &backend_;
+    std::unique_ptr<TileWorkers> tile_workers_; // tiled preprocessing
+    std::vector<std::unique_ptr<FrameTask>> tasks_, eos_tasks_;
+    static constexpr size_t kMaxCachedPlans = 8;
+    int num_sources_ = 0;
+    std::vector<std::unique_ptr<SpscQueue<FrameTask *>>> src_free_, src_ready_; // per source
+    std::vector<int> src_depth_; // tasks owned by each source
+    std::unique_ptr<std::atomic<bool>[]> src_done_;
+    std::vector<std::unique_ptr<SpscQueue<FrameTask *>>> pre_in_, pre_out_, post_in_, post_out_;
+    std::atomic<bool> abort_input_{false};
+    std::atomic<bool> infer_failed_{false};
+    const std::atomic<bool> never_abort_{false};
+    StageStats stats_[kStageCount];
+    Metrics *metrics_ = nullptr;
+    std::atomic<bool> running_{false}; // queues exist (for queue_depth / in_flight from other threads)
+    std::atomic<uint64_t> batch_frames_{0}; // images (frames or tiles) sent to the backend (infer items count calls)
+    std::chrono::steady_clock::time_point start_, end_;
+};
@@ -0,0 +1,419 @@
+#pragma once
+// Machine-readable detection results (--results) and the human-readable log lines.
+//
+// One record per output frame: stream, frame index, stream time, wall-clock
+// time, whether the model ran on it, and the boxes (class, track id, score,
+// corners). The output thread only encodes the record into a memory buffer; a
+// background thread writes the buffer out in large chunks, so no per-line
+// syscall or flush happens on the output thread.
+//
+//   jsonl  one JSON object per line
+//   bin    fixed-layout little-endian records: ResultRecordHeader followed by
+//          `count` ResultBox entries (no padding, no per-file header)
+//
+// The target is a file path or unix:/path/to/socket (a SOCK_STREAM listener,
+// connected once at start). When the background thread falls more than
+// `max_pending` bytes behind, a file target makes the output thread wait; a
+// socket target drops whole records instead, so a slow reader cannot stall
+// detection.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "alarm.hpp" // json_escape
+#include "detection.hpp"
+
+enum class ResultFormat
+{
+    Jsonl,
+    Binary
+};
+
+// jsonl | bin; returns false for anything else.
+inline bool parse_result_format(const std::string &s, ResultFormat &fmt)
+{
+    if (s == "jsonl" || s == "json")
+        fmt = ResultFormat::Jsonl;
+    else if (s == "bin" || s == "binary")
+        fmt = ResultFormat::Binary;
+    else
+        return false;
+    return true;
+}
+
+struct ResultRecordHeader
+{
+    uint32_t magic;    // kResultMagic
+    uint16_t version;  // 1
+    uint16_t flags;    // bit 0: the model ran on this frame (otherwise tracked / repeated boxes)
+    uint32_t stream;   // index in the stream list (0 for a single input)
+    uint32_t count;    // ResultBox entries that follow
+    uint64_t frame;    // frame index within the stream
+    double time_sec;   // stream time (video position, or index / --img-fps for image lists)
+    int64_t wall_us;   // wall-clock time, microseconds since the Unix epoch
+};
+
+struct ResultBox
+{
+    float x1, y1, x2, y2, score;
+    int32_t class_id, track_id; // track_id -1 without tracking
+};
+
+static_assert(sizeof(ResultRecordHeader) == 40, "ResultRecordHeader layout");
+static_assert(sizeof(ResultBox) == 28, "ResultBox layout");
+
+constexpr uint32_t kResultMagic = 0x54454448; // "HDET" in a little-endian file
+constexpr uint16_t kResultDetected = 1;
+
+inline const std::string &result_class_name(const std::vector<std::string> &class_names, int class_id, std::string &scratch)
+{
+    if (class_id >= 0 && class_id < (int)class_names.size())
+        return class_names[class_id];
+    scratch = std::to_string(class_id);
+    return scratch;
+}
+
+// Human-readable lines of one frame, appended to `out` (same text as the old per-box std::cout lines).
+inline void append_frame_log(std::string &out, const std::string &tag, bool video_mode, size_t frame_idx, double pos_msec,
+                             const std::string &file, const std::vector<Detection> &dets, const std::vector<std::string> &class_names)
+{
+    char buf[256];
+    out += tag;
+    if (video_mode)
+    {
+        snprintf(buf, sizeof(buf), "Frame: %zu time_ms: %g\n", frame_idx, pos_msec);
+        out += buf;
+    }
+    else
+    {
+        out += "File: ";
+        out += file;
+        out += '\n';
+    }
+    std::string scratch;
+    for (const Detection &d : dets)
+    {
+        out += tag;
+        out += "  Class: ";
+        out += result_class_name(class_names, d.class_id, scratch);
+        if (d.track_id >= 0)
+        {
+            snprintf(buf, sizeof(buf), ", Track: %d", d.track_id);
+            out += buf;
+        }
+        snprintf(buf, sizeof(buf), ", Conf: %.2f, Box: [%d,%d,%d,%d]\n", d.score, (int)std::lround(d.x1), (int)std::lround(d.y1),
+                 (int)std::lround(d.x2), (int)std::lround(d.y2));
+        out += buf;
+    }
+}
+
+// Encodes one frame's record (jsonl or bin, see above) into a string; shared by
+// the results file and the daemon replies. Escaped names are cached per encoder.
+class ResultEncoder
+{
+public:
+    void binary(std::string &out, uint32_t stream, size_t frame_idx, double time_sec, int64_t wall_us, bool detected, const std::vector<Detection> &dets)
+    {
+        ResultRecordHeader h{kResultMagic, 1, (uint16_t)(detected ? kResultDetected : 0), stream, (uint32_t)dets.size(),
+                             (uint64_t)frame_idx, time_sec, wall_us};
+        out.append((const char *)&h, sizeof(h));
+        for (const Detection &d : dets)
+        {
+            ResultBox b{d.x1, d.y1, d.x2, d.y2, d.score, d.class_id, d.track_id};
+            out.append((const char *)&b, sizeof(b));
+        }
+    }
+
+    void jsonl(std::string &out, const std::string &stream_name, size_t frame_idx, double time_sec, int64_t wall_us, bool detected,
+               const std::vector<Detection> &dets, const std::vector<std::string> &class_names)
+    {
+        // escaped names are cached; numbers are formatted by hand (snprintf of floats dominated the cost)
+        if (stream_name != stream_name_)
+        {
+            stream_name_ = stream_name;
+            stream_json_ = json_escape(stream_name);
+        }
+        if (class_json_.size() != class_names.size())
+        {
+            class_json_.clear();
+            for (const std::string &n : class_names)
+                class_json_.push_back(json_escape(n));
+        }
+        out += "{\"stream\":\"";
+        out += stream_json_;
+        out += "\",\"frame\":";
+        append_int(out, (int64_t)frame_idx);
+        out += ",\"time_sec\":";
+        append_fixed(out, time_sec, 3);
+        out += ",\"wall_us\":";
+        append_int(out, wall_us);
+        out += detected ? ",\"detected\":true,\"boxes\":[" : ",\"detected\":false,\"boxes\":[";
+        for (size_t i = 0; i < dets.size(); ++i)
+        {
+            const Detection &d = dets[i];
+            out += i ? ",{\"class\":\"" : "{\"class\":\"";
+            if (d.class_id >= 0 && d.class_id < (int)class_json_.size())
+                out += class_json_[d.class_id];
+            else
+                append_int(out, d.class_id);
+            out += "\",\"class_id\":";
+            append_int(out, d.class_id);
+            out += ",\"track\":";
+            append_int(out, d.track_id);
+            out += ",\"conf\":";
+            append_fixed(out, d.score, 3);
+            out += ",\"box\":[";
+            append_fixed(out, d.x1, 1);
+            out += ',';
+            append_fixed(out, d.y1, 1);
+            out += ',';
+            append_fixed(out, d.x2, 1);
+            out += ',';
+            append_fixed(out, d.y2, 1);
+            out += "]}";
+        }
+        out += "]}\n";
+    }
+
+    static void append_int(std::string &out, int64_t v)
+    {
+        char buf[24];
+        char *end = buf + sizeof(buf), *p = end;
+        uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+        do
+        {
+            *--p = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0)
+            *--p = '-';
+        out.append(p, end);
+    }
+
+    // `decimals` (1-3) fixed digits, rounded half away from zero
+    static void append_fixed(std::string &out, double v, int decimals)
+    {
+        static const int64_t scale[] = {1, 10, 100, 1000};
+        if (!(std::fabs(v) < 1e12))
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%.*f", decimals, std::isfinite(v) ? v : 0.0);
+            out += buf;
+            return;
+        }
+        int64_t q = std::llround(std::fabs(v) * scale[decimals]);
+        if (v < 0 && q != 0)
+            out += '-';
+        append_int(out, q / scale[decimals]);
+        out += '.';
+        int64_t frac = q % scale[decimals];
+        for (int64_t s = scale[decimals] / 10; s > 0; s /= 10)
+            out += (char)('0' + frac / s % 10);
+    }
+
+private:
+    std::string stream_name_, stream_json_;
+    std::vector<std::string> class_json_;
+};
+
+class ResultSink
+{
+public:
+    ResultSink() = default;
+    ~ResultSink() { close(); }
+
+    ResultSink(const ResultSink &) = delete;
+    ResultSink &operator=(const ResultSink &) = delete;
+
+    // `target`: file path or unix:/path. Returns false (and logs) when it cannot be opened.
+    bool open(const std::string &target, ResultFormat fmt, int log_level = 1, size_t max_pending = 4u << 20)
+    {
+        close();
+        fmt_ = fmt;
+        log_level_ = log_level;
+        max_pending_ = std::max<size_t>(4096, max_pending);
+        target_ = target;
+        socket_ = target.rfind("unix:", 0) == 0;
+        if (socket_)
+        {
+            std::string path = target.substr(5);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            {
+                std::cerr << "Invalid results socket path: " << path << std::endl;
+                return false;
+            }
+            memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd_ >= 0 && ::connect(fd_, (const sockaddr *)&addr, sizeof(addr)) != 0)
+            {
+                ::close(fd_);
+                fd_ = -1;
+            }
+        }
+        else
+            fd_ = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+        {
+            std::cerr << "Failed to open results target " << target << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        pending_.reserve(max_pending_);
+        writing_.reserve(max_pending_);
+        stop_ = false;
+        thread_ = std::thread([this]
+                              { writer_loop(); });
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Encode one frame's record and queue it. Called from a single thread (the output thread).
+    void write(uint32_t stream, const std::string &stream_name, size_t frame_idx, double time_sec, bool detected,
+               const std::vector<Detection> &dets, const std::vector<std::string> &class_names)
+    {
+        if (fd_ < 0)
+            return;
+        int64_t wall_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record_.clear();
+        if (fmt_ == ResultFormat::Binary)
+            encoder_.binary(record_, stream, frame_idx, time_sec, wall_us, detected, dets);
+        else
+            encoder_.jsonl(record_, stream_name, frame_idx, time_sec, wall_us, detected, dets, class_names);
+        write_raw(record_);
+    }
+
+    // Queue bytes encoded by the caller as one record (same waiting / dropping rules).
+    // False when the record was dropped.
+    bool write_raw(const std::string &record)
+    {
+        if (fd_ < 0)
+            return false;
+        std::unique_lock<std::mutex> lock(mu_);
+        if (!pending_.empty() && pending_.size() + record.size() > max_pending_)
+        {
+            if (socket_ || failed_)
+            {
+                ++dropped_;
+                return false;
+            }
+            ++waits_;
+            drained_.wait(lock, [this, &record]
+                          { return pending_.empty() || pending_.size() + record.size() <= max_pending_ || failed_ || stop_; });
+        }
+        if (failed_)
+        {
+            ++dropped_;
+            return false;
+        }
+        pending_ += record;
+        ++records_;
+        lock.unlock();
+        ready_.notify_one();
+        return true;
+    }
+
+    // Write out everything queued and close the target.
+    void close()
+    {
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        ready_.notify_one();
+        drained_.notify_all();
+        thread_.join();
+        ::close(fd_);
+        fd_ = -1;
+        if (log_level_ >= 1)
+            std::cout << "Results: " << records_.load() << " records, " << bytes_ / 1024 << " KiB to " << target_
+                      << (dropped_.load() ? ", " + std::to_string(dropped_.load()) + " dropped" : std::string())
+                      << (waits_ ? ", output waited " + std::to_string(waits_) + " times" : std::string()) << std::endl;
+    }
+
+    uint64_t records() const { return records_.load(); }
+    uint64_t dropped() const { return dropped_.load(); }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    void writer_loop()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        for (;;)
+        {
+            ready_.wait(lock, [this]
+                        { return !pending_.empty() || stop_; });
+            if (pending_.empty())
+                return; // stopped and drained
+            writing_.swap(pending_);
+            lock.unlock();
+            drained_.notify_all();
+            bool ok = write_all(writing_);
+            writing_.clear();
+            lock.lock();
+            if (!ok && !failed_)
+            {
+                failed_ = true;
+                pending_.clear();
+                std::cerr << "Results target " << target_ << " failed: " << strerror(errno) << ", dropping further records" << std::endl;
+                drained_.notify_all();
+            }
+        }
+    }
+
+    bool write_all(const std::string &buf)
+    {
+        const char *p = buf.data();
+        size_t left = buf.size();
+        while (left > 0)
+        {
+            // MSG_NOSIGNAL: a reader that went away is an error here, not SIGPIPE
+            ssize_t n = socket_ ? ::send(fd_, p, left, MSG_NOSIGNAL) : ::write(fd_, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            left -= (size_t)n;
+            bytes_ += (uint64_t)n;
+        }
+        return true;
+    }
+
+    ResultFormat fmt_ = ResultFormat::Jsonl;
+    int log_level_ = 1;
+    size_t max_pending_ = 4u << 20;
+    std::string target_;
+    bool socket_ = false;
+    int fd_ = -1;
+    std::string record_; // output thread only
+    ResultEncoder encoder_;
+
+    std::mutex mu_;
+    std::condition_variable ready_, drained_;
+    std::string pending_, writing_;
+    bool stop_ = false, failed_ = false;
+    std::atomic<uint64_t> records_{0}, dropped_{0}; // also read by the metrics thread
+    uint64_t waits_ = 0;
+    uint64_t bytes_ = 0; // writer thread; read after close()
+    std::thread thread_;
+};
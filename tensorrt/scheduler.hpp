@@ -0,0 +1,148 @@
+#pragma once
+// Adaptive choice of the video frames that go through the model (--adaptive).
+//
+// Instead of every N-th frame, a frame is inferred when something may have
+// changed: motion in the picture, tracks whose predicted position has become
+// uncertain, or an active alarm. Idle scenes fall back to one detection every
+// max_interval frames. When the pipeline falls behind its latency budget the
+// minimum interval is stretched in proportion, shedding inference load first.
+//
+// Motion is measured on a coarse luma thumbnail sampled straight from the BGR
+// frame (no resize, no allocation after the first frame): the score is the
+// fraction of cells that changed by more than `pixel_thresh` grey levels since
+// the previous frame. It costs a few tens of microseconds per 1080p frame.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+struct SchedulerConfig
+{
+    int min_interval = 1;             // frames between detections at least (1 = react on the next frame)
+    int max_interval = 30;            // and at most
+    float motion_thresh = 0.005f;     // share of changed thumbnail cells that counts as motion
+    int pixel_thresh = 12;            // grey-level change of one cell
+    float uncertainty_thresh = 0.25f; // track position std relative to box size
+    double latency_budget_ms = 0.0;   // capture-to-output latency to stay under (0 = no load shedding)
+};
+
+// State the output thread reports back to the capture thread.
+struct ScheduleFeedback
+{
+    std::atomic<float> track_uncertainty{0.0f};
+    std::atomic<float> latency_ms{0.0f};
+    std::atomic<bool> alarm{false};
+};
+
+class DetectScheduler
+{
+public:
+    enum Reason
+    {
+        Skip,
+        First,
+        Motion,
+        Tracks,
+        Alarm,
+        MaxInterval,
+        kReasons
+    };
+
+    static const char *reason_name(Reason r)
+    {
+        static const char *names[kReasons] = {"skip", "first", "motion", "tracks", "alarm", "max-interval"};
+        return names[r];
+    }
+
+    explicit DetectScheduler(const SchedulerConfig &cfg = SchedulerConfig()) : cfg_(cfg)
+    {
+        cfg_.min_interval = std::max(1, cfg_.min_interval);
+        cfg_.max_interval = std::max(cfg_.min_interval, cfg_.max_interval);
+    }
+
+    // Decide for the next frame; anything but Skip means run the model.
+    Reason decide(const cv::Mat &frame, const ScheduleFeedback &fb)
+    {
+        float m = motion_score(frame);
+        ++frames_;
+        Reason r = Skip;
+        if (since_ < 0)
+            r = First;
+        else
+        {
+            ++since_;
+            int min_interval = cfg_.min_interval;
+            float latency = fb.latency_ms.load(std::memory_order_relaxed);
+            if (cfg_.latency_budget_ms > 0.0 && latency > cfg_.latency_budget_ms)
+                min_interval = std::min(cfg_.max_interval, (int)std::ceil(min_interval * latency / cfg_.latency_budget_ms));
+            if (since_ >= cfg_.max_interval)
+                r = MaxInterval;
+            else if (since_ >= min_interval)
+            {
+                if (m >= cfg_.motion_thresh)
+                    r = Motion;
+                else if (fb.alarm.load(std::memory_order_relaxed))
+                    r = Alarm;
+                else if (fb.track_uncertainty.load(std::memory_order_relaxed) > cfg_.uncertainty_thresh)
+                    r = Tracks;
+            }
+        }
+        if (r != Skip)
+            since_ = 0;
+        ++counts_[r];
+        return r;
+    }
+
+    float motion() const { return motion_; }
+    uint64_t frames() const { return frames_; }
+    uint64_t count(Reason r) const { return counts_[r]; }
+    uint64_t detected() const { return frames_ - counts_[Skip]; }
+
+private:
+    static constexpr int kGridW = 64, kGridH = 36;
+
+    float motion_score(const cv::Mat &frame)
+    {
+        if (frame.empty() || frame.channels() != 3)
+            return motion_ = 1.0f;
+        bool fresh = thumb_.empty() || frame.cols != thumb_w_ || frame.rows != thumb_h_;
+        thumb_.resize(kGridW * kGridH);
+        prev_.resize(kGridW * kGridH);
+        thumb_.swap(prev_);
+        // 2x2 samples per cell, luma ~ (B + 2G + R) / 4
+        int changed = 0;
+        for (int gy = 0; gy < kGridH; ++gy)
+        {
+            const uint8_t *rows[2] = {frame.ptr<uint8_t>((gy * 4 + 1) * frame.rows / (kGridH * 4)),
+                                      frame.ptr<uint8_t>((gy * 4 + 3) * frame.rows / (kGridH * 4))};
+            for (int gx = 0; gx < kGridW; ++gx)
+            {
+                int xs[2] = {(gx * 4 + 1) * frame.cols / (kGridW * 4), (gx * 4 + 3) * frame.cols / (kGridW * 4)};
+                int sum = 0;
+                for (const uint8_t *row : rows)
+                    for (int x : xs)
+                        sum += row[x * 3] + 2 * row[x * 3 + 1] + row[x * 3 + 2];
+                uint8_t v = (uint8_t)(sum >> 4);
+                int i = gy * kGridW + gx;
+                thumb_[i] = v;
+                changed += std::abs((int)v - (int)prev_[i]) > cfg_.pixel_thresh;
+            }
+        }
+        thumb_w_ = frame.cols;
+        thumb_h_ = frame.rows;
+        motion_ = fresh ? 1.0f : (float)changed / (kGridW * kGridH);
+        return motion_;
+    }
+
+    SchedulerConfig cfg_;
+    std::vector<uint8_t> thumb_, prev_;
+    int thumb_w_ = 0, thumb_h_ = 0;
+    float motion_ = 0.0f;
+    int since_ = -1; // frames since the last detection, -1 before the first
+    uint64_t frames_ = 0;
+    uint64_t counts_[kReasons] = {};
+};
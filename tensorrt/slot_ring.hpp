@@ -0,0 +1,82 @@
+#pragma once
+// In-order ring of in-flight submissions for asynchronous inference.
+//
+// Up to `slots` batches can be submitted before the oldest has to be waited for
+// (double / triple buffering). Entries retire strictly in submission order, so
+// frames leave in input order. Entries without device work (slot -1, e.g. frames
+// that skip detection) queue behind the in-flight ones without taking a slot.
+// Entry storage is reused, so a warmed-up ring does not allocate.
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+template <typename T>
+class SlotRing
+{
+public:
+    // max_entries bounds in-flight plus no-work entries
+    SlotRing(int slots, size_t max_entries)
+        : busy_(std::max(1, slots), false), entries_(std::max<size_t>(1, max_entries))
+    {
+    }
+
+    int slots() const { return (int)busy_.size(); }
+    int in_flight() const { return in_flight_; }
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return in_flight_ == slots(); }
+
+    // Claims a free slot for a submission; -1 when all slots are in flight.
+    int acquire()
+    {
+        for (int k = 0; k < slots(); ++k)
+        {
+            int s = (next_ + k) % slots();
+            if (!busy_[s])
+            {
+                busy_[s] = true;
+                next_ = (s + 1) % slots();
+                ++in_flight_;
+                return s;
+            }
+        }
+        return -1;
+    }
+
+    // Appends an entry for `slot` (from acquire(), or -1) and returns its value to fill.
+    // The value keeps whatever the slot held last time; clear it before use.
+    T &push(int slot)
+    {
+        Entry &e = entries_[(head_ + count_) % entries_.size()];
+        ++count_;
+        e.slot = slot;
+        return e.value;
+    }
+
+    int front_slot() const { return entries_[head_].slot; }
+    T &front() { return entries_[head_].value; }
+
+    // Retires the oldest entry and frees its slot.
+    void pop()
+    {
+        Entry &e = entries_[head_];
+        if (e.slot >= 0)
+        {
+            busy_[e.slot] = false;
+            --in_flight_;
+        }
+        head_ = (head_ + 1) % entries_.size();
+        --count_;
+    }
+
+private:
+    struct Entry
+    {
+        int slot = -1;
+        T value{};
+    };
+    std::vector<bool> busy_;
+    std::vector<Entry> entries_;
+    size_t head_ = 0, count_ = 0;
+    int next_ = 0, in_flight_ = 0;
+};
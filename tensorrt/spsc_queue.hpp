@@ -0,0 +1,125 @@
+#pragma once
+// Bounded lock-free single-producer / single-consumer ring buffer.
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPSC_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#define SPSC_CPU_RELAX() asm volatile("yield" ::: "memory")
+#else
+#define SPSC_CPU_RELAX() ((void)0)
+#endif
+
+// Spin briefly, then yield, then sleep; keeps idle stages cheap without adding
+// much latency when work arrives.
+struct Backoff
+{
+    int n = 0;
+    void pause()
+    {
+        if (n < 64)
+            SPSC_CPU_RELAX();
+        else if (n < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(n < 256 ? 50 : 200));
+        if (n < 1024)
+            ++n;
+    }
+    void reset() { n = 0; }
+};
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity = 8)
+    {
+        size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+        buf_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // producer side
+    bool try_push(const T &v)
+    {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        if (t - head_cache_ > mask_)
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (t - head_cache_ > mask_)
+                return false;
+        }
+        buf_[t & mask_] = v;
+        tail_.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool try_pop(T &v)
+    {
+        size_t h = head_.load(std::memory_order_relaxed);
+        if (h == tail_cache_)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (h == tail_cache_)
+                return false;
+        }
+        v = buf_[h & mask_];
+        head_.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking variants; return false if `abort` becomes true while waiting.
+    bool push(const T &v, const std::atomic<bool> &abort)
+    {
+        Backoff b;
+        while (!try_push(v))
+        {
+            if (abort.load(std::memory_order_relaxed))
+                return false;
+            b.pause();
+        }
+        return true;
+    }
+
+    bool pop(T &v, const std::atomic<bool> &abort)
+    {
+        Backoff b;
+        while (!try_pop(v))
+        {
+            if (abort.load(std::memory_order_relaxed))
+                return false;
+            b.pause();
+        }
+        return true;
+    }
+
+    // number of queued items as seen from any thread (may be momentarily stale)
+    size_t size_approx() const
+    {
+        size_t h = head_.load(std::memory_order_acquire);
+        size_t t = tail_.load(std::memory_order_acquire);
+        return t >= h ? t - h : 0;
+    }
+
+private:
+    std::vector<T> buf_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0}; // written by consumer
+    size_t tail_cache_ = 0;                   // consumer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0}; // written by producer
+    size_t head_cache_ = 0;                   // producer's view of head_
+};
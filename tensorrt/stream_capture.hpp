@@ -0,0 +1,235 @@
+#pragma once
+// Capture thread for live inputs (RTSP/RTMP/HTTP cameras, or a video file
+// replayed as one with --live).
+//
+// A camera does not wait for us: when cap.read() is only called as fast as the
+// pipeline takes frames, the decoder's internal buffer fills up and every frame
+// handed out is seconds old. LiveCapture reads on its own thread at the camera's
+// rate and keeps only the newest `depth` frames; when the pipeline is slower,
+// older frames are dropped (and counted) instead of queued. A failed read or a
+// stream that stops delivering frames is reopened with exponential backoff
+// while the rest of the process (model, writers, alarms) keeps running.
+//
+// A replayed file is paced at its own frame rate and starts over at the end,
+// which is how a reconnect looks to the consumer.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.hpp"
+
+struct CaptureConfig
+{
+    size_t depth = 1;                // frames kept for the pipeline (1 = latest frame only)
+    int in_flight = 2;               // frames of the input inside the pipeline (PipelineConfig::source_depth)
+    double reconnect_min_sec = 0.5;  // first retry delay, doubled per failed attempt
+    double reconnect_max_sec = 30.0; // longest retry delay
+    int open_timeout_ms = 10000;     // FFmpeg backend: give up on a dead host / stalled read
+    int read_timeout_ms = 5000;
+};
+
+class LiveCapture
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Frame
+    {
+        cv::Mat image;
+        clock::time_point captured; // when the capture thread had the frame decoded
+        double pos_msec = 0.0;      // stream timestamp (CAP_PROP_POS_MSEC)
+    };
+
+    // `replay`: `url` is a file played back in real time and looped.
+    LiveCapture(std::string url, const CaptureConfig &cfg, bool replay, int log_level, std::string tag)
+        : url_(std::move(url)), cfg_(cfg), replay_(replay), log_level_(log_level), tag_(std::move(tag)),
+          ring_(std::max<size_t>(1, cfg.depth))
+    {
+    }
+
+    ~LiveCapture() { stop(); }
+
+    LiveCapture(const LiveCapture &) = delete;
+    LiveCapture &operator=(const LiveCapture &) = delete;
+
+    // Opens the input on the calling thread (so a bad URL fails startup as before),
+    // then starts the capture thread.
+    bool start()
+    {
+        if (!open())
+            return false;
+        fps_ = cap_.get(cv::CAP_PROP_FPS);
+        thread_ = std::thread([this]
+                              { loop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        ready_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    // Oldest frame still kept (with depth 1: the newest captured). Waits up to
+    // `timeout`; false on timeout or after stop().
+    bool next(Frame &out, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        if (!ready_.wait_for(lock, timeout, [this]
+                             { return count_ > 0 || stop_; }) ||
+            count_ == 0)
+            return false;
+        Frame &f = ring_[head_];
+        out.image = f.image;
+        out.captured = f.captured;
+        out.pos_msec = f.pos_msec;
+        f.image.release();
+        head_ = (head_ + 1) % ring_.size();
+        --count_;
+        return true;
+    }
+
+    double fps() const { return fps_; }
+    uint64_t captured() const { return captured_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+    bool connected() const { return connected_.load(std::memory_order_relaxed); }
+
+private:
+    bool open()
+    {
+        cap_.release();
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+        if (!replay_)
+            return cap_.open(url_, cv::CAP_ANY, {cv::CAP_PROP_OPEN_TIMEOUT_MSEC, cfg_.open_timeout_ms, cv::CAP_PROP_READ_TIMEOUT_MSEC, cfg_.read_timeout_ms});
+#endif
+        return cap_.open(url_);
+    }
+
+    // sleep that stop() interrupts; false when stopping
+    bool sleep_for(double sec)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        return !wake_.wait_for(lock, std::chrono::duration<double>(sec), [this]
+                               { return stop_; });
+    }
+
+    bool stopping()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return stop_;
+    }
+
+    void loop()
+    {
+        FramePool pool;
+        cv::Size size;
+        connected_.store(true, std::memory_order_relaxed);
+        clock::time_point replay_start = clock::now();
+        double backoff = cfg_.reconnect_min_sec;
+        uint64_t since_open = 0; // frames read since the input was (re)opened
+        while (!stopping())
+        {
+            if (!connected_.load(std::memory_order_relaxed))
+            {
+                if (log_level_ >= 1)
+                    std::cout << tag_ << (replay_ ? "Restarting replay of " : "Reconnecting to ") << url_ << std::endl;
+                if (!open())
+                {
+                    if (log_level_ >= 1)
+                        std::cerr << tag_ << "Reconnect failed, retrying in " << backoff << "s" << std::endl;
+                    if (!sleep_for(backoff))
+                        break;
+                    backoff = std::min(backoff * 2.0, cfg_.reconnect_max_sec);
+                    continue;
+                }
+                reconnects_.fetch_add(1, std::memory_order_relaxed);
+                connected_.store(true, std::memory_order_relaxed);
+                replay_start = clock::now();
+                since_open = 0;
+            }
+
+            cv::Mat frame = pool.acquire(size.height, size.width, CV_8UC3);
+            if (!cap_.read(frame) || frame.empty())
+            {
+                // end of a replayed file, a dropped connection or a read timeout
+                if (log_level_ >= 1 && !replay_)
+                    std::cerr << tag_ << "Stream read failed: " << url_ << std::endl;
+                connected_.store(false, std::memory_order_relaxed);
+                cap_.release();
+                // a replay that reached its end restarts at once; anything else waits first
+                if ((!replay_ || since_open == 0) && !sleep_for(backoff))
+                    break;
+                if (since_open == 0)
+                    backoff = std::min(backoff * 2.0, cfg_.reconnect_max_sec);
+                continue;
+            }
+            backoff = cfg_.reconnect_min_sec;
+            ++since_open;
+            size = frame.size();
+            double pos_msec = cap_.get(cv::CAP_PROP_POS_MSEC);
+            if (replay_)
+            {
+                // deliver the file's frames no faster than they would come from a camera
+                auto due = replay_start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(pos_msec));
+                auto now = clock::now();
+                if (due > now && !sleep_for(std::chrono::duration<double>(due - now).count()))
+                    break;
+            }
+            captured_.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                if (count_ == ring_.size())
+                {
+                    // the pipeline is behind: the oldest kept frame is stale, drop it
+                    ring_[head_].image.release();
+                    head_ = (head_ + 1) % ring_.size();
+                    --count_;
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+                Frame &f = ring_[(head_ + count_) % ring_.size()];
+                f.image = frame;
+                f.captured = clock::now();
+                f.pos_msec = pos_msec;
+                ++count_;
+            }
+            frame.release();
+            ready_.notify_one();
+        }
+        cap_.release();
+    }
+
+    const std::string url_;
+    const CaptureConfig cfg_;
+    const bool replay_;
+    const int log_level_;
+    const std::string tag_;
+    cv::VideoCapture cap_; // capture thread only (after start())
+    double fps_ = 0.0;
+
+    std::mutex mu_;
+    std::condition_variable ready_, wake_;
+    std::vector<Frame> ring_;
+    size_t head_ = 0, count_ = 0;
+    bool stop_ = false;
+
+    std::atomic<bool> connected_{false};
+    std::atomic<uint64_t> captured_{0}, dropped_{0}, reconnects_{0};
+    std::thread thread_;
+};
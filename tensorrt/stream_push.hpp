@@ -0,0 +1,411 @@
+#pragma once
+// RTMP/FLV push of the annotated frames on a dedicated encoder thread.
+//
+// The output thread only queues a reference to the frame in a fixed ring. The
+// queue is bounded and drops the oldest frame when the encoder or the network
+// falls behind, so a slow or stalled server never blocks detection. Frames are
+// converted from BGR straight to YUV 4:2:0 before they reach the encoder.
+//
+// Built with -DHELMET_WITH_LIBAV=1 the frames are encoded (H.264) and muxed
+// in-process with libavcodec/libavformat and carry their capture time as
+// timestamp. Otherwise an `ffmpeg` child process is fed raw yuv420p through a
+// pipe at a constant rate. The target can be an rtmp:// URL or a local file
+// (the container is then taken from the extension, e.g. .flv or .mp4).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "metrics.hpp"
+
+#ifndef HELMET_WITH_LIBAV
+#define HELMET_WITH_LIBAV 0
+#endif
+
+#if HELMET_WITH_LIBAV
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+inline bool is_rtmp_url(const std::string &url)
+{
+    return url.rfind("rtmp://", 0) == 0 || url.rfind("rtmps://", 0) == 0;
+}
+
+#if HELMET_WITH_LIBAV
+// H.264 encoder + muxer writing to `url`; timestamps in milliseconds.
+class LibavMuxer
+{
+public:
+    ~LibavMuxer() { close(); }
+
+    bool open(const std::string &url, int w, int h, double fps, int log_level)
+    {
+        avformat_network_init();
+        const char *format = is_rtmp_url(url) ? "flv" : nullptr;
+        if (avformat_alloc_output_context2(&fmt_, nullptr, format, url.c_str()) < 0 || !fmt_)
+        {
+            std::cerr << "libav: no output format for " << url << std::endl;
+            return false;
+        }
+        const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+        if (!codec)
+            codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+        if (!codec)
+        {
+            std::cerr << "libav: no H.264 encoder available" << std::endl;
+            return false;
+        }
+        enc_ = avcodec_alloc_context3(codec);
+        enc_->width = w;
+        enc_->height = h;
+        enc_->pix_fmt = AV_PIX_FMT_YUV420P;
+        enc_->time_base = AVRational{1, 1000};
+        enc_->framerate = AVRational{(int)(fps + 0.5), 1};
+        enc_->gop_size = std::max(1, (int)(fps * 2.0 + 0.5)); // keyframe every ~2 s for late joiners
+        enc_->max_b_frames = 0;
+        av_opt_set(enc_->priv_data, "preset", "veryfast", 0);
+        av_opt_set(enc_->priv_data, "tune", "zerolatency", 0);
+        if (fmt_->oformat->flags & AVFMT_GLOBALHEADER)
+            enc_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (avcodec_open2(enc_, codec, nullptr) < 0)
+        {
+            std::cerr << "libav: failed to open encoder " << codec->name << std::endl;
+            return false;
+        }
+        st_ = avformat_new_stream(fmt_, nullptr);
+        if (!st_ || avcodec_parameters_from_context(st_->codecpar, enc_) < 0)
+            return false;
+        st_->time_base = enc_->time_base;
+        if (!(fmt_->oformat->flags & AVFMT_NOFILE) && avio_open(&fmt_->pb, url.c_str(), AVIO_FLAG_WRITE) < 0)
+        {
+            std::cerr << "libav: failed to open " << url << std::endl;
+            return false;
+        }
+        if (avformat_write_header(fmt_, nullptr) < 0)
+        {
+            std::cerr << "libav: failed to write header to " << url << std::endl;
+            return false;
+        }
+        header_written_ = true;
+        frame_ = av_frame_alloc();
+        pkt_ = av_packet_alloc();
+        if (!frame_ || !pkt_)
+            return false;
+        frame_->format = AV_PIX_FMT_YUV420P;
+        frame_->width = w;
+        frame_->height = h;
+        if (av_frame_get_buffer(frame_, 0) < 0)
+            return false;
+        sws_ = sws_getContext(w, h, AV_PIX_FMT_BGR24, w, h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!sws_)
+            return false;
+        if (log_level >= 1)
+            std::cout << "libav: pushing " << w << "x" << h << " " << codec->name << " to " << url << std::endl;
+        return true;
+    }
+
+    // `bgr`: w x h CV_8UC3 (any row stride); `pts_ms` must increase.
+    bool write(const cv::Mat &bgr, int64_t pts_ms)
+    {
+        if (av_frame_make_writable(frame_) < 0)
+            return false;
+        const uint8_t *src[1] = {bgr.data};
+        int stride[1] = {(int)bgr.step};
+        sws_scale(sws_, src, stride, 0, bgr.rows, frame_->data, frame_->linesize);
+        frame_->pts = pts_ms;
+        return encode(frame_);
+    }
+
+    void close()
+    {
+        if (header_written_)
+        {
+            if (enc_ && pkt_)
+                encode(nullptr); // drain the encoder
+            av_write_trailer(fmt_);
+            header_written_ = false;
+        }
+        if (fmt_ && fmt_->pb && !(fmt_->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&fmt_->pb);
+        if (sws_)
+            sws_freeContext(sws_);
+        sws_ = nullptr;
+        av_frame_free(&frame_);
+        av_packet_free(&pkt_);
+        avcodec_free_context(&enc_);
+        if (fmt_)
+            avformat_free_context(fmt_);
+        fmt_ = nullptr;
+        st_ = nullptr;
+    }
+
+private:
+    bool encode(AVFrame *frame)
+    {
+        if (avcodec_send_frame(enc_, frame) < 0)
+            return false;
+        int ret;
+        while ((ret = avcodec_receive_packet(enc_, pkt_)) == 0)
+        {
+            av_packet_rescale_ts(pkt_, enc_->time_base, st_->time_base);
+            pkt_->stream_index = st_->index;
+            if (av_interleaved_write_frame(fmt_, pkt_) < 0)
+                return false;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+
+    AVFormatContext *fmt_ = nullptr;
+    AVCodecContext *enc_ = nullptr;
+    AVStream *st_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *pkt_ = nullptr;
+    SwsContext *sws_ = nullptr;
+    bool header_written_ = false;
+};
+#endif
+
+// Fallback without libav: `ffmpeg` reads raw yuv420p on stdin at a constant rate.
+class FfmpegPipeMuxer
+{
+public:
+    ~FfmpegPipeMuxer() { close(); }
+
+    bool open(const std::string &url, int w, int h, double fps, int log_level)
+    {
+        char cmd[4096];
+        snprintf(cmd, sizeof(cmd), "ffmpeg -y -loglevel error -f rawvideo -pix_fmt yuv420p -s %dx%d -r %.2f -i - -c:v libx264 -preset veryfast -tune zerolatency -pix_fmt yuv420p %s\"%s\"",
+                 w, h, fps, is_rtmp_url(url) ? "-f flv " : "", url.c_str());
+        if (log_level >= 1)
+            std::cout << "Starting ffmpeg push: " << cmd << std::endl;
+        pipe_ = popen(cmd, "w");
+        if (!pipe_)
+            std::cerr << "Failed to start ffmpeg for rtmp push" << std::endl;
+        return pipe_ != nullptr;
+    }
+
+    bool write(const cv::Mat &bgr, int64_t pts_ms)
+    {
+        (void)pts_ms;
+        cv::cvtColor(bgr, yuv_, cv::COLOR_BGR2YUV_I420); // half the bytes of bgr24 through the pipe
+        size_t bytes = yuv_.total() * yuv_.elemSize();
+        return fwrite(yuv_.data, 1, bytes, pipe_) == bytes;
+    }
+
+    void close()
+    {
+        if (pipe_)
+            pclose(pipe_);
+        pipe_ = nullptr;
+    }
+
+private:
+    FILE *pipe_ = nullptr;
+    cv::Mat yuv_;
+};
+
+class StreamPusher
+{
+public:
+#if HELMET_WITH_LIBAV
+    using Muxer = LibavMuxer;
+#else
+    using Muxer = FfmpegPipeMuxer;
+#endif
+
+    // `fps`: nominal rate (encoder settings; the pipe fallback's constant rate).
+    // `max_queue`: frames waiting for the encoder before the oldest is dropped.
+    StreamPusher(std::string url, double fps, int log_level, size_t max_queue = 8, std::string tag = "")
+        : url_(std::move(url)), fps_(fps > 1.0 ? fps : 25.0), log_level_(log_level),
+          tag_(std::move(tag)), ring_(std::max<size_t>(1, max_queue))
+    {
+        thread_ = std::thread([this]
+                              { encoder_loop(); });
+    }
+
+    ~StreamPusher() { close(); }
+
+    StreamPusher(const StreamPusher &) = delete;
+    StreamPusher &operator=(const StreamPusher &) = delete;
+
+    // Queue `frame` (referenced, not copied: don't draw into it afterwards); never
+    // blocks on the encoder. `captured` is the frame's capture time, used for
+    // timestamps and the latency counters.
+    void push(const cv::Mat &frame, std::chrono::steady_clock::time_point captured)
+    {
+        if (frame.empty())
+            return;
+        std::unique_lock<std::mutex> lock(mu_);
+        if (stop_ || failed_)
+            return;
+        if (count_ == ring_.size())
+        {
+            ring_[head_].image.release(); // drop oldest
+            head_ = (head_ + 1) % ring_.size();
+            --count_;
+            ++dropped_;
+        }
+        Item &item = ring_[(head_ + count_) % ring_.size()];
+        item.image = frame;
+        item.captured = captured;
+        ++count_;
+        ++pushed_;
+        lock.unlock();
+        cv_.notify_one();
+    }
+
+    // Encode what is still queued, finish the stream and print the counters.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (stop_)
+                return;
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        if (log_level_ >= 1)
+            std::cout << tag_ << "Push " << url_ << ": " << sent_ << " frames sent, " << dropped_ << " dropped (queue full), "
+                      << "capture->sent latency avg " << latency_avg_ms() << " ms, max " << latency_max_ms_ << " ms"
+                      << (failed_ ? " [encoder failed]" : "") << std::endl;
+    }
+
+    // frames waiting for the encoder
+    size_t queued()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return count_;
+    }
+
+    // encode+send time of every frame (null: off); set before the first push()
+    void set_latency_histogram(LatencyHistogram *h) { hist_ = h; }
+
+    // counters; read them after close() (pushed / dropped also from the thread calling push())
+    uint64_t pushed() const { return pushed_; }
+    uint64_t sent() const { return sent_; }
+    uint64_t dropped() const { return dropped_; }
+    bool failed() const { return failed_; }
+    double latency_avg_ms() const { return sent_ ? latency_sum_ms_ / sent_ : 0.0; }
+    double latency_max_ms() const { return latency_max_ms_; }
+
+private:
+    struct Item
+    {
+        cv::Mat image;
+        std::chrono::steady_clock::time_point captured;
+    };
+
+    // drop everything queued (mu_ held)
+    void clear_queue()
+    {
+        for (; count_ > 0; --count_)
+        {
+            ring_[head_].image.release();
+            head_ = (head_ + 1) % ring_.size();
+        }
+    }
+
+    void encoder_loop()
+    {
+        Muxer muxer;
+        bool opened = false;
+        cv::Size size;
+        cv::Mat resized;
+        int64_t last_pts = -1;
+        std::chrono::steady_clock::time_point t0;
+        for (;;)
+        {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                cv_.wait(lock, [this]
+                         { return stop_ || count_ > 0; });
+                if (count_ == 0)
+                    break;
+                std::swap(item, ring_[head_]);
+                head_ = (head_ + 1) % ring_.size();
+                --count_;
+            }
+            if (!opened)
+            {
+                // 4:2:0 needs even dimensions
+                size = cv::Size(item.image.cols & ~1, item.image.rows & ~1);
+                t0 = item.captured;
+                if (!muxer.open(url_, size.width, size.height, fps_, log_level_))
+                {
+                    std::lock_guard<std::mutex> lock(mu_);
+                    failed_ = true;
+                    clear_queue();
+                    break;
+                }
+                opened = true;
+            }
+            cv::Mat src = item.image;
+            if (src.cols != size.width || src.rows != size.height)
+            {
+                if (src.cols - size.width <= 1 && src.rows - size.height <= 1 && src.cols >= size.width && src.rows >= size.height)
+                    src = item.image(cv::Rect(0, 0, size.width, size.height)); // drop the odd column/row
+                else
+                {
+                    cv::resize(item.image, resized, size); // resolution changed mid-stream
+                    src = resized;
+                }
+            }
+            int64_t pts = std::chrono::duration_cast<std::chrono::milliseconds>(item.captured - t0).count();
+            pts = std::max(pts, last_pts + 1);
+            last_pts = pts;
+            auto w0 = std::chrono::steady_clock::now();
+            bool ok = muxer.write(src, pts);
+            if (LatencyHistogram *h = hist_.load(std::memory_order_relaxed))
+                h->record(std::chrono::steady_clock::now() - w0);
+            src.release();
+            item.image.release(); // hand the buffer back (FramePool)
+            double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - item.captured).count();
+            std::lock_guard<std::mutex> lock(mu_);
+            if (!ok)
+            {
+                if (log_level_ >= 0)
+                    std::cerr << tag_ << "Push to " << url_ << " failed, stopping the stream" << std::endl;
+                failed_ = true;
+                clear_queue();
+                break;
+            }
+            ++sent_;
+            latency_sum_ms_ += latency;
+            latency_max_ms_ = std::max(latency_max_ms_, latency);
+        }
+        muxer.close();
+    }
+
+    std::string url_;
+    double fps_;
+    int log_level_;
+    std::string tag_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::vector<Item> ring_; // queued frames: count_ entries from head_
+    size_t head_ = 0, count_ = 0;
+    bool stop_ = false, failed_ = false;
+    uint64_t pushed_ = 0, sent_ = 0, dropped_ = 0;
+    double latency_sum_ms_ = 0.0, latency_max_ms_ = 0.0;
+    std::atomic<LatencyHistogram *> hist_{nullptr};
+    std::thread thread_;
+};
@@ -0,0 +1,264 @@
+#pragma once
+// Tiled (sliced) inference for small objects in high-resolution frames.
+//
+// Letterboxing a 4K drone frame into 640x640 shrinks it six times, and a head a
+// few dozen pixels across in the frame ends up below what the model can find.
+// With tiling, the frame is cut into overlapping tiles of about the model's
+// input size (so they go in at native resolution), optionally plus the usual
+// full-frame pass for large objects. All units of a frame go to the backend
+// together as one batch; their boxes are mapped back to frame coordinates,
+// merged by one NMS, and boxes cut in two by a tile edge are fused again.
+//
+// The layout (tile rectangles and one LetterboxPlan per tile size) depends only
+// on the frame size, so it is built once per resolution and shared.
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "detection.hpp"
+#include "letterbox.hpp"
+
+struct TileConfig
+{
+    bool enabled = false;
+    float overlap = 0.2f;    // fraction of a tile shared with its neighbour
+    bool full_frame = true;  // also run the whole frame letterboxed as usual
+    int max_tiles = 16;      // tiles grow beyond the model size to stay within this
+    float fuse_ios = 0.5f;   // cut boxes overlapping by this fraction of the smaller one are fused
+    int threads = -1;        // helpers letterboxing the tiles of one frame (-1: auto)
+};
+
+struct TileLayout
+{
+    struct Unit
+    {
+        int x = 0, y = 0, w = 0, h = 0; // source rectangle
+        int plan = 0;                   // index into `plans`
+    };
+
+    int src_w = 0, src_h = 0, input_w = 0, input_h = 0;
+    std::vector<Unit> units; // full frame (if enabled) first, then tiles row by row
+    std::vector<LetterboxPlan> plans; // one per distinct rectangle size
+
+    bool matches(int w, int h, int in_w, int in_h) const
+    {
+        return src_w == w && src_h == h && input_w == in_w && input_h == in_h;
+    }
+
+    const LetterboxPlan &plan(const Unit &u) const { return plans[u.plan]; }
+
+    // a box edge within `margin` of an inner tile edge was probably cut there
+    bool cut_at_edge(const Unit &u, float x1, float y1, float x2, float y2, float margin = 2.0f) const
+    {
+        return (u.x > 0 && x1 <= u.x + margin) || (u.y > 0 && y1 <= u.y + margin) ||
+               (u.x + u.w < src_w && x2 >= u.x + u.w - margin) || (u.y + u.h < src_h && y2 >= u.y + u.h - margin);
+    }
+};
+
+namespace tiling_detail
+{
+    // Tile origins along one axis: evenly spaced, first at 0 and last flush with the end.
+    inline std::vector<int> axis_origins(int len, int tile, float overlap)
+    {
+        if (len <= tile)
+            return {0};
+        double stride = tile * (1.0 - std::min(0.9f, std::max(0.0f, overlap)));
+        int n = (int)std::ceil((len - tile) / stride - 1e-9) + 1;
+        std::vector<int> o(n);
+        for (int i = 0; i < n; ++i)
+            o[i] = (int)std::lround((double)i * (len - tile) / (n - 1));
+        return o;
+    }
+}
+
+inline TileLayout make_tile_layout(int src_w, int src_h, int input_w, int input_h, const TileConfig &cfg)
+{
+    TileLayout l;
+    l.src_w = src_w;
+    l.src_h = src_h;
+    l.input_w = input_w;
+    l.input_h = input_h;
+    if (cfg.full_frame)
+        l.plans.push_back(make_letterbox_plan(src_w, src_h, input_w, input_h));
+
+    // tiles at model resolution; grown (same aspect) when there would be too many
+    double grow = 1.0;
+    int tw = 0, th = 0;
+    std::vector<int> xs, ys;
+    for (;;)
+    {
+        tw = std::min(src_w, (int)std::lround(input_w * grow));
+        th = std::min(src_h, (int)std::lround(input_h * grow));
+        xs = tiling_detail::axis_origins(src_w, tw, cfg.overlap);
+        ys = tiling_detail::axis_origins(src_h, th, cfg.overlap);
+        if (cfg.max_tiles <= 0 || (int)(xs.size() * ys.size()) <= cfg.max_tiles || (tw == src_w && th == src_h))
+            break;
+        grow *= 1.1;
+    }
+    // a frame that fits in one tile gains nothing from tiling
+    bool tiled = xs.size() * ys.size() > 1;
+    if (tiled)
+        l.plans.push_back(make_letterbox_plan(tw, th, input_w, input_h));
+    if (l.plans.empty())
+        l.plans.push_back(make_letterbox_plan(src_w, src_h, input_w, input_h));
+
+    if (cfg.full_frame || !tiled)
+        l.units.push_back(TileLayout::Unit{0, 0, src_w, src_h, 0});
+    if (tiled)
+        for (int y : ys)
+            for (int x : xs)
+                l.units.push_back(TileLayout::Unit{x, y, tw, th, (int)l.plans.size() - 1});
+    return l;
+}
+
+// Fuses boxes of one object that a tile edge cut in two (NMS keeps both halves:
+// they barely overlap by IoU). Two boxes of the same class are fused into their
+// union when at least one of them touches an inner tile edge (`cut`, parallel to
+// `dets`) and their intersection covers `min_ios` of the smaller box.
+// Works in place (fused boxes are marked 2 in `cut` until compacted).
+inline void fuse_tile_boxes(std::vector<Detection> &dets, std::vector<char> &cut, float min_ios)
+{
+    if (dets.size() < 2 || min_ios <= 0.0f)
+        return;
+    const char kGone = 2;
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < dets.size(); ++i)
+        {
+            if (cut[i] == kGone)
+                continue;
+            for (size_t j = i + 1; j < dets.size(); ++j)
+            {
+                Detection &a = dets[i], &b = dets[j];
+                if (cut[j] == kGone || a.class_id != b.class_id || !(cut[i] || cut[j]))
+                    continue;
+                float iw = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+                float ih = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+                if (iw <= 0.0f || ih <= 0.0f)
+                    continue;
+                float smaller = std::min((a.x2 - a.x1) * (a.y2 - a.y1), (b.x2 - b.x1) * (b.y2 - b.y1));
+                if (smaller <= 0.0f || iw * ih < min_ios * smaller)
+                    continue;
+                a.x1 = std::min(a.x1, b.x1);
+                a.y1 = std::min(a.y1, b.y1);
+                a.x2 = std::max(a.x2, b.x2);
+                a.y2 = std::max(a.y2, b.y2);
+                a.score = std::max(a.score, b.score);
+                cut[i] = cut[i] && cut[j];
+                cut[j] = kGone;
+                merged = true;
+            }
+        }
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < dets.size(); ++i)
+        if (cut[i] != kGone)
+        {
+            dets[n] = dets[i];
+            cut[n++] = cut[i];
+        }
+    dets.resize(n);
+    cut.resize(n);
+}
+
+// Fork-join helpers for the tiles of one frame. The calling preprocess worker
+// takes part; if another worker is already using the helpers, it letterboxes
+// its tiles alone rather than wait.
+class TileWorkers
+{
+public:
+    using Job = std::function<void(int unit, LetterboxScratch &scratch)>;
+
+    explicit TileWorkers(int helpers)
+    {
+        for (int i = 0; i < helpers; ++i)
+            threads_.emplace_back([this]
+                                  { loop(); });
+    }
+
+    ~TileWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        work_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+    }
+
+    TileWorkers(const TileWorkers &) = delete;
+    TileWorkers &operator=(const TileWorkers &) = delete;
+
+    // Runs job(i) for i in [0, n) and returns when all are done.
+    void run(int n, const Job &job, LetterboxScratch &scratch)
+    {
+        std::unique_lock<std::mutex> owner(owner_, std::try_to_lock);
+        if (threads_.empty() || n < 2 || !owner.owns_lock())
+        {
+            for (int i = 0; i < n; ++i)
+                job(i, scratch);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            job_ = &job;
+            count_ = n;
+            next_ = 0;
+            done_ = 0;
+        }
+        work_.notify_all();
+        work(scratch);
+        std::unique_lock<std::mutex> lock(mu_);
+        finished_.wait(lock, [this]
+                       { return done_ == count_; });
+        job_ = nullptr;
+    }
+
+private:
+    // claims and runs units of the current job until none are left
+    void work(LetterboxScratch &scratch)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (job_ && next_ < count_)
+        {
+            int i = next_++;
+            const Job *job = job_;
+            lock.unlock();
+            (*job)(i, scratch);
+            lock.lock();
+            if (++done_ == count_)
+                finished_.notify_all();
+        }
+    }
+
+    void loop()
+    {
+        LetterboxScratch scratch;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                work_.wait(lock, [this]
+                           { return stop_ || (job_ && next_ < count_); });
+                if (stop_)
+                    return;
+            }
+            work(scratch);
+        }
+    }
+
+    std::mutex owner_; // held by the preprocess worker whose job is running
+    std::mutex mu_;
+    std::condition_variable work_, finished_;
+    const Job *job_ = nullptr;
+    int count_ = 0, next_ = 0, done_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,259 @@
+#pragma once
+// Multi-object tracker that carries boxes across the frames between detections.
+//
+// ByteTrack-style: every track has a constant-velocity Kalman filter over box
+// centre and size. On a detection frame the high-score detections are matched
+// to all live tracks first, then the low-score ones to the tracks still
+// unmatched, which keeps occluded or blurred objects without starting tracks
+// from noise. Matching is greedy by IoU within a class. On a detection frame
+// the detections themselves are reported, tagged with the id of the track
+// they matched; on frames without detection the tracks are only predicted, so
+// boxes follow moving objects instead of freezing, and each object keeps a
+// stable track id.
+//
+// The motion model and the noise are independent per axis (as in SORT/ByteTrack),
+// so the 8-state filter splits exactly into four [position, velocity] filters.
+// Storage is reserved up front; predict()/update() do not allocate once warm.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "detection.hpp"
+
+struct TrackerConfig
+{
+    float high_thresh = 0.4f;  // detections at or above this take part in the first round and may start tracks
+    float match_iou = 0.3f;    // minimum IoU in the first round
+    float low_match_iou = 0.5f; // minimum IoU for low-score detections (second round)
+    int max_misses = 3;        // detection rounds a track may go unmatched before it is dropped
+    int max_tracks = 256;
+};
+
+namespace tracker_detail
+{
+    // Kalman filter of one coordinate: state [x, v], unit time step.
+    struct Axis
+    {
+        float x = 0, v = 0, pxx = 0, pxv = 0, pvv = 0;
+
+        void init(float z, float sd_pos, float sd_vel)
+        {
+            x = z;
+            v = 0;
+            pxx = sd_pos * sd_pos;
+            pxv = 0;
+            pvv = sd_vel * sd_vel;
+        }
+
+        void predict(float q_pos, float q_vel)
+        {
+            x += v;
+            pxx += 2 * pxv + pvv + q_pos;
+            pxv += pvv;
+            pvv += q_vel;
+        }
+
+        void update(float z, float r)
+        {
+            float s = pxx + r;
+            float kx = pxx / s, kv = pxv / s;
+            float y = z - x;
+            x += kx * y;
+            v += kv * y;
+            float pxv0 = pxv;
+            pxx -= kx * pxx;
+            pxv -= kx * pxv0;
+            pvv -= kv * pxv0;
+        }
+    };
+
+    // noise relative to box size, as in ByteTrack
+    constexpr float kStdPos = 1.0f / 20, kStdVel = 1.0f / 160;
+
+    inline float iou(const Detection &a, const Detection &b)
+    {
+        float iw = std::max(0.0f, std::min(a.x2, b.x2) - std::max(a.x1, b.x1));
+        float ih = std::max(0.0f, std::min(a.y2, b.y2) - std::max(a.y1, b.y1));
+        float inter = iw * ih;
+        float ua = (a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - inter;
+        return ua > 0 ? inter / ua : 0.0f;
+    }
+} // namespace tracker_detail
+
+class ObjectTracker
+{
+public:
+    explicit ObjectTracker(const TrackerConfig &cfg = TrackerConfig()) : cfg_(cfg)
+    {
+        tracks_.reserve(cfg_.max_tracks);
+        det_used_.reserve(256);
+        pairs_.reserve(1024);
+    }
+
+    // Advance one frame without detections.
+    void predict()
+    {
+        for (Track &t : tracks_)
+            predict_track(t);
+    }
+
+    // Advance one frame and correct with this frame's detections. Each detection
+    // gets the id of its track (-1 for low-score detections no track matched).
+    void update(std::vector<Detection> &dets)
+    {
+        predict();
+        for (Track &t : tracks_)
+            t.matched = false;
+        det_used_.assign(dets.size(), 0);
+        for (Detection &d : dets)
+            d.track_id = -1;
+
+        // 1) high-score detections against every live track
+        match(dets, true, cfg_.match_iou, false);
+        // 2) low-score detections against tracks that were seen last round
+        match(dets, false, cfg_.low_match_iou, true);
+
+        // unmatched tracks age; unmatched high-score detections start tracks
+        size_t keep = 0;
+        for (size_t i = 0; i < tracks_.size(); ++i)
+        {
+            Track &t = tracks_[i];
+            if (!t.matched && ++t.misses > cfg_.max_misses)
+                continue;
+            tracks_[keep++] = t;
+        }
+        tracks_.resize(keep);
+        for (size_t d = 0; d < dets.size(); ++d)
+        {
+            if (det_used_[d] || dets[d].score < cfg_.high_thresh || (int)tracks_.size() >= cfg_.max_tracks)
+                continue;
+            Detection &det = dets[d];
+            Track t;
+            t.id = next_id_++;
+            det.track_id = t.id;
+            float cx = 0.5f * (det.x1 + det.x2), cy = 0.5f * (det.y1 + det.y2);
+            float w = det.x2 - det.x1, h = det.y2 - det.y1;
+            t.axis[0].init(cx, 2 * tracker_detail::kStdPos * w, 10 * tracker_detail::kStdVel * w);
+            t.axis[1].init(cy, 2 * tracker_detail::kStdPos * h, 10 * tracker_detail::kStdVel * h);
+            t.axis[2].init(w, 2 * tracker_detail::kStdPos * w, 10 * tracker_detail::kStdVel * w);
+            t.axis[3].init(h, 2 * tracker_detail::kStdPos * h, 10 * tracker_detail::kStdVel * h);
+            t.class_id = det.class_id;
+            t.score = det.score;
+            t.matched = true;
+            tracks_.push_back(t);
+        }
+    }
+
+    // Boxes of all live tracks at their predicted position, for the frames between
+    // detections; a track missed by the last few detections is still shown.
+    void active(std::vector<Detection> &out) const
+    {
+        out.clear();
+        for (const Track &t : tracks_)
+            out.push_back(box(t));
+    }
+
+    // Largest position standard deviation of the tracks matched at the last update,
+    // relative to box size; grows with every frame predicted without a detection.
+    float uncertainty() const
+    {
+        float u = 0.0f;
+        for (const Track &t : tracks_)
+        {
+            if (t.misses != 0)
+                continue;
+            u = std::max(u, std::sqrt(t.axis[0].pxx) / std::max(1.0f, t.axis[2].x));
+            u = std::max(u, std::sqrt(t.axis[1].pxx) / std::max(1.0f, t.axis[3].x));
+        }
+        return u;
+    }
+
+    size_t size() const { return tracks_.size(); }
+
+private:
+    struct Track
+    {
+        tracker_detail::Axis axis[4]; // cx, cy, w, h
+        int id = 0, class_id = 0, misses = 0;
+        float score = 0;
+        bool matched = false;
+    };
+
+    struct Pair
+    {
+        float iou;
+        int track, det;
+    };
+
+    static Detection box(const Track &t)
+    {
+        float cx = t.axis[0].x, cy = t.axis[1].x;
+        float w = std::max(1.0f, t.axis[2].x), h = std::max(1.0f, t.axis[3].x);
+        Detection d{cx - 0.5f * w, cy - 0.5f * h, cx + 0.5f * w, cy + 0.5f * h, t.score, t.class_id};
+        d.track_id = t.id;
+        return d;
+    }
+
+    static void predict_track(Track &t)
+    {
+        using tracker_detail::kStdPos;
+        using tracker_detail::kStdVel;
+        float w = std::max(1.0f, t.axis[2].x), h = std::max(1.0f, t.axis[3].x);
+        for (int k = 0; k < 4; ++k)
+        {
+            float s = (k % 2 == 0) ? w : h;
+            t.axis[k].predict(kStdPos * kStdPos * s * s, kStdVel * kStdVel * s * s);
+        }
+    }
+
+    // Greedy assignment by descending IoU between unmatched tracks and unused
+    // detections of the same class on one side of high_thresh.
+    void match(std::vector<Detection> &dets, bool high, float min_iou, bool recent_only)
+    {
+        pairs_.clear();
+        for (size_t ti = 0; ti < tracks_.size(); ++ti)
+        {
+            const Track &t = tracks_[ti];
+            if (t.matched || (recent_only && t.misses > 0))
+                continue;
+            Detection tb = box(t);
+            for (size_t d = 0; d < dets.size(); ++d)
+            {
+                const Detection &det = dets[d];
+                if (det_used_[d] || det.class_id != t.class_id || (det.score >= cfg_.high_thresh) != high)
+                    continue;
+                float v = tracker_detail::iou(tb, det);
+                if (v >= min_iou)
+                    pairs_.push_back(Pair{v, (int)ti, (int)d});
+            }
+        }
+        std::sort(pairs_.begin(), pairs_.end(), [](const Pair &a, const Pair &b)
+                  { return a.iou > b.iou || (a.iou == b.iou && (a.track < b.track || (a.track == b.track && a.det < b.det))); });
+        for (const Pair &p : pairs_)
+        {
+            Track &t = tracks_[p.track];
+            if (t.matched || det_used_[p.det])
+                continue;
+            Detection &det = dets[p.det];
+            det.track_id = t.id;
+            float cx = 0.5f * (det.x1 + det.x2), cy = 0.5f * (det.y1 + det.y2);
+            float w = det.x2 - det.x1, h = det.y2 - det.y1;
+            float rw = tracker_detail::kStdPos * w, rh = tracker_detail::kStdPos * h;
+            t.axis[0].update(cx, rw * rw);
+            t.axis[1].update(cy, rh * rh);
+            t.axis[2].update(w, rw * rw);
+            t.axis[3].update(h, rh * rh);
+            t.score = det.score;
+            t.misses = 0;
+            t.matched = true;
+            det_used_[p.det] = 1;
+        }
+    }
+
+    TrackerConfig cfg_;
+    std::vector<Track> tracks_;
+    std::vector<uint8_t> det_used_;
+    std::vector<Pair> pairs_;
+    int next_id_ = 1;
+};
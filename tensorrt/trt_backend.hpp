@@ -0,0 +1,365 @@
+#pragma once
+// TensorRT implementation of InferenceBackend: enqueueV3 on per-slot CUDA streams
+// with IO bound once via setTensorAddress (needs TensorRT >= 8.5).
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "NvInfer.h"
+#include "cuda_runtime_api.h"
+
+#include "inference_backend.hpp"
+
+class Logger : public nvinfer1::ILogger
+{
+public:
+    void log(Severity severity, const char *msg) noexcept override
+    {
+        if (severity <= Severity::kWARNING)
+            std::cout << "[TensorRT] " << msg << std::endl;
+    }
+};
+
+inline Logger gLogger;
+
+// What a cached engine depends on besides the ONNX file and the build options.
+inline std::string trt_engine_context()
+{
+    std::string ctx = "trt " + std::to_string(getInferLibVersion());
+    int dev = 0;
+    cudaDeviceProp prop;
+    if (cudaGetDevice(&dev) == cudaSuccess && cudaGetDeviceProperties(&prop, dev) == cudaSuccess)
+        ctx += std::string(" ") + prop.name + " sm" + std::to_string(prop.major) + std::to_string(prop.minor);
+    return ctx;
+}
+
+class TrtBackend : public InferenceBackend
+{
+public:
+    ~TrtBackend() override
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.stream)
+                cudaStreamSynchronize(slot.stream);
+            for (void *b : slot.buffers)
+                if (b)
+                    cudaFree(b);
+            if (slot.done)
+                cudaEventDestroy(slot.done);
+            if (slot.stream)
+                cudaStreamDestroy(slot.stream);
+            delete slot.context;
+        }
+        delete engine_;
+        delete runtime_;
+    }
+
+    // Deserialize the engine (an .onnx goes through the engine cache first); then per
+    // async slot create an execution context, a CUDA stream and device IO buffers,
+    // and bind the buffers once with setTensorAddress.
+    int load(const BackendConfig &cfg) override
+    {
+        using namespace nvinfer1;
+        std::string engineFile = cfg.model_path;
+        const int input_w = cfg.input_w, input_h = cfg.input_h, log_level = cfg.log_level;
+        std::string error;
+        if (std::filesystem::path(engineFile).extension() == ".onnx")
+        {
+            if (cfg.engine_cache_dir.empty())
+            {
+                std::cerr << "An .onnx model needs the engine cache (--engine-cache DIR), or build an engine with onnx_to_trt.sh\n";
+                return 4;
+            }
+            std::string build_args = cfg.engine_build_args;
+            if (cfg.max_batch > 1)
+            {
+                // dynamic-batch profile for ONNX exported with --dynamic (trtexec ignores it for static models)
+                std::string chw = "x3x" + std::to_string(input_h) + "x" + std::to_string(input_w);
+                build_args += " --minShapes=images:1" + chw + " --optShapes=images:" + std::to_string(cfg.max_batch) + chw +
+                              " --maxShapes=images:" + std::to_string(cfg.max_batch) + chw;
+            }
+            EngineCache cache(cfg.engine_cache_dir);
+            engineFile = cache.resolve(engineFile, build_args, trt_engine_context(), log_level, startup_, error);
+            if (engineFile.empty())
+            {
+                std::cerr << error << std::endl;
+                return 4;
+            }
+        }
+
+        auto t0 = StartupTimes::clock::now();
+        MappedFile engine_data;
+        if (!engine_data.open(engineFile, error))
+        {
+            std::cerr << error << std::endl;
+            return 4;
+        }
+        startup_.add("map", t0);
+        startup_.note(engine_data.mapped() ? "mmap" : "read");
+        t0 = StartupTimes::clock::now();
+        runtime_ = createInferRuntime(gLogger);
+        if (!runtime_)
+        {
+            std::cerr << "Failed to create TensorRT runtime\n";
+            return 3;
+        }
+        startup_.add("runtime", t0);
+        t0 = StartupTimes::clock::now();
+        engine_ = runtime_->deserializeCudaEngine(engine_data.data(), engine_data.size());
+        if (!engine_)
+        {
+            std::cerr << "Failed to deserialize engine: " << engineFile << "\n";
+            return 4;
+        }
+        engine_data.close(); // the engine holds its own copy
+        startup_.add("deserialize", t0);
+        t0 = StartupTimes::clock::now();
+
+        int nbIO = engine_->getNbIOTensors();
+        for (int i = 0; i < nbIO; ++i)
+        {
+            const char *name = engine_->getIOTensorName(i);
+            if (!name)
+                continue;
+            TensorIOMode mode = engine_->getTensorIOMode(name);
+            if (mode == TensorIOMode::kINPUT)
+                inputIndex_ = i;
+            if (log_level >= 1)
+                std::cout << "IO[" << i << "] name='" << name << "' mode=" << (mode == TensorIOMode::kINPUT ? "INPUT" : "OUTPUT") << std::endl;
+        }
+        if (inputIndex_ < 0)
+        {
+            std::cerr << "No input IO found\n";
+            return 6;
+        }
+
+        // batch size: a dynamic leading dim (-1) takes its maximum from the optimization
+        // profiles, capped by --max-batch; a static leading dim > 1 is always run full.
+        // Contexts running concurrently need their own profile, so a dynamic engine gets
+        // at most one async slot per profile.
+        int nslots = std::max(1, cfg.async_slots);
+        inputName_ = engine_->getIOTensorName(inputIndex_);
+        inputShape_ = engine_->getTensorShape(inputName_);
+        if (inputShape_.nbDims == 4)
+        {
+            if (inputShape_.d[0] < 0)
+            {
+                dynamicBatch_ = true;
+                nslots = std::min(nslots, std::max(1, engine_->getNbOptimizationProfiles()));
+                int profile_max = INT32_MAX;
+                for (int k = 0; k < nslots; ++k)
+                {
+                    Dims maxShape = engine_->getProfileShape(inputName_, k, OptProfileSelector::kMAX);
+                    profile_max = std::min(profile_max, maxShape.nbDims == 4 ? (int)maxShape.d[0] : 1);
+                }
+                maxBatch_ = std::max(1, std::min(cfg.max_batch, profile_max));
+                inputShape_.d[0] = maxBatch_;
+            }
+            else
+                maxBatch_ = std::max<int>(1, (int)inputShape_.d[0]);
+            inputShape_.d[1] = 3;
+            inputShape_.d[2] = input_h;
+            inputShape_.d[3] = input_w;
+        }
+        if (log_level >= 1)
+            std::cout << "Engine batch: " << (dynamicBatch_ ? "dynamic" : "static") << ", max " << maxBatch_
+                      << "; async slots: " << nslots << std::endl;
+        input_elems_ = 3 * (size_t)input_w * input_h;
+
+        // find combined output index if available
+        const char *combinedName = nullptr;
+        for (int i = 0; i < nbIO; ++i)
+        {
+            const char *nm = engine_->getIOTensorName(i);
+            if (nm && std::string(nm) == "output")
+            {
+                outputIndex_ = i;
+                combinedName = nm;
+                break;
+            }
+        }
+        if (outputIndex_ >= 0)
+        {
+            if (log_level >= 1)
+                std::cout << "Using combined output: '" << combinedName << "' (IO index=" << outputIndex_ << ")\n";
+            // combined output shape is fixed for the engine: [1, C, L] or [C, L]
+            Dims combShape = engine_->getTensorShape(combinedName);
+            if (combShape.nbDims == 3)
+            {
+                out_C_ = combShape.d[1];
+                out_L_ = combShape.d[2];
+            }
+            else if (combShape.nbDims == 2)
+            {
+                out_C_ = combShape.d[0];
+                out_L_ = combShape.d[1];
+            }
+            if (out_C_ <= 4 || out_L_ <= 0)
+                out_C_ = out_L_ = 0;
+        }
+
+        slots_.resize(nslots);
+        for (int k = 0; k < nslots; ++k)
+        {
+            Slot &slot = slots_[k];
+            slot.context = engine_->createExecutionContext();
+            if (!slot.context)
+            {
+                std::cerr << "Failed to create execution context\n";
+                return 5;
+            }
+            if (cudaStreamCreateWithFlags(&slot.stream, cudaStreamNonBlocking) != cudaSuccess ||
+                cudaEventCreateWithFlags(&slot.done, cudaEventDisableTiming) != cudaSuccess)
+            {
+                std::cerr << "Failed to create CUDA stream/event\n";
+                return 5;
+            }
+            if (dynamicBatch_ && k > 0)
+                slot.context->setOptimizationProfileAsync(k, slot.stream);
+
+            // allocate buffers (dynamic dims: batch -> maxBatch_, input H/W -> input_h/input_w)
+            slot.buffers.assign(nbIO, nullptr);
+            for (int i = 0; i < nbIO; ++i)
+            {
+                const char *name = engine_->getIOTensorName(i);
+                if (!name)
+                    continue;
+                Dims shape = engine_->getTensorShape(name);
+                int64_t elem = 1;
+                if (i == inputIndex_)
+                    elem = 3LL * input_w * input_h * maxBatch_;
+                else if (shape.nbDims > 0)
+                {
+                    for (int d = 0; d < shape.nbDims; ++d)
+                    {
+                        int64_t dim = shape.d[d];
+                        if (dim <= 0 && d == 0)
+                            dim = maxBatch_;
+                        if (dim <= 0)
+                        {
+                            elem = 100000LL * maxBatch_;
+                            break;
+                        }
+                        elem *= dim;
+                    }
+                }
+                else
+                    elem = 100000LL * maxBatch_;
+                int32_t bpc = engine_->getTensorBytesPerComponent(name);
+                if (bpc <= 0)
+                    bpc = 4;
+                size_t bytes = static_cast<size_t>(elem) * static_cast<size_t>(bpc);
+                cudaError_t cerr = cudaMalloc(&slot.buffers[i], bytes);
+                if (cerr != cudaSuccess)
+                {
+                    std::cerr << "cudaMalloc failed for " << name << " bytes=" << bytes << " " << cudaGetErrorString(cerr) << std::endl;
+                    return 7;
+                }
+                if (!slot.context->setTensorAddress(name, slot.buffers[i]))
+                {
+                    std::cerr << "setTensorAddress failed for " << name << std::endl;
+                    return 7;
+                }
+                if (log_level >= 1)
+                    std::cout << "Allocated IO[" << i << "] '" << name << "' bytes=" << bytes << " (slot " << k << ")" << std::endl;
+            }
+        }
+        startup_.add("contexts", t0);
+        return 0;
+    }
+
+    const char *name() const override { return "tensorrt"; }
+    int output_channels() const override { return out_C_; }
+    int output_anchors() const override { return out_L_; }
+    int max_batch() const override { return maxBatch_; }
+    int async_slots() const override { return (int)slots_.size(); }
+
+    float *alloc_host(size_t elems) override
+    {
+        float *p = nullptr;
+        if (cudaMallocHost((void **)&p, elems * sizeof(float)) != cudaSuccess)
+            return nullptr;
+        return p;
+    }
+    void free_host(float *p) override { cudaFreeHost(p); }
+
+    bool infer(const float *input, float *output) override
+    {
+        return infer_batch(&input, &output, 1);
+    }
+
+    // Synchronous call on slot 0; not to be mixed with submissions in flight.
+    bool infer_batch(const float *const *inputs, float *const *outputs, int n) override
+    {
+        return submit(0, inputs, outputs, n) && wait(0);
+    }
+
+    // Frames are copied (from pinned host memory, asynchronously) into consecutive
+    // slots of the slot's device NCHW input, the engine is enqueued on the slot's
+    // stream and the per-frame output slices are copied back, all without blocking.
+    bool submit(int k, const float *const *inputs, float *const *outputs, int n) override
+    {
+        if (k < 0 || k >= (int)slots_.size() || n <= 0 || n > maxBatch_)
+            return false;
+        Slot &slot = slots_[k];
+        float *dev_in = static_cast<float *>(slot.buffers[inputIndex_]);
+        for (int i = 0; i < n; ++i)
+            cudaMemcpyAsync(dev_in + i * input_elems_, inputs[i], input_elems_ * sizeof(float), cudaMemcpyHostToDevice, slot.stream);
+        if (dynamicBatch_)
+        {
+            nvinfer1::Dims shape = inputShape_;
+            shape.d[0] = n;
+            if (!slot.context->setInputShape(inputName_, shape))
+                return false;
+        }
+        // a static batch engine always runs all slots; outputs of unused ones are ignored
+        if (!slot.context->enqueueV3(slot.stream))
+            return false;
+        if (outputIndex_ >= 0 && out_C_ > 0)
+        {
+            const size_t out_elems = (size_t)out_C_ * out_L_;
+            const float *dev_out = static_cast<const float *>(slot.buffers[outputIndex_]);
+            for (int i = 0; i < n; ++i)
+                cudaMemcpyAsync(outputs[i], dev_out + i * out_elems, out_elems * sizeof(float), cudaMemcpyDeviceToHost, slot.stream);
+        }
+        return cudaEventRecord(slot.done, slot.stream) == cudaSuccess;
+    }
+
+    bool wait(int k) override
+    {
+        if (k < 0 || k >= (int)slots_.size())
+            return false;
+        cudaError_t err = cudaEventSynchronize(slots_[k].done);
+        if (err != cudaSuccess)
+        {
+            std::cerr << "CUDA error in inference slot " << k << ": " << cudaGetErrorString(err) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        nvinfer1::IExecutionContext *context = nullptr;
+        cudaStream_t stream = nullptr;
+        cudaEvent_t done = nullptr;
+        std::vector<void *> buffers; // device IO, bound to `context`
+    };
+
+    nvinfer1::IRuntime *runtime_ = nullptr;
+    nvinfer1::ICudaEngine *engine_ = nullptr;
+    std::vector<Slot> slots_;
+    int inputIndex_ = -1, outputIndex_ = -1;
+    const char *inputName_ = nullptr;
+    nvinfer1::Dims inputShape_{};
+    bool dynamicBatch_ = false;
+    int maxBatch_ = 1;
+    int out_C_ = 0, out_L_ = 0;
+    size_t input_elems_ = 0;
+};
@@ -0,0 +1,1883 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+
+#include "alarm.hpp"
+#include "annotate.hpp"
+#include "bench_data.hpp"
+#include "detection_log.hpp"
+#include "frame_pool.hpp"
+#include "frame_sink.hpp"
+#include "image_source.hpp"
+#include "infer_daemon.hpp"
+#include "inference_backend.hpp"
+#include "letterbox.hpp"
+#include "metrics.hpp"
+#include "model_file.hpp"
+#include "nms.hpp"
+#include "pipeline.hpp"
+#include "result_sink.hpp"
+#include "scheduler.hpp"
+#include "stream_push.hpp"
+#include "tiling.hpp"
+#include "tracker.hpp"
+#include "yolo_decoder.hpp"
+
+// CPU micro-benchmarks for the pre/post-processing kernels used by trt_batch_infer.
+// Each benchmark also checks the new kernel against the legacy code it replaced.
+
+// Heap allocation counter for `trt_bench alloc`: malloc and friends forward to
+// glibc and count while counting is on (operator new and OpenCV's fastMalloc both
+// end up here). Left out under sanitizers, which replace malloc themselves.
+#if defined(__GLIBC__) && !defined(__SANITIZE_THREAD__) && !defined(__SANITIZE_ADDRESS__)
+#define HELMET_COUNT_ALLOCS 1
+#include <cerrno>
+#include <atomic>
+static std::atomic<bool> g_count_allocs{false};
+static std::atomic<uint64_t> g_allocs{0};
+static inline void count_alloc()
+{
+    if (g_count_allocs.load(std::memory_order_relaxed))
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+}
+extern "C"
+{
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void *__libc_memalign(size_t, size_t);
+    void *malloc(size_t n)
+    {
+        count_alloc();
+        return __libc_malloc(n);
+    }
+    void *calloc(size_t n, size_t size)
+    {
+        count_alloc();
+        return __libc_calloc(n, size);
+    }
+    void *realloc(void *p, size_t n)
+    {
+        count_alloc();
+        return __libc_realloc(p, n);
+    }
+    void *memalign(size_t align, size_t n)
+    {
+        count_alloc();
+        return __libc_memalign(align, n);
+    }
+    void *aligned_alloc(size_t align, size_t n)
+    {
+        count_alloc();
+        return __libc_memalign(align, n);
+    }
+    int posix_memalign(void **out, size_t align, size_t n)
+    {
+        count_alloc();
+        void *p = __libc_memalign(align, n);
+        if (!p)
+            return ENOMEM;
+        *out = p;
+        return 0;
+    }
+}
+#else
+#define HELMET_COUNT_ALLOCS 0
+#endif
+
+static double time_ms(const std::function<void()> &fn, int iters)
+{
+    fn(); // warm-up
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; ++i)
+        fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / iters;
+}
+
+// legacy path of trt_batch_infer: preprocess() + cv::split + memcpy
+static cv::Mat legacy_preprocess(const cv::Mat &img, int input_w, int input_h)
+{
+    int orig_w = img.cols, orig_h = img.rows;
+    float r = std::min((float)input_w / orig_w, (float)input_h / orig_h);
+    int new_w = (int)std::round(orig_w * r);
+    int new_h = (int)std::round(orig_h * r);
+    cv::Mat resized;
+    cv::cvtColor(img, resized, cv::COLOR_BGR2RGB);
+    cv::resize(resized, resized, cv::Size(new_w, new_h));
+    int dw = input_w - new_w;
+    int dh = input_h - new_h;
+    int top = dh / 2;
+    int bottom = dh - top;
+    int left = dw / 2;
+    int right = dw - left;
+    cv::Mat padded;
+    cv::copyMakeBorder(resized, padded, top, bottom, left, right, cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
+    padded.convertTo(padded, CV_32F, 1.0 / 255.0);
+    return padded;
+}
+
+static void legacy_to_planar(const cv::Mat &frame, int input_w, int input_h, std::vector<float> &hostInput)
+{
+    cv::Mat in = legacy_preprocess(frame, input_w, input_h);
+    size_t hw = (size_t)input_w * input_h;
+    std::vector<cv::Mat> chs;
+    cv::split(in, chs);
+    hostInput.assign(3 * hw, 0.0f);
+    for (int c = 0; c < 3; ++c)
+        memcpy(hostInput.data() + c * hw, chs[c].data, hw * sizeof(float));
+}
+
+static int bench_preprocess(int argc, char **argv)
+{
+    // trt_bench preprocess [image|WxH] [input_w] [input_h] [iters]
+    std::string src = argc > 2 ? argv[2] : "1920x1080";
+    int input_w = argc > 3 ? std::stoi(argv[3]) : 640;
+    int input_h = argc > 4 ? std::stoi(argv[4]) : 640;
+    int iters = argc > 5 ? std::stoi(argv[5]) : 200;
+
+    cv::Mat frame;
+    int sw = 0, sh = 0;
+    if (sscanf(src.c_str(), "%dx%d", &sw, &sh) == 2)
+        frame = synthetic_frame(sw, sh);
+    else
+        frame = cv::imread(src);
+    if (frame.empty())
+    {
+        std::cerr << "Failed to load " << src << std::endl;
+        return 2;
+    }
+
+    std::vector<float> legacy;
+    legacy_to_planar(frame, input_w, input_h, legacy);
+
+    LetterboxPlan plan = make_letterbox_plan(frame.cols, frame.rows, input_w, input_h);
+    LetterboxScratch scratch;
+    std::vector<float> fused(legacy.size());
+    letterbox_bgr_to_planar(frame.data, frame.step, plan, scratch, fused.data());
+
+    size_t mismatches = 0;
+    float max_diff = 0.0f;
+    for (size_t i = 0; i < legacy.size(); ++i)
+    {
+        if (std::memcmp(&legacy[i], &fused[i], sizeof(float)) != 0)
+            mismatches++;
+        max_diff = std::max(max_diff, std::fabs(legacy[i] - fused[i]));
+    }
+
+    double t_legacy = time_ms([&]
+                              { legacy_to_planar(frame, input_w, input_h, legacy); },
+                              iters);
+    double t_fused = time_ms([&]
+                             { letterbox_bgr_to_planar(frame.data, frame.step, plan, scratch, fused.data()); },
+                             iters);
+
+    std::cout << "preprocess " << frame.cols << "x" << frame.rows << " -> " << input_w << "x" << input_h
+              << " iters=" << iters << std::endl;
+    std::cout << "  legacy (preprocess+split+memcpy): " << t_legacy << " ms/frame" << std::endl;
+    std::cout << "  fused letterbox:                  " << t_fused << " ms/frame" << std::endl;
+    std::cout << "  speedup: " << t_legacy / std::max(1e-9, t_fused) << "x" << std::endl;
+    // allowed: the tail pixels of each row that cv::resize finishes with its scalar
+    // formula (up to one vector of the horizontal and of the vertical pass), and
+    // with IPP, which rounds differently, any value; never more than 1/255
+    size_t tail_allowance = (size_t)plan.new_h * 2 * 16 * 3;
+    bool ipp = cv::ipp::useIPP();
+    bool ok = max_diff <= 1.0f / 255.0f + 1e-6f && (ipp || mismatches <= tail_allowance);
+    std::cout << "  mismatching values: " << mismatches << " / " << legacy.size()
+              << " (max abs diff " << max_diff << ", allowed " << (ipp ? std::string("any with IPP") : std::to_string(tail_allowance))
+              << " within 1/255): " << (ok ? "ok" : "MISMATCH") << std::endl;
+    return ok ? 0 : 3;
+}
+
+// legacy decode loop of trt_batch_infer: per-anchor column walk, letterbox params recomputed per anchor
+static void legacy_decode(const std::vector<float> &hostOutput, int C, int L, int orig_w, int orig_h,
+                          int input_w, int input_h, float conf_thresh, std::vector<Detection> &dets)
+{
+    dets.clear();
+    int num_classes = C - 4;
+    for (int i = 0; i < L; ++i)
+    {
+        float cx = hostOutput[0 * L + i];
+        float cy = hostOutput[1 * L + i];
+        float w = hostOutput[2 * L + i];
+        float h = hostOutput[3 * L + i];
+        float best_score = -1e9f;
+        int best_class = -1;
+        for (int c = 0; c < num_classes; ++c)
+        {
+            float prob = hostOutput[(4 + c) * L + i];
+            if (prob > best_score)
+            {
+                best_score = prob;
+                best_class = c;
+            }
+        }
+        if (best_score > 1.5f || best_score < -0.5f)
+            best_score = 1.0f / (1.0f + std::exp(-best_score));
+        if (best_score < conf_thresh)
+            continue;
+        float r = std::min((float)input_w / orig_w, (float)input_h / orig_h);
+        int new_w = (int)std::round(orig_w * r);
+        int new_h = (int)std::round(orig_h * r);
+        int dw = input_w - new_w;
+        int dh = input_h - new_h;
+        float pad_x = dw / 2.0f;
+        float pad_y = dh / 2.0f;
+        auto box = std::array<float, 4>{cx - w / 2.0f, cy - h / 2.0f, cx + w / 2.0f, cy + h / 2.0f};
+        float x1 = (box[0] - pad_x) / r;
+        float y1 = (box[1] - pad_y) / r;
+        float x2 = (box[2] - pad_x) / r;
+        float y2 = (box[3] - pad_y) / r;
+        dets.push_back(Detection{x1, y1, x2, y2, best_score, best_class});
+    }
+}
+
+static int bench_decode(int argc, char **argv)
+{
+    // trt_bench decode [num_classes] [anchors] [conf] [iters] [--logits]
+    int num_classes = argc > 2 ? std::stoi(argv[2]) : 14;
+    int L = argc > 3 ? std::stoi(argv[3]) : 8400;
+    float conf = argc > 4 ? std::stof(argv[4]) : 0.25f;
+    int iters = argc > 5 ? std::stoi(argv[5]) : 500;
+    bool logits = false;
+    for (int i = 2; i < argc; ++i)
+        if (std::string(argv[i]) == "--logits")
+            logits = true;
+    int C = 4 + num_classes;
+    const int input_w = 640, input_h = 640, orig_w = 1920, orig_h = 1080;
+
+    std::vector<float> out = synthetic_output(C, L, input_w, input_h, 0.01f, logits);
+    LetterboxPlan plan = make_letterbox_plan(orig_w, orig_h, input_w, input_h);
+    YoloDecodeScratch scratch;
+    DetectionBuffer buf;
+    std::vector<Detection> legacy;
+
+    legacy_decode(out, C, L, orig_w, orig_h, input_w, input_h, conf, legacy);
+    decode_yolo_output(out.data(), C, L, plan, conf, scratch, buf);
+    bool same = legacy.size() == buf.count;
+    for (size_t k = 0; same && k < legacy.size(); ++k)
+    {
+        Detection d = buf.at(k);
+        same = std::memcmp(&d, &legacy[k], sizeof(Detection)) == 0;
+    }
+
+    double t_legacy = time_ms([&]
+                              { legacy_decode(out, C, L, orig_w, orig_h, input_w, input_h, conf, legacy); },
+                              iters);
+    double t_new = time_ms([&]
+                           { decode_yolo_output(out.data(), C, L, plan, conf, scratch, buf); },
+                           iters);
+
+    std::cout << "decode C=" << C << " L=" << L << " conf=" << conf << (logits ? " (logits)" : "")
+              << " candidates=" << buf.count << " iters=" << iters << std::endl;
+    std::cout << "  legacy loop: " << t_legacy * 1000.0 << " us/frame" << std::endl;
+    std::cout << "  decoder:     " << t_new * 1000.0 << " us/frame" << std::endl;
+    std::cout << "  speedup: " << t_legacy / std::max(1e-9, t_new) << "x" << std::endl;
+    std::cout << "  identical to legacy: " << (same ? "yes" : "NO") << std::endl;
+    return same ? 0 : 3;
+}
+
+// legacy NMS of trt_batch_infer: O(n^2) pair loop with areas recomputed per pair
+static void legacy_nms(std::vector<Detection> dets, float iou_thresh, std::vector<Detection> &final_dets)
+{
+    final_dets.clear();
+    std::sort(dets.begin(), dets.end(), [](const Detection &a, const Detection &b)
+              { return a.score > b.score; });
+    std::vector<bool> suppressed(dets.size(), false);
+    for (size_t i = 0; i < dets.size(); ++i)
+    {
+        if (suppressed[i])
+            continue;
+        final_dets.push_back(dets[i]);
+        for (size_t j = i + 1; j < dets.size(); ++j)
+        {
+            if (suppressed[j])
+                continue;
+            if (dets[i].class_id != dets[j].class_id)
+                continue;
+            float inter_x1 = std::max(dets[i].x1, dets[j].x1);
+            float inter_y1 = std::max(dets[i].y1, dets[j].y1);
+            float inter_x2 = std::min(dets[i].x2, dets[j].x2);
+            float inter_y2 = std::min(dets[i].y2, dets[j].y2);
+            float inter_w = std::max(0.0f, inter_x2 - inter_x1);
+            float inter_h = std::max(0.0f, inter_y2 - inter_y1);
+            float inter = inter_w * inter_h;
+            float areaA = (dets[i].x2 - dets[i].x1) * (dets[i].y2 - dets[i].y1);
+            float areaB = (dets[j].x2 - dets[j].x1) * (dets[j].y2 - dets[j].y1);
+            float iou = inter / (areaA + areaB - inter + 1e-6f);
+            if (iou > iou_thresh)
+                suppressed[j] = true;
+        }
+    }
+}
+
+static int bench_nms(int argc, char **argv)
+{
+    // trt_bench nms [num_classes] [iou] [max_det]
+    int num_classes = argc > 2 ? std::stoi(argv[2]) : 4;
+    NmsConfig cfg;
+    cfg.iou_thresh = argc > 3 ? std::stof(argv[3]) : 0.45f;
+    cfg.max_det = argc > 4 ? std::stoi(argv[4]) : 0;
+    const int sizes[] = {100, 300, 1000, 3000, 10000, 20000};
+
+    NmsScratch scratch;
+    DetectionBuffer buf;
+    std::vector<Detection> list, legacy;
+    std::vector<int> keep;
+    int rc = 0;
+    std::cout << "nms classes=" << num_classes << " iou=" << cfg.iou_thresh << " max_det=" << cfg.max_det << std::endl;
+    for (int n : sizes)
+    {
+        synthetic_candidates(n, num_classes, buf, list);
+        int iters = std::max(3, 200000 / n);
+        int legacy_iters = std::max(1, 20000 / n);
+        double t_legacy = time_ms([&]
+                                  { legacy_nms(list, cfg.iou_thresh, legacy); },
+                                  legacy_iters);
+        double t_grid = time_ms([&]
+                                { nms_boxes(buf, cfg, scratch, keep); },
+                                iters);
+        size_t expect = legacy.size();
+        if (cfg.max_det > 0)
+            expect = std::min(expect, (size_t)cfg.max_det);
+        bool same = keep.size() == expect;
+        for (size_t k = 0; same && k < keep.size(); ++k)
+        {
+            Detection d = buf.at(keep[k]);
+            same = std::memcmp(&d, &legacy[k], sizeof(Detection)) == 0;
+        }
+        if (!same)
+            rc = 3;
+        std::cout << "  n=" << n << " kept=" << keep.size() << " legacy " << t_legacy << " ms, grid " << t_grid
+                  << " ms, speedup " << t_legacy / std::max(1e-9, t_grid) << "x, identical: " << (same ? "yes" : "NO")
+                  << std::endl;
+    }
+    return rc;
+}
+
+static int bench_pipeline(int argc, char **argv)
+{
+    // trt_bench pipeline [stub_latency_ms] [frames] [detect_interval] [max_wait_ms]
+    double latency_ms = argc > 2 ? std::stod(argv[2]) : 5.0;
+    int frames = argc > 3 ? std::stoi(argv[3]) : 400;
+    int detect_interval = argc > 4 ? std::max(1, std::stoi(argv[4])) : 1;
+    double max_wait_ms = argc > 5 ? std::stod(argv[5]) : 2.0;
+    const int input_w = 640, input_h = 640;
+    cv::Mat frame = synthetic_frame(1280, 720);
+
+    int rc = 0;
+    std::cout << "pipeline stub latency=" << latency_ms << " ms/call frames=" << frames
+              << " detect every " << detect_interval << " max_wait=" << max_wait_ms << " ms" << std::endl;
+    for (int slots : {1, 2, 3})
+    {
+        for (int batch : {1, 2, 4, 8})
+        {
+            StubBackend backend(input_w, input_h, 3, latency_ms, batch, slots);
+            PipelineConfig cfg;
+            cfg.input_w = input_w;
+            cfg.input_h = input_h;
+            cfg.max_batch = batch;
+            cfg.max_wait_ms = max_wait_ms;
+            DetectionPipeline pipeline(cfg, backend);
+            int next = 0, expect = 0;
+            bool ordered = true, dets_ok = true;
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = pipeline.run(
+                [&](FrameTask &t)
+                {
+                    if (next >= frames)
+                        return false;
+                    t.index = next;
+                    t.do_detect = (next % detect_interval) == 0;
+                    frame.copyTo(t.frame);
+                    ++next;
+                    return true;
+                },
+                [&](FrameTask &t)
+                {
+                    ordered = ordered && (int)t.index == expect++;
+                    dets_ok = dets_ok && t.dets.size() == (t.do_detect ? 1u : 0u);
+                });
+            double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if (!ok || !ordered || !dets_ok || expect != frames)
+                rc = 3;
+            int detected = (frames + detect_interval - 1) / detect_interval;
+            std::cout << "  async_slots=" << slots << " max_batch=" << batch << " " << frames / sec << " fps, backend calls=" << backend.calls()
+                      << " (avg batch " << (backend.calls() ? (double)detected / backend.calls() : 0.0) << ")"
+                      << ", in order: " << (ordered && expect == frames ? "yes" : "NO")
+                      << ", detections: " << (dets_ok ? "ok" : "WRONG") << std::endl;
+        }
+    }
+    return rc;
+}
+
+static int bench_sinks(int argc, char **argv)
+{
+    // trt_bench sinks [WxH] [frames] [writer_threads] [dir]
+    std::string size = argc > 2 ? argv[2] : "1920x1080";
+    int frames = argc > 3 ? std::stoi(argv[3]) : 100;
+    int threads = argc > 4 ? std::stoi(argv[4]) : 2;
+    std::filesystem::path dir = argc > 5 ? std::filesystem::path(argv[5]) : std::filesystem::temp_directory_path() / "trt_bench_sinks";
+    int w = 1920, h = 1080;
+    sscanf(size.c_str(), "%dx%d", &w, &h);
+    cv::Mat frame = synthetic_frame(w, h);
+    std::filesystem::create_directories(dir);
+
+    struct Case
+    {
+        const char *label;
+        FrameFormat fmt;
+    };
+    const Case cases[] = {
+        {"none (video-only)", {FrameFormat::None, 0}},
+        {"raw (bmp)", {FrameFormat::Raw, 0}},
+        {"jpg q90", {FrameFormat::Jpeg, 90}},
+        {"jpg q75", {FrameFormat::Jpeg, 75}},
+        {"png level 1", {FrameFormat::Png, 1}},
+        {"png level 3", {FrameFormat::Png, 3}},
+    };
+
+    std::cout << "sinks " << w << "x" << h << " frames=" << frames << " writer_threads=" << threads << " dir=" << dir.string() << std::endl;
+    // old behaviour: synchronous PNG on the output thread
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+            cv::imwrite((dir / ("sync_" + std::to_string(i) + ".png")).string(), frame);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "  " << std::left << std::setw(20) << "png sync (legacy)" << std::right
+                  << " output thread " << ms / frames << " ms/frame, throughput " << frames * 1000.0 / ms << " fps" << std::endl;
+    }
+    for (const Case &c : cases)
+    {
+        uintmax_t bytes = 0;
+        double caller_ms = 0.0, wall_ms = 0.0;
+        {
+            FrameWriter writer(threads);
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < frames; ++i)
+                writer.write(frame, (dir / ("f_" + std::to_string(i))).string(), c.fmt);
+            caller_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            writer.flush();
+            wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        for (const auto &e : std::filesystem::directory_iterator(dir))
+            if (e.path().filename().string().rfind("f_", 0) == 0)
+                bytes += e.file_size();
+        std::cout << "  " << std::left << std::setw(20) << c.label << std::right
+                  << " output thread " << caller_ms / frames << " ms/frame, throughput "
+                  << (wall_ms > 0 ? frames * 1000.0 / wall_ms : 0.0) << " fps, "
+                  << bytes / (1024.0 * frames) << " KiB/frame" << std::endl;
+        for (const auto &e : std::filesystem::directory_iterator(dir))
+            std::filesystem::remove(e.path());
+    }
+    std::filesystem::remove_all(dir);
+    return 0;
+}
+
+static int bench_push(int argc, char **argv)
+{
+    // trt_bench push [WxH] [frames] [target] [fps] [queue]
+    std::string size = argc > 2 ? argv[2] : "1920x1080";
+    int frames = argc > 3 ? std::stoi(argv[3]) : 250;
+    std::string target = argc > 4 ? argv[4] : (std::filesystem::temp_directory_path() / "trt_bench_push.flv").string();
+    double fps = argc > 5 ? std::stod(argv[5]) : 25.0;
+    size_t queue = argc > 6 ? (size_t)std::stoi(argv[6]) : 8;
+    int w = 1920, h = 1080;
+    sscanf(size.c_str(), "%dx%d", &w, &h);
+    cv::Mat frame = synthetic_frame(w, h);
+
+    std::cout << "push " << w << "x" << h << " frames=" << frames << " fps=" << fps << " queue=" << queue << " target=" << target
+              << (HELMET_WITH_LIBAV ? " (libav)" : " (ffmpeg pipe)") << std::endl;
+    double push_ms = 0.0, push_max_ms = 0.0;
+    StreamPusher pusher(target, fps, 1, queue);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        // pace like a camera
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(i / fps));
+        auto t0 = std::chrono::steady_clock::now();
+        pusher.push(frame, t0);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        push_ms += ms;
+        push_max_ms = std::max(push_max_ms, ms);
+    }
+    pusher.close();
+    std::cout << "  output thread " << push_ms / frames << " ms/frame (max " << push_max_ms << " ms)" << std::endl;
+    std::cout << "  sent " << pusher.sent() << ", dropped " << pusher.dropped() << ", capture->sent latency avg "
+              << pusher.latency_avg_ms() << " ms, max " << pusher.latency_max_ms() << " ms" << std::endl;
+    return pusher.failed() ? 1 : 0;
+}
+
+// Detection sequence: dets[f] are the detections of frame f; truth[f] the boxes
+// the output should show on frame f.
+struct DetSequence
+{
+    std::vector<std::vector<Detection>> dets, truth;
+};
+
+// Workers walking across a 1920x1080 view: constant velocity with slow turns,
+// detector jitter, ~10% missed and ~10% low-score detections.
+static DetSequence synthetic_sequence(int objects, int frames)
+{
+    uint32_t s = 7;
+    auto rnd = [&s]()
+    {
+        s = s * 1664525u + 1013904223u;
+        return (s >> 8) * (1.0f / 16777216.0f);
+    };
+    struct Obj
+    {
+        float cx, cy, w, h, vx, vy;
+        int cls;
+    };
+    std::vector<Obj> objs(objects);
+    for (Obj &o : objs)
+        o = Obj{200 + 1500 * rnd(), 150 + 800 * rnd(), 30 + 50 * rnd(), 60 + 100 * rnd(), 8 * rnd() - 4, 4 * rnd() - 2, (int)(rnd() * 4) % 4};
+    DetSequence seq;
+    seq.dets.resize(frames);
+    seq.truth.resize(frames);
+    for (int f = 0; f < frames; ++f)
+    {
+        for (Obj &o : objs)
+        {
+            o.vx += 0.2f * rnd() - 0.1f;
+            o.vy += 0.2f * rnd() - 0.1f;
+            o.cx += o.vx;
+            o.cy += o.vy;
+            if (o.cx < o.w || o.cx > 1920 - o.w)
+                o.vx = -o.vx;
+            if (o.cy < o.h || o.cy > 1080 - o.h)
+                o.vy = -o.vy;
+            seq.truth[f].push_back(Detection{o.cx - o.w / 2, o.cy - o.h / 2, o.cx + o.w / 2, o.cy + o.h / 2, 1.0f, o.cls});
+            float r = rnd();
+            if (r < 0.1f)
+                continue; // missed
+            float jx = (rnd() - 0.5f) * 0.1f * o.w, jy = (rnd() - 0.5f) * 0.1f * o.h;
+            float score = r < 0.2f ? 0.15f + 0.2f * rnd() : 0.5f + 0.5f * rnd();
+            seq.dets[f].push_back(Detection{o.cx - o.w / 2 + jx, o.cy - o.h / 2 + jy, o.cx + o.w / 2 + jx, o.cy + o.h / 2 + jy, score, o.cls});
+        }
+    }
+    return seq;
+}
+
+// MOTChallenge det.txt: frame,id,x,y,w,h,conf[,class,...] (1-based frames). The
+// reference for a frame is its own detections at or above `ref_thresh`.
+static bool load_sequence(const std::string &path, float ref_thresh, DetSequence &seq)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream ss(line);
+        double v[8] = {0, 0, 0, 0, 0, 0, 0, -1};
+        int n = 0;
+        while (n < 8 && ss >> v[n])
+            ++n;
+        if (n < 7 || v[0] < 1)
+            continue;
+        size_t f = (size_t)v[0] - 1;
+        if (seq.dets.size() <= f)
+        {
+            seq.dets.resize(f + 1);
+            seq.truth.resize(f + 1);
+        }
+        Detection d{(float)v[2], (float)v[3], (float)(v[2] + v[4]), (float)(v[3] + v[5]), (float)v[6], v[7] >= 0 ? (int)v[7] : 0};
+        seq.dets[f].push_back(d);
+        if (d.score >= ref_thresh)
+            seq.truth[f].push_back(d);
+    }
+    return !seq.dets.empty();
+}
+
+// Mean IoU of each reference box with the best shown box of its class, and the
+// share of reference boxes covered with IoU >= 0.5.
+static void score_frame(const std::vector<Detection> &truth, const std::vector<Detection> &shown, double &iou_sum, size_t &hits, size_t &count)
+{
+    for (const Detection &t : truth)
+    {
+        float best = 0.0f;
+        for (const Detection &d : shown)
+            if (d.class_id == t.class_id)
+                best = std::max(best, tracker_detail::iou(t, d));
+        iou_sum += best;
+        hits += best >= 0.5f;
+        ++count;
+    }
+}
+
+static int bench_track(int argc, char **argv)
+{
+    // trt_bench track [det.txt|synthetic] [objects] [frames]
+    std::string src = argc > 2 ? argv[2] : "synthetic";
+    int objects = argc > 3 ? std::stoi(argv[3]) : 20;
+    int frames = argc > 4 ? std::stoi(argv[4]) : 1000;
+    TrackerConfig cfg;
+    DetSequence seq;
+    if (src == "synthetic")
+        seq = synthetic_sequence(objects, frames);
+    else if (!load_sequence(src, cfg.high_thresh, seq))
+    {
+        std::cerr << "Failed to read detections: " << src << std::endl;
+        return 1;
+    }
+    size_t ndets = 0;
+    for (const auto &d : seq.dets)
+        ndets += d.size();
+    std::cout << "track " << src << ": " << seq.dets.size() << " frames, " << ndets << " detections" << std::endl;
+    std::cout << "  interval   hold-last iou / recall@0.5   tracker iou / recall@0.5   tracker us/frame" << std::endl;
+    for (int interval : {1, 2, 3, 5, 10, 15})
+    {
+        ObjectTracker tracker(cfg);
+        std::vector<Detection> held, shown;
+        double hold_iou = 0.0, track_iou = 0.0, track_us = 0.0;
+        size_t hold_hits = 0, track_hits = 0, count = 0, unused = 0;
+        for (size_t f = 0; f < seq.dets.size(); ++f)
+        {
+            bool detect = f % interval == 0;
+            if (detect)
+                held = seq.dets[f];
+            auto t0 = std::chrono::steady_clock::now();
+            if (detect)
+            {
+                shown = seq.dets[f];
+                tracker.update(shown);
+            }
+            else
+            {
+                tracker.predict();
+                tracker.active(shown);
+            }
+            track_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+            score_frame(seq.truth[f], held, hold_iou, hold_hits, count);
+            score_frame(seq.truth[f], shown, track_iou, track_hits, unused);
+        }
+        double n = std::max<size_t>(1, count);
+        std::cout << "  " << std::setw(8) << interval << std::fixed << std::setprecision(3)
+                  << "   " << std::setw(13) << hold_iou / n << " / " << std::setw(5) << hold_hits / n
+                  << "      " << std::setw(11) << track_iou / n << " / " << std::setw(5) << track_hits / n
+                  << "      " << std::setw(10) << std::setprecision(2) << track_us / seq.dets.size() << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+    return 0;
+}
+
+static int bench_schedule(int argc, char **argv)
+{
+    // trt_bench schedule [video] [min_interval] [max_interval] [motion_thresh]
+    std::string path = argc > 2 ? argv[2] : "test_video.mp4";
+    SchedulerConfig cfg;
+    if (argc > 3)
+        cfg.min_interval = std::stoi(argv[3]);
+    if (argc > 4)
+        cfg.max_interval = std::stoi(argv[4]);
+    if (argc > 5)
+        cfg.motion_thresh = std::stof(argv[5]);
+    cv::VideoCapture cap(path);
+    if (!cap.isOpened())
+    {
+        std::cerr << "Failed to open video: " << path << std::endl;
+        return 1;
+    }
+    // motion only: no tracks or alarms feed back here
+    DetectScheduler sch(cfg);
+    ScheduleFeedback fb;
+    cv::Mat frame;
+    double decide_us = 0.0, motion_sum = 0.0, motion_max = 0.0;
+    int late = 0; // motion frames not inferred although the minimum interval allowed it
+    int since = 0;
+    while (cap.read(frame))
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        DetectScheduler::Reason r = sch.decide(frame, fb);
+        decide_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        ++since;
+        if (sch.motion() >= cfg.motion_thresh && r == DetectScheduler::Skip && since >= cfg.min_interval)
+            ++late;
+        if (r != DetectScheduler::Skip)
+            since = 0;
+        motion_sum += sch.motion();
+        motion_max = std::max(motion_max, (double)sch.motion());
+    }
+    uint64_t n = std::max<uint64_t>(1, sch.frames());
+    std::cout << "schedule " << path << ": " << sch.frames() << " frames, min " << cfg.min_interval << " max " << cfg.max_interval
+              << " motion >= " << cfg.motion_thresh << std::endl;
+    std::cout << "  inferred " << sch.detected() << " (" << 100.0 * sch.detected() / n << "% of frames; fixed interval 10 = "
+              << 100.0 * ((sch.frames() + 9) / 10) / n << "%)" << std::endl;
+    std::cout << "  reasons:";
+    for (int r = DetectScheduler::First; r < DetectScheduler::kReasons; ++r)
+        std::cout << " " << DetectScheduler::reason_name((DetectScheduler::Reason)r) << "=" << sch.count((DetectScheduler::Reason)r);
+    std::cout << std::endl;
+    std::cout << "  motion score avg " << motion_sum / n << " max " << motion_max << ", decide " << decide_us / n << " us/frame, late motion frames " << late << std::endl;
+    return 0;
+}
+
+static int bench_results(int argc, char **argv)
+{
+    // trt_bench results [frames] [boxes] [log_file] [dir]
+    int frames = argc > 2 ? std::stoi(argv[2]) : 20000;
+    int boxes = argc > 3 ? std::stoi(argv[3]) : 8;
+    std::string log_path = argc > 4 ? argv[4] : "/dev/null";
+    std::filesystem::path dir = argc > 5 ? std::filesystem::path(argv[5]) : std::filesystem::temp_directory_path() / "trt_bench_results";
+    std::filesystem::create_directories(dir);
+    const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+    std::vector<Detection> dets;
+    for (int i = 0; i < boxes; ++i)
+    {
+        Detection d{100.0f + 150 * i, 200.0f + 7 * i, 180.0f + 150 * i, 330.0f + 7 * i, 0.5f + 0.05f * (i % 10), i % 4};
+        d.track_id = i + 1;
+        dets.push_back(d);
+    }
+    const std::string tag;
+
+    std::ofstream log(log_path);
+    if (!log)
+    {
+        std::cerr << "Failed to open log target: " << log_path << std::endl;
+        return 1;
+    }
+    struct Row
+    {
+        std::string label;
+        double caller_us, wall_us;
+        uintmax_t bytes;
+    };
+    std::vector<Row> rows;
+    // output-thread cost per frame; `sink` (if any) is drained before the wall time is taken
+    auto run = [&](const std::string &label, int level, bool legacy, ResultSink *sink, const std::filesystem::path &file)
+    {
+        std::streambuf *console = std::cout.rdbuf(log.rdbuf());
+        std::string text;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+            if (level >= 1 && legacy)
+            {
+                // pre-result-sink trt_batch_infer: one flushed line per frame and per box
+                std::cout << tag << "Frame: " << f << " time_ms: " << f * 40.0 << std::endl;
+                for (const Detection &d : dets)
+                    std::cout << tag << "  Class: " << names[d.class_id] << ", Track: " << d.track_id << ", Conf: " << std::fixed << std::setprecision(2) << d.score
+                              << ", Box: [" << (int)std::round(d.x1) << "," << (int)std::round(d.y1) << "," << (int)std::round(d.x2) << "," << (int)std::round(d.y2) << "]" << std::endl;
+            }
+            else if (level >= 1)
+            {
+                text.clear();
+                append_frame_log(text, tag, true, f, f * 40.0, std::string(), dets, names);
+                std::cout << text;
+            }
+            if (sink)
+                sink->write(0, "cam0", f, f * 0.04, f % 5 == 0, dets, names);
+        }
+        double caller = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        if (sink)
+            sink->close();
+        std::cout.flush();
+        double wall = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        std::cout.rdbuf(console);
+        std::cout.unsetf(std::ios::fixed);
+        rows.push_back({label, caller / frames, wall / frames, file.empty() ? 0 : std::filesystem::file_size(file)});
+    };
+
+    run("log 0", 0, false, nullptr, {});
+    run("log 1 legacy endl", 1, true, nullptr, {});
+    run("log 1 buffered", 1, false, nullptr, {});
+    std::filesystem::path jsonl = dir / "results.jsonl", bin = dir / "results.bin";
+    {
+        ResultSink sink;
+        if (!sink.open(jsonl.string(), ResultFormat::Jsonl, 0))
+            return 1;
+        run("jsonl sink, log 0", 0, false, &sink, jsonl);
+    }
+    {
+        ResultSink sink;
+        if (!sink.open(bin.string(), ResultFormat::Binary, 0))
+            return 1;
+        run("bin sink, log 0", 0, false, &sink, bin);
+    }
+    {
+        ResultSink sink;
+        if (!sink.open(jsonl.string(), ResultFormat::Jsonl, 0))
+            return 1;
+        run("jsonl sink + log 1", 1, false, &sink, jsonl);
+    }
+
+    // check: the binary file decodes back to the records written
+    int rc = 0;
+    {
+        std::ifstream f(bin, std::ios::binary);
+        ResultRecordHeader h;
+        int n = 0;
+        while (f.read((char *)&h, sizeof(h)))
+        {
+            std::vector<ResultBox> b(h.count);
+            f.read((char *)b.data(), (std::streamsize)(b.size() * sizeof(ResultBox)));
+            bool ok = h.magic == kResultMagic && h.frame == (uint64_t)n && h.count == dets.size() && ((h.flags & kResultDetected) != 0) == (n % 5 == 0);
+            for (size_t i = 0; ok && i < b.size(); ++i)
+                ok = b[i].x1 == dets[i].x1 && b[i].y2 == dets[i].y2 && b[i].score == dets[i].score && b[i].class_id == dets[i].class_id && b[i].track_id == dets[i].track_id;
+            if (!ok)
+            {
+                std::cerr << "binary record " << n << " does not match" << std::endl;
+                rc = 1;
+                break;
+            }
+            ++n;
+        }
+        if (n != frames && rc == 0)
+        {
+            std::cerr << "binary file holds " << n << " of " << frames << " records" << std::endl;
+            rc = 1;
+        }
+    }
+
+    std::cout << "results frames=" << frames << " boxes/frame=" << boxes << " log=" << log_path << std::endl;
+    for (const Row &r : rows)
+        std::cout << "  " << std::left << std::setw(20) << r.label << std::right << " output thread " << r.caller_us << " us/frame ("
+                  << 1e6 / std::max(1e-3, r.caller_us) << " fps), incl. drain " << r.wall_us << " us/frame"
+                  << (r.bytes ? ", " + std::to_string(r.bytes / frames) + " B/frame" : std::string()) << std::endl;
+    std::cout << "  binary round trip: " << (rc == 0 ? "ok" : "MISMATCH") << std::endl;
+    std::filesystem::remove_all(dir);
+    return rc;
+}
+
+static int bench_detlog(int argc, char **argv)
+{
+    // trt_bench detlog [frames] [boxes] [detect_interval] [dir]
+    int frames = argc > 2 ? std::max(1, std::stoi(argv[2])) : 20000;
+    int boxes = argc > 3 ? std::stoi(argv[3]) : 8;
+    int interval = argc > 4 ? std::max(1, std::stoi(argv[4])) : 5;
+    std::filesystem::path dir = argc > 5 ? std::filesystem::path(argv[5]) : std::filesystem::temp_directory_path() / "trt_bench_detlog";
+    std::filesystem::create_directories(dir);
+    const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+    // box count varies per frame so the records are not all the same size
+    auto frame_dets = [&](int f)
+    {
+        std::vector<Detection> dets;
+        for (int i = 0; i < boxes + f % 3; ++i)
+        {
+            Detection d{100.0f + 150 * i + f % 7, 200.0f + 7 * i, 180.0f + 150 * i, 330.0f + 7 * i + f % 11, 0.5f + 0.05f * (i % 10), (i + f) % 4};
+            d.track_id = i + 1;
+            dets.push_back(d);
+        }
+        return dets;
+    };
+    std::vector<std::vector<Detection>> all(frames);
+    for (int f = 0; f < frames; ++f)
+        all[f] = frame_dets(f);
+
+    std::string path = (dir / "det.log").string();
+    DetectionLogWriter writer;
+    if (!writer.open(path, "test_video.mp4", 25.0, names, 0))
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f)
+        writer.write(f, f / 25.0, f % interval == 0, all[f]);
+    double caller = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    writer.close();
+    double wall = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    uintmax_t bytes = std::filesystem::file_size(path), idx_bytes = std::filesystem::file_size(path + ".idx");
+
+    int rc = 0;
+    auto check = [&](const char *what, bool ok)
+    {
+        if (!ok)
+        {
+            std::cerr << "detlog: " << what << " failed" << std::endl;
+            rc = 1;
+        }
+    };
+    auto same = [](const std::vector<Detection> &a, const std::vector<Detection> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+            if (a[i].x1 != b[i].x1 || a[i].y2 != b[i].y2 || a[i].score != b[i].score || a[i].class_id != b[i].class_id || a[i].track_id != b[i].track_id)
+                return false;
+        return true;
+    };
+
+    DetectionLog log;
+    std::string error;
+    double scan_us = 0.0, find_us = 0.0;
+    if (!log.open(path, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    check("header", log.size() == (size_t)frames && log.fps() == 25.0 && log.source() == "test_video.mp4" && log.class_names() == names);
+    // sequential read-back, as trt_render does
+    std::vector<Detection> dets;
+    t0 = std::chrono::steady_clock::now();
+    bool records_ok = log.size() == (size_t)frames;
+    for (size_t i = 0; records_ok && i < log.size(); ++i)
+    {
+        ResultRecordHeader h = log.record(i, dets);
+        records_ok = h.frame == i && log.entry(i).frame == i && ((h.flags & kResultDetected) != 0) == (i % interval == 0) && same(dets, all[i]);
+    }
+    scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    check("sequential read-back", records_ok);
+    // random access by frame index
+    uint64_t seed = 88172645463325252ull;
+    const int lookups = 100000;
+    bool find_ok = true;
+    t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < lookups; ++k)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        uint64_t f = seed % (uint64_t)frames;
+        size_t i = log.find(f);
+        find_ok = find_ok && i == f;
+    }
+    find_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    log.record(log.find(frames / 2), dets);
+    check("find", find_ok && same(dets, all[frames / 2]) && log.find((uint64_t)frames) == log.size());
+    log.close();
+
+    // a run killed mid-write: the log cut inside a record, the index a little ahead
+    size_t kept = (size_t)frames / 2;
+    {
+        DetectionLog full;
+        full.open(path, error);
+        uint64_t cut = full.entry(kept).offset + sizeof(ResultRecordHeader) / 2;
+        std::filesystem::copy_file(path, path + ".cut", std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::copy_file(path + ".idx", path + ".cut.idx", std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::resize_file(path + ".cut", cut);
+        std::filesystem::resize_file(path + ".cut.idx", sizeof(DetLogIndexHeader) + (kept + 3) * sizeof(DetLogIndexEntry) + 5);
+    }
+    DetectionLog cut;
+    bool cut_ok = cut.open(path + ".cut", error) && cut.size() == kept;
+    for (size_t i = 0; cut_ok && i < cut.size(); ++i)
+    {
+        cut.record(i, dets);
+        cut_ok = same(dets, all[i]);
+    }
+    check("truncated log", cut_ok);
+
+    std::cout << "detlog frames=" << frames << " boxes/frame=" << boxes << ".." << boxes + 2 << " detect_interval=" << interval << std::endl;
+    std::cout << "  write: output thread " << caller / frames << " us/frame, incl. drain " << wall / frames << " us/frame; "
+              << bytes / frames << " B/frame log + " << idx_bytes / frames << " B/frame index" << std::endl;
+    std::cout << "  read: sequential " << scan_us / frames << " us/frame (" << frames / std::max(1e-9, scan_us * 1e-6) << " frames/s), find() "
+              << find_us * 1e3 / lookups << " ns" << std::endl;
+    std::cout << "  checks: " << (rc == 0 ? "ok" : "FAILED") << " (round trip, find, truncated log keeps " << cut.size() << " of " << frames << ")" << std::endl;
+    cut.close();
+    std::filesystem::remove_all(dir);
+    return rc;
+}
+
+static int bench_metrics(int argc, char **argv)
+{
+    // trt_bench metrics [frames] [stub_latency_ms]
+    int frames = argc > 2 ? std::stoi(argv[2]) : 2000;
+    double latency_ms = argc > 3 ? std::stod(argv[3]) : 0.0;
+    const int input_w = 640, input_h = 640;
+    cv::Mat frame = synthetic_frame(1280, 720);
+
+    // raw recording cost, uncontended and with four threads on one histogram
+    const int n = 10000000;
+    for (int threads : {1, 4})
+    {
+        LatencyHistogram h;
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t)
+            pool.emplace_back([&h, t]
+                              {
+                                  for (int i = 0; i < n; ++i)
+                                      h.record_ns((uint64_t)(i * 7919u + t) % 50000000u);
+                              });
+        for (auto &t : pool)
+            t.join();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n;
+        bool ok = h.count() == (uint64_t)n * threads;
+        std::cout << "histogram record, " << threads << " thread(s): " << ns << " ns/sample per thread, count " << (ok ? "ok" : "WRONG") << std::endl;
+        if (!ok)
+            return 3;
+    }
+
+    // whole pipeline (stub backend) with metrics off and on
+    std::cout << "pipeline stub latency=" << latency_ms << " ms/call frames=" << frames << std::endl;
+    for (bool on : {false, true, false, true})
+    {
+        StubBackend backend(input_w, input_h, 3, latency_ms, 1, 1);
+        PipelineConfig cfg;
+        cfg.input_w = input_w;
+        cfg.input_h = input_h;
+        DetectionPipeline pipeline(cfg, backend);
+        Metrics metrics({"bench"});
+        if (on)
+            pipeline.set_metrics(&metrics);
+        int next = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        pipeline.run(
+            [&](FrameTask &t)
+            {
+                if (next >= frames)
+                    return false;
+                t.index = next++;
+                t.do_detect = true;
+                frame.copyTo(t.frame);
+                return true;
+            },
+            [&](FrameTask &t)
+            {
+                if (on)
+                {
+                    metrics.stream(0).frames.fetch_add(1, std::memory_order_relaxed);
+                    metrics.timer(Metrics::kLatency).record(std::chrono::steady_clock::now() - t.captured);
+                }
+            });
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "  metrics " << (on ? "on " : "off") << " " << frames / sec << " fps" << std::endl;
+        if (on)
+            std::cout << "  " << metrics.summary() << std::endl;
+    }
+    return 0;
+}
+
+static int bench_alloc(int argc, char **argv)
+{
+    // trt_bench alloc [frames] [WxH] [warmup]
+    int frames = argc > 2 ? std::stoi(argv[2]) : 2000;
+    std::string size = argc > 3 ? argv[3] : "1920x1080";
+    int warmup = argc > 4 ? std::stoi(argv[4]) : 200;
+    int w = 1920, h = 1080;
+    sscanf(size.c_str(), "%dx%d", &w, &h);
+    frames = std::max(frames, warmup + 1);
+#if !HELMET_COUNT_ALLOCS
+    (void)w;
+    (void)h;
+    std::cerr << "alloc: allocation counting needs glibc and no sanitizer" << std::endl;
+    return 1;
+#else
+    const int input_w = 640, input_h = 640;
+    const cv::Mat camera = synthetic_frame(w, h); // what the decoder hands out
+    const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "trt_bench_alloc";
+    std::filesystem::create_directories(dir);
+
+    // The output path of trt_batch_infer on every frame, with every frame inferred:
+    // capture into a frame buffer, pipeline (stub model), tracking, drawing, the
+    // per-frame log text, binary results, alarms and the metrics histograms.
+    // legacy: a new frame per read and an annotated clone per inferred frame.
+    std::cout << "alloc " << w << "x" << h << " frames=" << frames << " (first " << warmup << " not counted)" << std::endl;
+    int rc = 0;
+    for (bool legacy : {true, false})
+    {
+        StubBackend backend(input_w, input_h, (int)names.size());
+        PipelineConfig cfg;
+        cfg.input_w = input_w;
+        cfg.input_h = input_h;
+        DetectionPipeline pipeline(cfg, backend);
+        Metrics metrics({"bench"});
+        pipeline.set_metrics(&metrics);
+        FramePool pool;
+        FrameWriter writer(1);
+        ResultSink results;
+        results.open("/dev/null", ResultFormat::Binary, 0);
+        ObjectTracker tracker;
+        AlarmEngine alarms;
+        AlarmConfig acfg;
+        acfg.save_frame = acfg.save_crop = false;
+        acfg.repeat_sec = 0.0;
+        alarms.configure(acfg, names, "bench", dir.string(), 0, "");
+        std::string log_text;
+        cv::Mat last_annotated;
+        int next = 0;
+        uint64_t at_warmup = 0, at_end = 0;
+        g_allocs = 0;
+        g_count_allocs = true;
+        pipeline.run(
+            [&](FrameTask &t)
+            {
+                if (next >= frames)
+                    return false;
+                if (legacy)
+                    t.frame = cv::Mat(h, w, camera.type());
+                else
+                {
+                    t.frame.release();
+                    t.frame = pool.acquire(h, w, camera.type());
+                }
+                camera.copyTo(t.frame); // stands in for cap.read()
+                t.index = next++;
+                t.do_detect = true;
+                t.time_sec = t.index / 25.0;
+                return true;
+            },
+            [&](FrameTask &t)
+            {
+                if ((int)t.index == warmup)
+                    at_warmup = g_allocs.load();
+                tracker.update(t.dets);
+                draw_detections(t.frame, t.dets, names, [&alarms](int c)
+                                { return alarms.is_alarm_class(c); });
+                log_text.clear();
+                append_frame_log(log_text, "", true, t.index, t.time_sec * 1000.0, t.file, t.dets, names);
+                results.write(0, "bench", t.index, t.time_sec, true, t.dets, names);
+                alarms.update(t.dets, t.frame, t.index, t.time_sec, true, writer);
+                if (legacy)
+                    last_annotated = t.frame.clone();
+                metrics.timer(Metrics::kLatency).record(std::chrono::steady_clock::now() - t.captured);
+                if ((int)t.index == frames - 1)
+                    at_end = g_allocs.load();
+            });
+        g_count_allocs = false;
+        double per_frame = (double)(at_end - at_warmup) / (frames - 1 - warmup);
+        std::cout << "  " << std::left << std::setw(8) << (legacy ? "legacy" : "pooled") << std::right
+                  << " warm-up " << at_warmup << " allocations, steady state " << (at_end - at_warmup)
+                  << " (" << per_frame << " per frame)";
+        if (!legacy)
+            std::cout << ", frame buffers " << pool.size();
+        std::cout << std::endl;
+        if (!legacy && at_end != at_warmup)
+            rc = 3;
+        alarms.close();
+        results.close();
+    }
+    std::filesystem::remove_all(dir);
+    return rc;
+#endif
+}
+
+static int bench_load(int argc, char **argv)
+{
+    // trt_bench load <model file> [iters]
+    if (argc < 3)
+    {
+        std::cerr << "load needs a model file (.engine or .onnx)" << std::endl;
+        return 1;
+    }
+    std::string path = argv[2];
+    int iters = argc > 3 ? std::stoi(argv[3]) : 10;
+    // the deserializer reads every byte once; sum them so both paths touch all pages
+    auto touch = [](const char *p, size_t n)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i += 64)
+            sum += (unsigned char)p[i];
+        return sum;
+    };
+    uint64_t ref = 0, got = 0;
+    size_t size = 0;
+    double read_ms = time_ms([&]
+                             {
+        // legacy readFile(): ifstream into a std::vector<char>
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        std::vector<char> buffer((size_t)file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read(buffer.data(), buffer.size());
+        size = buffer.size();
+        ref = touch(buffer.data(), buffer.size()); }, iters);
+    bool mapped = false;
+    std::string error;
+    double map_ms = time_ms([&]
+                            {
+        MappedFile f;
+        if (!f.open(path, error))
+            return;
+        mapped = f.mapped();
+        got = touch(f.data(), f.size()); }, iters);
+    if (!error.empty() || got != ref)
+    {
+        std::cerr << "MISMATCH: " << (error.empty() ? "mapped contents differ from the file" : error) << std::endl;
+        return 2;
+    }
+    MappedFile f;
+    f.open(path, error);
+    double hash_ms = time_ms([&]
+                             { got = content_hash(f.data(), f.size()); }, iters);
+    std::cout << "load " << path << " " << size / (1024.0 * 1024.0) << " MiB, " << iters << " iters (page cache warm)" << std::endl;
+    std::cout << "  ifstream -> vector (legacy) " << read_ms << " ms, " << size / (1024.0 * 1024.0) << " MiB heap copy per process" << std::endl;
+    std::cout << "  " << (mapped ? "mmap" : "read fallback") << "                       " << map_ms << " ms, pages shared with the page cache" << std::endl;
+    std::cout << "  content hash (cache key)    " << hash_ms << " ms, " << (hash_ms > 0 ? size / (1024.0 * 1024.0) / hash_ms * 1000.0 : 0.0) << " MiB/s" << std::endl;
+    return 0;
+}
+
+static int bench_images(int argc, char **argv)
+{
+    // trt_bench images [dir|WxH] [count] [input_w] [input_h]
+    std::string src = argc > 2 ? argv[2] : "4032x3024";
+    int count = argc > 3 ? std::stoi(argv[3]) : 64;
+    int input_w = argc > 4 ? std::stoi(argv[4]) : 640;
+    int input_h = argc > 5 ? std::stoi(argv[5]) : 640;
+    std::vector<std::string> files;
+    std::filesystem::path tmp;
+    if (std::filesystem::is_directory(src))
+    {
+        for (const auto &e : std::filesystem::directory_iterator(src))
+            if (e.is_regular_file())
+                files.push_back(e.path().string());
+        std::sort(files.begin(), files.end());
+    }
+    else
+    {
+        // synthetic camera photos, one encoded JPEG copied `count` times
+        int w = 4032, h = 3024;
+        sscanf(src.c_str(), "%dx%d", &w, &h);
+        tmp = std::filesystem::temp_directory_path() / "trt_bench_images";
+        std::filesystem::create_directories(tmp);
+        std::vector<uchar> jpg;
+        cv::imencode(".jpg", synthetic_frame(w, h), jpg, {cv::IMWRITE_JPEG_QUALITY, 90});
+        for (int i = 0; i < count; ++i)
+        {
+            files.push_back((tmp / ("img_" + std::to_string(i) + ".jpg")).string());
+            std::ofstream(files.back(), std::ios::binary).write((const char *)jpg.data(), jpg.size());
+        }
+    }
+    if (files.empty())
+    {
+        std::cerr << "No images in " << src << std::endl;
+        return 1;
+    }
+
+    // reference: the first file decoded at full size on this thread
+    std::vector<uchar> bytes;
+    cv::Mat first;
+    int jw = 0, jh = 0;
+    if (read_file_bytes(files[0], bytes))
+        first = cv::imdecode(bytes, cv::IMREAD_COLOR);
+    bool jpeg = jpeg_dimensions(bytes, jw, jh);
+    if (first.empty() || (jpeg && (jw != first.cols || jh != first.rows)))
+    {
+        std::cerr << "MISMATCH: header size " << jw << "x" << jh << " vs decoded " << first.cols << "x" << first.rows << std::endl;
+        return 2;
+    }
+    int factor = jpeg ? reduced_decode_factor(jw, jh, input_w, input_h) : 1;
+    std::cout << "images " << files.size() << " files, first " << first.cols << "x" << first.rows
+              << (jpeg ? " jpeg" : "") << ", reduced decode 1/" << factor << " for " << input_w << "x" << input_h << std::endl;
+
+    int hw = std::max(1, (int)std::thread::hardware_concurrency());
+    for (bool reduced : {false, true})
+    {
+        double base_fps = 0.0;
+        for (int threads = 1; threads <= std::min(hw, 16); threads *= 2)
+        {
+            ImagePrefetcher prefetch(files, threads, (size_t)threads * 2 + 8, reduced ? input_w : 0, reduced ? input_h : 0);
+            cv::Mat frame;
+            float scale = 1.0f;
+            size_t n = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            while (prefetch.next(frame, scale))
+            {
+                if (n == 0 && !frame.empty() && (std::abs(frame.cols * scale - first.cols) >= scale || std::abs(frame.rows * scale - first.rows) >= scale))
+                {
+                    std::cerr << "MISMATCH: " << frame.cols << "x" << frame.rows << " x" << scale << " vs " << first.cols << "x" << first.rows << std::endl;
+                    return 2;
+                }
+                ++n;
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            double fps = ms > 0 ? n * 1000.0 / ms : 0.0;
+            if (threads == 1)
+                base_fps = fps;
+            std::cout << "  " << (reduced ? "reduced" : "full   ") << " threads=" << std::setw(2) << threads
+                      << " " << std::fixed << std::setprecision(1) << fps << " img/s"
+                      << " (x" << std::setprecision(2) << (base_fps > 0 ? fps / base_fps : 0.0) << ")" << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+    if (!tmp.empty())
+        std::filesystem::remove_all(tmp);
+    return 0;
+}
+
+// Stand-in detector for `trt_bench tiles`: every bright blob (R > 0.8) of at least
+// min_px x min_px model pixels becomes a class-0 box, so what it finds depends on
+// the resolution the object reaches the model at, like a real detector's
+// minimum object size. `ms_per_image` simulates the model's cost per image.
+class BlobBackend : public InferenceBackend
+{
+public:
+    BlobBackend(int input_w, int input_h, int min_px, double ms_per_image)
+        : w_(input_w), h_(input_h), min_px_(min_px), ms_(ms_per_image), anchors_(yolo_anchor_count(input_w, input_h)) {}
+
+    const char *name() const override { return "blob"; }
+    int load(const BackendConfig &) override { return 0; }
+    int output_channels() const override { return 5; }
+    int output_anchors() const override { return anchors_; }
+    int max_batch() const override { return 64; }
+    size_t images() const { return images_; }
+
+    bool infer(const float *input, float *output) override
+    {
+        ++images_;
+        if (ms_ > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms_));
+        const size_t L = (size_t)anchors_;
+        std::memset(output, 0, sizeof(float) * 5 * L);
+        label_.assign((size_t)w_ * h_, 0);
+        size_t k = 0;
+        for (int y = 0; y < h_; ++y)
+            for (int x = 0; x < w_; ++x)
+            {
+                size_t i = (size_t)y * w_ + x;
+                if (label_[i] || input[i] <= 0.8f)
+                    continue;
+                // flood fill one blob, tracking its bounding box
+                int x1 = x, y1 = y, x2 = x, y2 = y;
+                stack_.assign(1, (int)i);
+                label_[i] = 1;
+                while (!stack_.empty())
+                {
+                    int j = stack_.back(), jx = j % w_, jy = j / w_;
+                    stack_.pop_back();
+                    x1 = std::min(x1, jx);
+                    x2 = std::max(x2, jx);
+                    y1 = std::min(y1, jy);
+                    y2 = std::max(y2, jy);
+                    const int nb[4][2] = {{jx - 1, jy}, {jx + 1, jy}, {jx, jy - 1}, {jx, jy + 1}};
+                    for (const auto &n : nb)
+                    {
+                        if (n[0] < 0 || n[0] >= w_ || n[1] < 0 || n[1] >= h_)
+                            continue;
+                        size_t ni = (size_t)n[1] * w_ + n[0];
+                        if (!label_[ni] && input[ni] > 0.8f)
+                        {
+                            label_[ni] = 1;
+                            stack_.push_back((int)ni);
+                        }
+                    }
+                }
+                int bw = x2 - x1 + 1, bh = y2 - y1 + 1;
+                if (bw < min_px_ || bh < min_px_ || k >= L)
+                    continue;
+                output[0 * L + k] = x1 + bw / 2.0f;
+                output[1 * L + k] = y1 + bh / 2.0f;
+                output[2 * L + k] = (float)bw;
+                output[3 * L + k] = (float)bh;
+                output[4 * L + k] = 0.9f;
+                ++k;
+            }
+        return true;
+    }
+
+private:
+    int w_, h_, min_px_;
+    double ms_;
+    int anchors_;
+    size_t images_ = 0;
+    std::vector<uint8_t> label_;
+    std::vector<int> stack_;
+};
+
+static int bench_tiles(int argc, char **argv)
+{
+    // trt_bench tiles [WxH] [heads] [ms_per_image] [frames]
+    int w = 3840, h = 2160;
+    if (argc > 2)
+        sscanf(argv[2], "%dx%d", &w, &h);
+    int heads = argc > 3 ? std::stoi(argv[3]) : 60;
+    double ms_per_image = argc > 4 ? std::stod(argv[4]) : 5.0;
+    int frames = argc > 5 ? std::stoi(argv[5]) : 20;
+    const int input_w = 640, input_h = 640;
+    int rc = 0;
+
+    // 1) layouts: tiles inside the frame, every pixel covered, the overlap kept, the cap respected
+    std::cout << "tiles layout (" << input_w << "x" << input_h << " model, overlap 0.2, max 16):" << std::endl;
+    TileConfig tcfg;
+    tcfg.enabled = true;
+    for (auto sz : std::vector<std::pair<int, int>>{{640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}, {4032, 3024}, {7680, 4320}, {w, h}})
+    {
+        TileLayout l = make_tile_layout(sz.first, sz.second, input_w, input_h, tcfg);
+        std::vector<int> cover_x(sz.first, 0), cover_y(sz.second, 0);
+        bool inside = true, overlap_ok = true;
+        int tiles = 0, tw = 0, th = 0;
+        for (size_t u = tcfg.full_frame ? 1 : 0; u < l.units.size(); ++u)
+        {
+            const TileLayout::Unit &t = l.units[u];
+            inside = inside && t.x >= 0 && t.y >= 0 && t.x + t.w <= sz.first && t.y + t.h <= sz.second;
+            if (!inside)
+                break;
+            for (int x = t.x; x < t.x + t.w; ++x)
+                ++cover_x[x];
+            for (int y = t.y; y < t.y + t.h; ++y)
+                ++cover_y[y];
+            // the next tile of the row must share at least overlap * width (less 1 px of rounding)
+            if (u + 1 < l.units.size() && l.units[u + 1].y == t.y)
+                overlap_ok = overlap_ok && t.x + t.w - l.units[u + 1].x >= (int)(tcfg.overlap * t.w) - 1;
+            tw = t.w;
+            th = t.h;
+            ++tiles;
+        }
+        bool covered = tiles == 0 || (std::count(cover_x.begin(), cover_x.end(), 0) == 0 && std::count(cover_y.begin(), cover_y.end(), 0) == 0);
+        bool ok = inside && covered && overlap_ok && tiles <= tcfg.max_tiles;
+        if (!ok)
+            rc = 2;
+        std::cout << "  " << std::setw(4) << sz.first << "x" << std::setw(4) << sz.second << ": " << std::setw(2) << tiles << " tiles";
+        if (tiles > 0)
+            std::cout << " of " << tw << "x" << th;
+        std::cout << " + full frame = " << l.units.size() << " units, " << (ok ? "ok" : "WRONG (coverage/overlap/cap)") << std::endl;
+    }
+
+    // 2) letterboxing a tile in place equals letterboxing a copy of the crop
+    cv::Mat scene(h, w, CV_8UC3, cv::Scalar(60, 60, 60));
+    std::vector<Detection> truth;
+    {
+        uint32_t r = 2024;
+        auto rnd = [&r](int n)
+        {
+            r = r * 1664525u + 1013904223u;
+            return (int)((r >> 8) % (uint32_t)n);
+        };
+        auto place = [&](int size)
+        {
+            for (int attempt = 0; attempt < 1000; ++attempt)
+            {
+                int x = rnd(w - size - 8) + 4, y = rnd(h - size - 8) + 4;
+                bool clear = true;
+                for (const auto &d : truth)
+                    clear = clear && (x + size + 8 < d.x1 || x > d.x2 + 8 || y + size + 8 < d.y1 || y > d.y2 + 8);
+                if (!clear)
+                    continue;
+                for (int yy = y; yy < y + size; ++yy)
+                    memset(scene.ptr<uint8_t>(yy) + x * 3, 255, (size_t)size * 3);
+                truth.push_back(Detection{(float)x, (float)y, (float)(x + size), (float)(y + size), 1.0f, 0});
+                return;
+            }
+        };
+        for (int i = 0; i < 4; ++i)
+            place(std::min(w, h) / 9); // workers close to the camera
+        for (int i = 0; i < heads; ++i)
+            place(std::max(12, std::min(w, h) / 135)); // heads far away (16 px at 2160p)
+    }
+    {
+        TileLayout l = make_tile_layout(w, h, input_w, input_h, tcfg);
+        std::vector<float> a(3 * (size_t)input_w * input_h), b(a.size());
+        LetterboxScratch scratch;
+        bool same = true;
+        for (const auto &u : l.units)
+        {
+            cv::Mat crop(u.h, u.w, CV_8UC3);
+            for (int y = 0; y < u.h; ++y)
+                memcpy(crop.ptr<uint8_t>(y), scene.ptr<uint8_t>(u.y + y) + u.x * 3, (size_t)u.w * 3);
+            letterbox_bgr_to_planar(scene.data + u.y * scene.step + u.x * 3, scene.step, l.plan(u), scratch, a.data());
+            letterbox_bgr_to_planar(crop.data, crop.step, l.plan(u), scratch, b.data());
+            same = same && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+        }
+        std::cout << "  in-place tile letterbox vs cropped copy (" << l.units.size() << " units): " << (same ? "identical" : "MISMATCH") << std::endl;
+        if (!same)
+            rc = 2;
+    }
+
+    // 3) recall / precision on a synthetic drone frame, and the cost of the extra units
+    std::cout << "tiles recall on a synthetic " << w << "x" << h << " frame: " << truth.size() << " objects (" << heads
+              << " heads of " << (int)(truth.back().x2 - truth.back().x1) << " px, 4 large), detector needs 6 px at model scale, "
+              << ms_per_image << " ms per model image, " << frames << " frames" << std::endl;
+    struct Mode
+    {
+        const char *label;
+        bool tiles, full_frame;
+    };
+    for (const Mode &m : {Mode{"full frame only  ", false, true}, Mode{"tiles + full     ", true, true}, Mode{"tiles only       ", true, false}})
+    {
+        BlobBackend backend(input_w, input_h, 6, ms_per_image);
+        PipelineConfig cfg;
+        cfg.input_w = input_w;
+        cfg.input_h = input_h;
+        cfg.max_batch = 8;
+        cfg.tiles.enabled = m.tiles;
+        cfg.tiles.full_frame = m.full_frame;
+        DetectionPipeline pipeline(cfg, backend);
+        int next = 0;
+        size_t hits = 0, dets = 0, correct = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok = pipeline.run(
+            [&](FrameTask &t)
+            {
+                if (next >= frames)
+                    return false;
+                t.index = next++;
+                t.do_detect = true;
+                scene.copyTo(t.frame);
+                return true;
+            },
+            [&](FrameTask &t)
+            {
+                dets += t.dets.size();
+                for (const auto &g : truth)
+                    for (const auto &d : t.dets)
+                        if (tracker_detail::iou(g, d) >= 0.5f)
+                        {
+                            ++hits;
+                            break;
+                        }
+                for (const auto &d : t.dets)
+                    for (const auto &g : truth)
+                        if (tracker_detail::iou(g, d) >= 0.5f)
+                        {
+                            ++correct;
+                            break;
+                        }
+            });
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double recall = frames ? (double)hits / (truth.size() * frames) : 0.0;
+        double precision = dets ? (double)correct / dets : 1.0;
+        std::cout << "  " << m.label << std::fixed << std::setprecision(1) << frames / sec << " fps, "
+                  << (frames ? (double)backend.images() / frames : 0.0) << " model images/frame, recall "
+                  << std::setprecision(3) << recall << ", precision " << precision << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        if (!ok || (m.tiles && (recall < 0.95 || precision < 0.95)))
+            rc = 3;
+    }
+    return rc;
+}
+
+static int bench_headless(int argc, char **argv)
+{
+    // trt_bench headless [video] [detect_interval] [frames]
+    std::string path = argc > 2 ? argv[2] : "test_video.mp4";
+    int interval = argc > 3 ? std::max(1, std::stoi(argv[3])) : 10;
+    int max_frames = argc > 4 ? std::stoi(argv[4]) : 0; // 0 = whole video
+    const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+    std::vector<Detection> dets;
+    for (int i = 0; i < 6; ++i)
+        dets.push_back(Detection{60.0f + i * 150, 80.0f, 180.0f + i * 150, 230.0f, 0.8f, i % 4});
+
+    struct Pass
+    {
+        int frames = 0, decoded = 0;
+        double wall_ms = 0.0, cpu_ms = 0.0;
+        std::vector<double> pos;    // timestamps of the inferred frames
+        std::vector<uint64_t> sums; // and a checksum of their pixels
+    };
+    // headless = false: what the output path did for every frame (read + draw);
+    // true: grab() between detections, read() only the frames that are inferred, no drawing
+    auto run = [&](bool headless, Pass &p) -> bool
+    {
+        cv::VideoCapture cap(path);
+        if (!cap.isOpened())
+            return false;
+        cv::Mat frame;
+        std::clock_t c0 = std::clock();
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; max_frames <= 0 || i < max_frames; ++i)
+        {
+            bool detect = i % interval == 0;
+            if (headless && !detect)
+            {
+                if (!cap.grab())
+                    break;
+            }
+            else
+            {
+                if (!cap.read(frame))
+                    break;
+                ++p.decoded;
+                if (detect)
+                {
+                    uint64_t sum = 0;
+                    for (int y = 0; y < frame.rows; y += 7)
+                        for (int x = 0; x < frame.cols * 3; x += 13)
+                            sum = sum * 31 + frame.ptr<uint8_t>(y)[x];
+                    p.sums.push_back(sum);
+                    p.pos.push_back(cap.get(cv::CAP_PROP_POS_MSEC));
+                }
+                if (!headless)
+                    draw_detections(frame, dets, names, [](int c)
+                                    { return c == 1 || c == 3; });
+            }
+            ++p.frames;
+        }
+        p.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        p.cpu_ms = 1000.0 * (double)(std::clock() - c0) / CLOCKS_PER_SEC;
+        return p.frames > 0;
+    };
+    Pass full, headless;
+    if (!run(false, full) || !run(true, headless))
+    {
+        std::cerr << "Cannot read " << path << std::endl;
+        return 1;
+    }
+    bool same = full.frames == headless.frames && full.sums == headless.sums && full.pos == headless.pos;
+    std::cout << "headless " << path << ": " << full.frames << " frames, inference every " << interval << " (capture + drawing only, no model)" << std::endl;
+    auto row = [&](const char *label, const Pass &p)
+    {
+        std::cout << "  " << label << std::fixed << std::setprecision(1) << p.wall_ms << " ms wall, " << p.cpu_ms << " ms CPU ("
+                  << std::setprecision(3) << p.cpu_ms / std::max(1, p.frames) << " ms/frame), " << p.decoded << " frames decoded to images"
+                  << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    };
+    row("read + draw every frame      ", full);
+    row("headless grab / retrieve     ", headless);
+    std::cout << "  CPU time x" << std::setprecision(2) << (headless.cpu_ms > 0 ? full.cpu_ms / headless.cpu_ms : 0.0)
+              << " less, inferred frames " << (same ? "identical (pixels and timestamps)" : "DIFFER") << std::endl;
+    return same ? 0 : 2;
+}
+
+static int bench_daemon(int argc, char **argv)
+{
+    // trt_bench daemon [requests] [clients] [stub_latency_ms] [WxH]
+    int requests = argc > 2 ? std::stoi(argv[2]) : 400;
+    int clients = argc > 3 ? std::max(1, std::stoi(argv[3])) : 4;
+    double latency_ms = argc > 4 ? std::stod(argv[4]) : 4.0;
+    int w = 1920, h = 1080;
+    if (argc > 5)
+        sscanf(argv[5], "%dx%d", &w, &h);
+    const int input_w = 640, input_h = 640;
+    const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+    BackendConfig bcfg;
+    bcfg.input_w = input_w;
+    bcfg.input_h = input_h;
+    bcfg.num_classes = (int)names.size();
+    bcfg.max_batch = 8;
+    bcfg.stub_latency_ms = latency_ms;
+    StubBackend backend;
+    backend.load(bcfg);
+    DaemonConfig dcfg;
+    dcfg.max_batch = 8;
+    dcfg.log_level = 0;
+    std::string path = "/tmp/trt_bench_daemon_" + std::to_string(::getpid()) + ".sock";
+    InferServer server(backend, dcfg, input_w, input_h, names);
+    if (!server.start(path))
+        return 1;
+    cv::Mat frame(h, w, CV_8UC3);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w * 3; ++x)
+            frame.ptr<uint8_t>(y)[x] = (uint8_t)(x * 7 + y * 3);
+    int rc = 0;
+
+    // 1) one synchronous round trip against the same steps run in-process
+    {
+        InferClient client;
+        if (!client.connect(path, 2, (uint64_t)w * h * 3))
+        {
+            std::cerr << "connect: " << client.error() << std::endl;
+            return 1;
+        }
+        StubBackend local;
+        local.load(bcfg);
+        LetterboxPlan plan = make_letterbox_plan(w, h, input_w, input_h);
+        LetterboxScratch lb;
+        std::vector<float> in((size_t)3 * input_w * input_h), out((size_t)local.output_channels() * local.output_anchors());
+        YoloDecodeScratch ds;
+        DetectionBuffer cand;
+        NmsScratch ns;
+        std::vector<int> keep;
+        bool same = client.class_names() == names && client.input_w() == input_w && client.input_h() == input_h;
+        std::vector<Detection> dets;
+        for (int i = 0; i < 8 && same; ++i)
+        {
+            letterbox_bgr_to_planar(frame.data, frame.step, plan, lb, in.data());
+            local.infer(in.data(), out.data());
+            decode_yolo_output(out.data(), local.output_channels(), local.output_anchors(), plan, dcfg.conf_thresh, ds, cand);
+            nms_boxes(cand, dcfg.nms, ns, keep);
+            same = client.detect(frame, dets) && dets.size() == keep.size();
+            for (size_t k = 0; same && k < keep.size(); ++k)
+            {
+                Detection d = cand.at(keep[k]);
+                same = d.x1 == dets[k].x1 && d.y1 == dets[k].y1 && d.x2 == dets[k].x2 && d.y2 == dets[k].y2 && d.score == dets[k].score &&
+                       d.class_id == dets[k].class_id;
+            }
+        }
+        std::cout << "daemon " << w << "x" << h << " frames, stub model " << latency_ms << " ms per call, max batch 8" << std::endl;
+        std::cout << "  round trip vs in-process letterbox + infer + decode + NMS: " << (same ? "identical boxes" : "DIFFER") << std::endl;
+        if (!same)
+            rc = 2;
+
+        // a request naming a slot that does not exist ends the connection; the daemon keeps serving
+        DaemonRequest bad;
+        bad.slot = 99;
+        DaemonReply r;
+        std::string payload;
+        bool dropped = client.submit(bad) && !client.receive(r, payload);
+        InferClient again;
+        bool served = again.connect(path, 1, (uint64_t)w * h * 3) && again.detect(frame, dets) && !dets.empty();
+        std::cout << "  protocol error: client " << (dropped ? "disconnected" : "NOT disconnected") << ", daemon "
+                  << (served ? "still serving" : "NOT serving") << std::endl;
+        if (!dropped || !served)
+            rc = 2;
+
+        // a client truncating its ring (the server would fault reading the slot): the seal refuses
+        // it, and a request on the same connection is still answered
+        bool shrink_refused = false, answered = false;
+        {
+            sockaddr_un addr;
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            DaemonHello hello;
+            hello.slots = 1;
+            hello.slot_bytes = (uint64_t)w * h * 3;
+            DaemonWelcome welcome;
+            int shm = -1;
+            if (fd >= 0 && daemon_detail::make_unix_address(path, addr) && ::connect(fd, (const sockaddr *)&addr, sizeof(addr)) == 0 &&
+                daemon_detail::send_all(fd, &hello, sizeof(hello)) && daemon_detail::recv_with_fd(fd, &welcome, sizeof(welcome), shm) && shm >= 0)
+            {
+                std::string names_blob(welcome.names_length, '\0');
+                daemon_detail::recv_all(fd, &names_blob[0], names_blob.size());
+                shrink_refused = ::ftruncate(shm, 0) != 0;
+                DaemonRequest req;
+                req.width = w;
+                req.height = h;
+                req.stride = w * 3;
+                DaemonReply r;
+                answered = daemon_detail::send_all(fd, &req, sizeof(req)) && daemon_detail::recv_all(fd, &r, sizeof(r)) && r.status == kDaemonOk;
+            }
+            if (shm >= 0)
+                ::close(shm);
+            if (fd >= 0)
+                ::close(fd);
+        }
+        served = again.connect(path, 1, (uint64_t)w * h * 3) && again.detect(frame, dets) && !dets.empty();
+        std::cout << "  client shrinking its ring: " << (shrink_refused ? "refused" : "NOT refused") << ", its request "
+                  << (answered ? "answered" : "NOT answered") << ", daemon " << (served ? "still serving" : "NOT serving") << std::endl;
+        if (!shrink_refused || !answered || !served)
+            rc = 2;
+    }
+
+    // 2) latency and throughput: each client keeps both of its slots busy
+    auto pass = [&](int n_clients, int slots, std::vector<double> &lat) -> double
+    {
+        std::vector<std::vector<double>> per(n_clients);
+        std::vector<std::thread> threads;
+        std::atomic<int> failures{0};
+        uint64_t calls0 = server.batches();
+        auto t0 = std::chrono::steady_clock::now();
+        for (int c = 0; c < n_clients; ++c)
+            threads.emplace_back([&, c]
+                                 {
+                InferClient client;
+                if (!client.connect(path, slots, (uint64_t)w * h * 3))
+                {
+                    ++failures;
+                    return;
+                }
+                int n = requests / n_clients;
+                std::vector<std::chrono::steady_clock::time_point> sent(slots);
+                DaemonReply r;
+                std::string payload;
+                int submitted = 0, received = 0;
+                auto submit = [&](uint32_t s)
+                {
+                    // the producer's one copy: the frame lands in shared memory, not in a socket
+                    for (int y = 0; y < h; ++y)
+                        memcpy(client.slot(s) + (size_t)y * w * 3, frame.ptr(y), (size_t)w * 3);
+                    DaemonRequest req;
+                    req.id = s;
+                    req.slot = s;
+                    req.width = w;
+                    req.height = h;
+                    req.stride = w * 3;
+                    req.frame = (uint64_t)submitted++;
+                    sent[s] = std::chrono::steady_clock::now();
+                    return client.submit(req);
+                };
+                for (int s = 0; s < slots && submitted < n; ++s)
+                    if (!submit((uint32_t)s))
+                        ++failures;
+                while (received < submitted)
+                {
+                    if (!client.receive(r, payload) || r.status != kDaemonOk)
+                    {
+                        ++failures;
+                        return;
+                    }
+                    ++received;
+                    per[c].push_back(daemon_detail::ms_since(sent[r.id]));
+                    if (submitted < n && !submit(r.id))
+                        ++failures;
+                } });
+        for (auto &t : threads)
+            t.join();
+        double ms = daemon_detail::ms_since(t0);
+        lat.clear();
+        for (auto &v : per)
+            lat.insert(lat.end(), v.begin(), v.end());
+        std::sort(lat.begin(), lat.end());
+        if (failures.load())
+            rc = 2;
+        uint64_t calls = server.batches() - calls0;
+        std::cout << "  " << n_clients << " client(s) x " << slots << " slot(s): " << std::fixed << std::setprecision(1)
+                  << lat.size() * 1000.0 / ms << " frames/s, " << (calls ? (double)lat.size() / calls : 0.0) << " frames per model call, latency ms p50 "
+                  << std::setprecision(2) << (lat.empty() ? 0.0 : lat[lat.size() / 2]) << " p99 "
+                  << (lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, lat.size() * 99 / 100)])
+                  << (failures.load() ? "  FAILURES" : "") << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        return ms;
+    };
+    std::vector<double> lat;
+    pass(1, 1, lat);
+    pass(1, 2, lat);
+    pass(clients, 2, lat);
+    server.stop();
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <benchmark> [args]" << std::endl;
+        std::cout << "  preprocess [image|WxH] [input_w] [input_h] [iters]" << std::endl;
+        std::cout << "  decode [num_classes] [anchors] [conf] [iters] [--logits]" << std::endl;
+        std::cout << "  nms [num_classes] [iou] [max_det]" << std::endl;
+        std::cout << "  pipeline [stub_latency_ms] [frames] [detect_interval] [max_wait_ms]" << std::endl;
+        std::cout << "  metrics [frames] [stub_latency_ms]" << std::endl;
+        std::cout << "  sinks [WxH] [frames] [writer_threads] [dir]" << std::endl;
+        std::cout << "  push [WxH] [frames] [target] [fps] [queue]" << std::endl;
+        std::cout << "  results [frames] [boxes] [log_file] [dir]" << std::endl;
+        std::cout << "  detlog [frames] [boxes] [detect_interval] [dir]" << std::endl;
+        std::cout << "  track [det.txt|synthetic] [objects] [frames]" << std::endl;
+        std::cout << "  schedule [video] [min_interval] [max_interval] [motion_thresh]" << std::endl;
+        std::cout << "  alloc [frames] [WxH] [warmup]" << std::endl;
+        std::cout << "  images [dir|WxH] [count] [input_w] [input_h]" << std::endl;
+        std::cout << "  load <model file> [iters]" << std::endl;
+        std::cout << "  tiles [WxH] [heads] [ms_per_image] [frames]" << std::endl;
+        std::cout << "  headless [video] [detect_interval] [frames]" << std::endl;
+        std::cout << "  daemon [requests] [clients] [stub_latency_ms] [WxH]" << std::endl;
+        return 1;
+    }
+    std::string which = argv[1];
+    if (which == "preprocess")
+        return bench_preprocess(argc, argv);
+    if (which == "decode")
+        return bench_decode(argc, argv);
+    if (which == "nms")
+        return bench_nms(argc, argv);
+    if (which == "pipeline")
+        return bench_pipeline(argc, argv);
+    if (which == "metrics")
+        return bench_metrics(argc, argv);
+    if (which == "sinks")
+        return bench_sinks(argc, argv);
+    if (which == "push")
+        return bench_push(argc, argv);
+    if (which == "results")
+        return bench_results(argc, argv);
+    if (which == "detlog")
+        return bench_detlog(argc, argv);
+    if (which == "track")
+        return bench_track(argc, argv);
+    if (which == "schedule")
+        return bench_schedule(argc, argv);
+    if (which == "alloc")
+        return bench_alloc(argc, argv);
+    if (which == "images")
+        return bench_images(argc, argv);
+    if (which == "load")
+        return bench_load(argc, argv);
+    if (which == "tiles")
+        return bench_tiles(argc, argv);
+    if (which == "headless")
+        return bench_headless(argc, argv);
+    if (which == "daemon")
+        return bench_daemon(argc, argv);
+    std::cerr << "Unknown benchmark: " << which << std::endl;
+    return 1;
+}
@@ -0,0 +1,541 @@
+// Regression benchmark suite for the CPU side of trt_batch_infer.
+//
+// Google-Benchmark-style: each case repeats its body until --min-time has
+// passed and reports time per iteration (wall and calling-thread CPU) and
+// items per second. --json writes the results in Google Benchmark's JSON
+// layout (context + benchmarks[]), so the files can be archived per release
+// and fed to the usual tooling; `trt_bench_suite compare old.json new.json`
+// lists the changes and fails when a case got slower than the threshold.
+//
+// Cases: preprocess (letterbox), output decode, NMS, drawing, frame encoding
+// (JPEG / PNG / BMP to memory) and end-to-end frames/sec through the real
+// pipeline on a video and an image directory, with the stub backend (no model)
+// or OpenCV DNN (--backend dnn --model best.onnx). Inputs that are not found
+// are skipped.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <unistd.h>
+
+#include "alarm.hpp"
+#include "annotate.hpp"
+#include "backend_factory.hpp"
+#include "bench_data.hpp"
+#include "frame_sink.hpp"
+#include "letterbox.hpp"
+#include "nms.hpp"
+#include "pipeline.hpp"
+#include "yolo_decoder.hpp"
+
+#ifndef HELMET_VERSION
+#define HELMET_VERSION "dev"
+#endif
+
+struct SuiteOptions
+{
+    double min_time = 0.5; // seconds per case
+    std::string filter;    // substring of the case name
+    std::string json_path;
+    std::string video = "test_video.mp4";
+    std::string images = "input_photos";
+    std::string backend = "stub";
+    std::string model;      // .onnx for --backend dnn
+    int e2e_frames = 300;   // frames per end-to-end pass
+    int input_w = 640, input_h = 640;
+    int num_classes = 4;
+};
+
+struct CaseResult
+{
+    std::string name;
+    uint64_t iterations = 0;
+    double real_ns = 0.0, cpu_ns = 0.0; // per iteration
+    double items_per_second = 0.0;
+    std::string label;
+};
+
+static double thread_cpu_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Runs `body` (one iteration) in growing batches until min_time has passed, as
+// Google Benchmark does; `items` are counted per iteration for items_per_second.
+static CaseResult run_case(const std::string &name, double min_time, double items, const std::function<void()> &body)
+{
+    body(); // warm-up: first-touch allocations, caches, lazily built tables
+    CaseResult r;
+    r.name = name;
+    uint64_t batch = 1;
+    double wall = 0.0, cpu = 0.0;
+    for (;;)
+    {
+        double c0 = thread_cpu_ns();
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < batch; ++i)
+            body();
+        wall += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        cpu += thread_cpu_ns() - c0;
+        r.iterations += batch;
+        if (wall >= min_time * 1e9 || r.iterations >= 1000000000ull)
+            break;
+        // aim at the remaining time with a 40% margin, at most 10x per step
+        double per_iter = wall / r.iterations;
+        double want = (min_time * 1e9 - wall) * 1.4 / std::max(1.0, per_iter);
+        batch = (uint64_t)std::max(1.0, std::min(want, batch * 10.0));
+    }
+    r.real_ns = wall / r.iterations;
+    r.cpu_ns = cpu / r.iterations;
+    r.items_per_second = items * 1e9 / std::max(1.0, r.real_ns);
+    return r;
+}
+
+static std::string json_number(double v)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.6g", std::isfinite(v) ? v : 0.0);
+    return buf;
+}
+
+static bool write_json(const std::string &path, const std::vector<CaseResult> &results, const SuiteOptions &opt, const char *argv0)
+{
+    std::ofstream f(path);
+    if (!f)
+        return false;
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    std::time_t now = std::time(nullptr);
+    std::tm tm{};
+    localtime_r(&now, &tm);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", &tm);
+    f << "{\n  \"context\": {\n";
+    f << "    \"date\": \"" << date << "\",\n";
+    f << "    \"host_name\": \"" << json_escape(host) << "\",\n";
+    f << "    \"executable\": \"" << json_escape(argv0) << "\",\n";
+    f << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    f << "    \"library_build_type\": \"release\",\n";
+#else
+    f << "    \"library_build_type\": \"debug\",\n";
+#endif
+    f << "    \"helmet_version\": \"" << HELMET_VERSION << "\",\n";
+    f << "    \"opencv_version\": \"" << CV_VERSION << "\",\n";
+    f << "    \"backend\": \"" << json_escape(opt.backend) << "\",\n";
+    f << "    \"min_time\": " << json_number(opt.min_time) << "\n  },\n";
+    f << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const CaseResult &r = results[i];
+        f << (i ? ",\n" : "\n") << "    {\n";
+        f << "      \"name\": \"" << json_escape(r.name) << "\",\n";
+        f << "      \"run_name\": \"" << json_escape(r.name) << "\",\n";
+        f << "      \"run_type\": \"iteration\",\n";
+        f << "      \"iterations\": " << r.iterations << ",\n";
+        f << "      \"real_time\": " << json_number(r.real_ns / 1e3) << ",\n";
+        f << "      \"cpu_time\": " << json_number(r.cpu_ns / 1e3) << ",\n";
+        f << "      \"time_unit\": \"us\",\n";
+        f << "      \"items_per_second\": " << json_number(r.items_per_second);
+        if (!r.label.empty())
+            f << ",\n      \"label\": \"" << json_escape(r.label) << "\"";
+        f << "\n    }";
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+static void print_row(const CaseResult &r)
+{
+    std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << r.real_ns / 1e3 << " us" << std::setw(14) << r.cpu_ns / 1e3 << " us"
+              << std::setw(12) << r.iterations << std::setprecision(2) << std::setw(14) << r.items_per_second << "/s"
+              << (r.label.empty() ? "" : "  " + r.label) << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+// Image-directory / video frames for the end-to-end cases.
+static std::vector<std::string> list_images(const std::string &dir)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir, ec))
+        return files;
+    for (const auto &e : std::filesystem::directory_iterator(dir, ec))
+    {
+        std::string ext = e.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                       { return (char)std::tolower(c); });
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp")
+            files.push_back(e.path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// One pass of up to `frames` frames through the pipeline: decode, preprocess,
+// inference, decode+NMS, drawing. Returns the number of frames, 0 on failure.
+static int run_e2e(const SuiteOptions &opt, InferenceBackend &backend, const std::function<bool(cv::Mat &)> &next_frame,
+                   const TileConfig &tiles = TileConfig())
+{
+    PipelineConfig cfg;
+    cfg.input_w = opt.input_w;
+    cfg.input_h = opt.input_h;
+    cfg.tiles = tiles;
+    if (tiles.enabled)
+        cfg.max_batch = 8;
+    DetectionPipeline pipeline(cfg, backend);
+    std::vector<std::string> names;
+    for (int c = 0; c < opt.num_classes; ++c)
+        names.push_back("class" + std::to_string(c));
+    int read = 0, out = 0;
+    bool ok = pipeline.run(
+        [&](FrameTask &t)
+        {
+            if (read >= opt.e2e_frames || !next_frame(t.frame))
+                return false;
+            t.index = read++;
+            t.do_detect = true;
+            return true;
+        },
+        [&](FrameTask &t)
+        {
+            draw_detections(t.frame, t.dets, names, [](int c)
+                            { return c == 1; });
+            ++out;
+        });
+    return ok ? out : 0;
+}
+
+static int run_suite(const SuiteOptions &opt, const char *argv0)
+{
+    std::vector<CaseResult> results;
+    auto want = [&](const std::string &name)
+    { return opt.filter.empty() || name.find(opt.filter) != std::string::npos; };
+    auto add = [&](CaseResult r)
+    {
+        print_row(r);
+        results.push_back(std::move(r));
+    };
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(17) << "time" << std::setw(17) << "cpu"
+              << std::setw(12) << "iterations" << std::setw(16) << "items" << std::endl;
+
+    const cv::Mat frame1080 = synthetic_frame(1920, 1080);
+
+    // preprocess: letterbox + BGR->RGB planar float
+    {
+        std::vector<float> input(3 * (size_t)opt.input_w * opt.input_h);
+        LetterboxScratch scratch;
+        std::vector<std::pair<std::string, cv::Mat>> frames = {{"1920x1080", frame1080}, {"1280x720", synthetic_frame(1280, 720)}};
+        std::vector<std::string> photos = list_images(opt.images);
+        if (!photos.empty())
+        {
+            cv::Mat photo = cv::imread(photos.front());
+            if (!photo.empty())
+                frames.push_back({std::filesystem::path(photos.front()).filename().string(), photo});
+        }
+        for (const auto &f : frames)
+        {
+            std::string name = "preprocess/letterbox/" + f.first;
+            if (!want(name))
+                continue;
+            LetterboxPlan plan = make_letterbox_plan(f.second.cols, f.second.rows, opt.input_w, opt.input_h);
+            add(run_case(name, opt.min_time, 1, [&]
+                         { letterbox_bgr_to_planar(f.second.data, f.second.step, plan, scratch, input.data()); }));
+        }
+    }
+
+    // output decode: YOLOv8 head, 8400 anchors
+    for (int classes : {4, 14})
+    {
+        std::string name = "decode/yolo/C" + std::to_string(4 + classes) + "xL8400";
+        if (!want(name))
+            continue;
+        const int C = 4 + classes, L = 8400;
+        std::vector<float> out = synthetic_output(C, L, opt.input_w, opt.input_h, 0.01f, false);
+        LetterboxPlan plan = make_letterbox_plan(1920, 1080, opt.input_w, opt.input_h);
+        YoloDecodeScratch scratch;
+        DetectionBuffer buf;
+        CaseResult r = run_case(name, opt.min_time, 1, [&]
+                                { decode_yolo_output(out.data(), C, L, plan, 0.25f, scratch, buf); });
+        r.label = std::to_string(buf.count) + " candidates";
+        add(r);
+    }
+
+    // NMS over crowded-scene candidates
+    for (int n : {200, 2000, 20000})
+    {
+        std::string name = "nms/candidates:" + std::to_string(n);
+        if (!want(name))
+            continue;
+        DetectionBuffer buf;
+        std::vector<Detection> list;
+        synthetic_candidates(n, 4, buf, list);
+        NmsConfig cfg;
+        NmsScratch scratch;
+        std::vector<int> keep;
+        CaseResult r = run_case(name, opt.min_time, 1, [&]
+                                { nms_boxes(buf, cfg, scratch, keep); });
+        r.label = std::to_string(keep.size()) + " kept";
+        add(r);
+    }
+
+    // drawing boxes and labels onto a 1080p frame
+    for (int boxes : {4, 32})
+    {
+        std::string name = "draw/boxes:" + std::to_string(boxes);
+        if (!want(name))
+            continue;
+        cv::Mat canvas = frame1080.clone();
+        std::vector<Detection> dets;
+        for (int i = 0; i < boxes; ++i)
+        {
+            Detection d{40.0f + (i % 8) * 230, 60.0f + (i / 8) * 250, 140.0f + (i % 8) * 230, 260.0f + (i / 8) * 250, 0.9f, i % 4};
+            d.track_id = i + 1;
+            dets.push_back(d);
+        }
+        const std::vector<std::string> names = {"helmet", "head", "vest", "no_vest"};
+        add(run_case(name, opt.min_time, boxes, [&]
+                     { draw_detections(canvas, dets, names, [](int c)
+                                       { return c == 1 || c == 3; }); }));
+    }
+
+    // per-frame image encoding (what the background frame writers spend their time on)
+    {
+        struct Enc
+        {
+            const char *label;
+            FrameFormat fmt;
+        };
+        const Enc encs[] = {{"jpg_q90", {FrameFormat::Jpeg, 90}}, {"png_l1", {FrameFormat::Png, 1}}, {"bmp", {FrameFormat::Raw, 0}}};
+        std::vector<uchar> bytes;
+        for (const Enc &e : encs)
+        {
+            std::string name = std::string("encode/") + e.label + "/1920x1080";
+            if (!want(name))
+                continue;
+            std::vector<int> params = frame_format_params(e.fmt);
+            CaseResult r = run_case(name, opt.min_time, 1, [&]
+                                    { cv::imencode(frame_format_ext(e.fmt), frame1080, bytes, params); });
+            r.label = std::to_string(bytes.size() / 1024) + " KiB";
+            add(r);
+        }
+    }
+
+    // end to end through the pipeline
+    std::unique_ptr<InferenceBackend> backend;
+    auto load_backend = [&]() -> bool
+    {
+        if (backend)
+            return true;
+        backend = make_inference_backend(opt.backend);
+        if (!backend)
+        {
+            std::cerr << "Unknown or unavailable backend: " << opt.backend << std::endl;
+            return false;
+        }
+        BackendConfig cfg;
+        cfg.model_path = opt.model;
+        cfg.input_w = opt.input_w;
+        cfg.input_h = opt.input_h;
+        cfg.num_classes = opt.num_classes;
+        cfg.max_batch = 8; // used by the tiled case only; the others run one frame per call
+        cfg.log_level = 0;
+        if (backend->load(cfg) != 0)
+        {
+            backend.reset();
+            return false;
+        }
+        return true;
+    };
+    int rc = 0;
+    std::string e2e_video = "e2e/video/" + opt.backend, e2e_images = "e2e/images/" + opt.backend;
+    // the video again with tiled inference (tiles of model size + the full frame, as --tiles)
+    TileConfig tiled;
+    tiled.enabled = true;
+    for (bool tiles : {false, true})
+    {
+        std::string name = tiles ? "e2e/video_tiled/" + opt.backend : e2e_video;
+        if (!want(name))
+            continue;
+        cv::VideoCapture probe(opt.video);
+        if (!probe.isOpened())
+            std::cout << name << ": skipped (cannot open " << opt.video << ")" << std::endl;
+        else if (!load_backend())
+            rc = 1;
+        else
+        {
+            probe.release();
+            int frames = 0;
+            // one iteration = one pass over the first e2e_frames frames, reopening the video
+            CaseResult r = run_case(name, opt.min_time, 0, [&]
+                                    {
+                                        cv::VideoCapture cap(opt.video);
+                                        frames = run_e2e(opt, *backend, [&cap](cv::Mat &f)
+                                                         { return cap.read(f); },
+                                                         tiles ? tiled : TileConfig());
+                                    });
+            r.items_per_second = frames * 1e9 / std::max(1.0, r.real_ns);
+            r.label = std::to_string(frames) + " frames/pass, items = frames";
+            add(r);
+            if (frames == 0)
+                rc = 1;
+        }
+    }
+    if (want(e2e_images))
+    {
+        std::vector<std::string> files = list_images(opt.images);
+        if (files.empty())
+            std::cout << e2e_images << ": skipped (no images in " << opt.images << ")" << std::endl;
+        else if (!load_backend())
+            rc = 1;
+        else
+        {
+            int frames = 0;
+            int count = std::min<int>(opt.e2e_frames, (int)files.size());
+            CaseResult r = run_case(e2e_images, opt.min_time, 0, [&]
+                                    {
+                                        size_t i = 0;
+                                        frames = run_e2e(opt, *backend, [&](cv::Mat &f)
+                                                         {
+                                                             if ((int)i >= count)
+                                                                 return false;
+                                                             f = cv::imread(files[i++]);
+                                                             return !f.empty();
+                                                         });
+                                    });
+            r.items_per_second = frames * 1e9 / std::max(1.0, r.real_ns);
+            r.label = std::to_string(frames) + " images/pass, items = images";
+            add(r);
+            if (frames == 0)
+                rc = 1;
+        }
+    }
+
+    if (!opt.json_path.empty())
+    {
+        if (!write_json(opt.json_path, results, opt, argv0))
+        {
+            std::cerr << "Failed to write " << opt.json_path << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << results.size() << " results to " << opt.json_path << std::endl;
+    }
+    return rc;
+}
+
+// name -> real_time (in the file's time unit) from a Google-Benchmark-style JSON file
+static bool read_results(const std::string &path, std::vector<std::pair<std::string, double>> &out)
+{
+    std::ifstream f(path);
+    if (!f)
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::stringstream ss;
+    ss << f.rdbuf();
+    const std::string text = ss.str();
+    size_t pos = text.find("\"benchmarks\"");
+    while (pos != std::string::npos)
+    {
+        size_t n = text.find("\"name\"", pos);
+        if (n == std::string::npos)
+            break;
+        size_t q0 = text.find('"', text.find(':', n) + 1), q1 = text.find('"', q0 + 1);
+        size_t t = text.find("\"real_time\"", q1);
+        size_t next = text.find("\"name\"", q1);
+        if (q0 == std::string::npos || q1 == std::string::npos || t == std::string::npos || (next != std::string::npos && t > next))
+            break;
+        out.emplace_back(text.substr(q0 + 1, q1 - q0 - 1), std::strtod(text.c_str() + text.find(':', t) + 1, nullptr));
+        pos = t;
+    }
+    return true;
+}
+
+static int compare_results(const std::string &old_path, const std::string &new_path, double threshold)
+{
+    std::vector<std::pair<std::string, double>> before, after;
+    if (!read_results(old_path, before) || !read_results(new_path, after))
+        return 1;
+    int slower = 0;
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(14) << "old" << std::setw(14) << "new" << std::setw(10) << "change" << std::endl;
+    for (const auto &a : after)
+    {
+        auto b = std::find_if(before.begin(), before.end(), [&](const std::pair<std::string, double> &p)
+                              { return p.first == a.first; });
+        if (b == before.end() || b->second <= 0.0)
+        {
+            std::cout << std::left << std::setw(44) << a.first << std::right << std::setw(14) << "-" << std::setw(14) << a.second << "   (new)" << std::endl;
+            continue;
+        }
+        double change = a.second / b->second - 1.0;
+        bool bad = change > threshold;
+        slower += bad;
+        char pct[32];
+        snprintf(pct, sizeof(pct), "%+.1f%%", 100.0 * change);
+        std::cout << std::left << std::setw(44) << a.first << std::right << std::setw(14) << b->second << std::setw(14) << a.second
+                  << std::setw(10) << pct << (bad ? "  SLOWER" : "") << std::endl;
+    }
+    std::cout << slower << " case(s) slower by more than " << 100.0 * threshold << "%" << std::endl;
+    return slower ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && std::string(argv[1]) == "compare")
+    {
+        if (argc < 4)
+        {
+            std::cout << "Usage: " << argv[0] << " compare <old.json> <new.json> [threshold 0.10]" << std::endl;
+            return 1;
+        }
+        return compare_results(argv[2], argv[3], argc > 4 ? std::stod(argv[4]) : 0.10);
+    }
+    SuiteOptions opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--json" && i + 1 < argc)
+            opt.json_path = argv[++i];
+        else if (a == "--min-time" && i + 1 < argc)
+            opt.min_time = std::stod(argv[++i]);
+        else if (a == "--filter" && i + 1 < argc)
+            opt.filter = argv[++i];
+        else if (a == "--video" && i + 1 < argc)
+            opt.video = argv[++i];
+        else if (a == "--images" && i + 1 < argc)
+            opt.images = argv[++i];
+        else if (a == "--backend" && i + 1 < argc)
+            opt.backend = argv[++i];
+        else if (a == "--model" && i + 1 < argc)
+            opt.model = argv[++i];
+        else if (a == "--frames" && i + 1 < argc)
+            opt.e2e_frames = std::max(1, std::stoi(argv[++i]));
+        else if (a == "--classes" && i + 1 < argc)
+            opt.num_classes = std::max(1, std::stoi(argv[++i]));
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--json out.json] [--min-time 0.5] [--filter substr] [--video test_video.mp4] [--images input_photos]"
+                      << " [--backend stub|dnn] [--model best.onnx] [--frames 300] [--classes 4]" << std::endl;
+            std::cout << "       " << argv[0] << " compare <old.json> <new.json> [threshold 0.10]" << std::endl;
+            return a == "--help" || a == "-h" ? 0 : 1;
+        }
+    }
+    return run_suite(opt, argv[0]);
+}
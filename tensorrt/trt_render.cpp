@@ -0,0 +1,313 @@
+// Renders annotated output from a detection log (trt_batch_infer --det-log)
+// and the original video, without the model: the annotated video and/or one
+// clip per alarm event, with its own alarm classes, label filter and size.
+//
+// The log is read first (mapped, no decoding) to find which frames are needed:
+// with only --clips, frames outside every clip window are grab()bed, never
+// decoded to images, and rendering stops after the last window.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "alarm.hpp"
+#include "annotate.hpp"
+#include "detection.hpp"
+#include "detection_log.hpp"
+#include "frame_sink.hpp"
+#include "video_output.hpp"
+
+// frames [first, last] of one alarm clip
+struct ClipWindow
+{
+    size_t first = 0, last = 0;
+    size_t event_frame = 0;
+    double event_time = 0.0;
+};
+
+// Replays the alarm debouncing of trt_batch_infer over the inferred records and
+// returns the clip windows around the events, merged where they overlap.
+static std::vector<ClipWindow> find_clip_windows(const DetectionLog &log, AlarmEngine &alarms, double fps, double pre_sec, double post_sec)
+{
+    std::vector<ClipWindow> windows;
+    FrameWriter no_writer(1); // unused: evidence images are off
+    cv::Mat no_frame;
+    std::vector<Detection> dets;
+    const size_t pre = (size_t)std::llround(pre_sec * fps), post = (size_t)std::llround(post_sec * fps);
+    for (size_t i = 0; i < log.size(); ++i)
+    {
+        ResultRecordHeader h = log.record(i, dets);
+        if (!(h.flags & kResultDetected) || alarms.update(dets, no_frame, (size_t)h.frame, h.time_sec, true, no_writer) == 0)
+            continue;
+        ClipWindow w;
+        w.first = h.frame > pre ? (size_t)h.frame - pre : 0;
+        w.last = (size_t)h.frame + post;
+        w.event_frame = (size_t)h.frame;
+        w.event_time = h.time_sec;
+        if (!windows.empty() && w.first <= windows.back().last + 1)
+            windows.back().last = std::max(windows.back().last, w.last);
+        else
+            windows.push_back(w);
+    }
+    return windows;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <det.log> [video] [--out-video path] [--clips dir] [--names names.txt] [--alarm-classes no_vest,head] [--alarm-k 3] [--alarm-n 5] [--alarm-repeat-sec 30] [--clip-pre-sec 3] [--clip-post-sec 5] [--scale 1.0] [--size WxH] [--min-score 0] [--start-sec 0] [--end-sec 0] [--log-level 0|1|2]" << std::endl;
+        std::cout << "  video defaults to the input recorded in the log; at least one of --out-video / --clips" << std::endl;
+        return 1;
+    }
+    std::string log_path = argv[1];
+    std::string video_path;
+    std::string out_video_path, clips_dir, names_path;
+    AlarmConfig alarm_cfg;
+    alarm_cfg.save_frame = false;
+    alarm_cfg.save_crop = false;
+    double pre_sec = 3.0, post_sec = 5.0;
+    double scale = 1.0;
+    int out_w = 0, out_h = 0;
+    float min_score = 0.0f;
+    double start_sec = 0.0, end_sec = 0.0;
+    int log_level = 1;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--out-video" && i + 1 < argc)
+            out_video_path = argv[++i];
+        else if (a == "--clips" && i + 1 < argc)
+            clips_dir = argv[++i];
+        else if (a == "--names" && i + 1 < argc)
+            names_path = argv[++i];
+        else if (a == "--alarm-classes" && i + 1 < argc)
+            alarm_cfg.classes = parse_class_list(argv[++i]);
+        else if (a == "--alarm-k" && i + 1 < argc)
+            alarm_cfg.k = std::stoi(argv[++i]);
+        else if (a == "--alarm-n" && i + 1 < argc)
+            alarm_cfg.n = std::stoi(argv[++i]);
+        else if (a == "--alarm-repeat-sec" && i + 1 < argc)
+            alarm_cfg.repeat_sec = std::stod(argv[++i]);
+        else if (a == "--clip-pre-sec" && i + 1 < argc)
+            pre_sec = std::max(0.0, std::stod(argv[++i]));
+        else if (a == "--clip-post-sec" && i + 1 < argc)
+            post_sec = std::max(0.0, std::stod(argv[++i]));
+        else if (a == "--scale" && i + 1 < argc)
+            scale = std::stod(argv[++i]);
+        else if (a == "--size" && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &out_w, &out_h);
+        else if (a == "--min-score" && i + 1 < argc)
+            min_score = std::stof(argv[++i]);
+        else if (a == "--start-sec" && i + 1 < argc)
+            start_sec = std::stod(argv[++i]);
+        else if (a == "--end-sec" && i + 1 < argc)
+            end_sec = std::stod(argv[++i]);
+        else if (a == "--log-level" && i + 1 < argc)
+            log_level = std::stoi(argv[++i]);
+        else if (a.rfind("--", 0) != 0 && video_path.empty())
+            video_path = a;
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << a << std::endl;
+            return 1;
+        }
+    }
+    if (out_video_path.empty() && clips_dir.empty())
+    {
+        std::cerr << "Nothing to render: give --out-video and/or --clips" << std::endl;
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    DetectionLog log;
+    std::string error;
+    if (!log.open(log_path, error))
+    {
+        std::cerr << error << std::endl;
+        return 2;
+    }
+    if (log.size() == 0)
+    {
+        std::cerr << log_path << ": no frames logged" << std::endl;
+        return 2;
+    }
+    if (video_path.empty())
+        video_path = log.source();
+    std::vector<std::string> class_names = log.class_names();
+    if (!names_path.empty())
+    {
+        class_names.clear();
+        std::ifstream nf(names_path);
+        std::string line;
+        while (std::getline(nf, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                class_names.push_back(line);
+        }
+    }
+
+    cv::VideoCapture cap(video_path);
+    if (!cap.isOpened())
+    {
+        std::cerr << "Failed to open video: " << video_path << std::endl;
+        return 2;
+    }
+    double fps = cap.get(cv::CAP_PROP_FPS);
+    if (!(fps > 1.0))
+        fps = log.fps() > 1.0 ? log.fps() : 25.0;
+    size_t last_logged = (size_t)log.entry(log.size() - 1).frame;
+    size_t first_frame = (size_t)std::llround(std::max(0.0, start_sec) * fps);
+    size_t last_frame = end_sec > 0.0 ? std::min(last_logged, (size_t)std::llround(end_sec * fps)) : last_logged;
+
+    AlarmEngine alarms;
+    std::vector<ClipWindow> windows;
+    if (!clips_dir.empty())
+    {
+        std::filesystem::create_directories(clips_dir);
+        std::filesystem::remove(clips_dir + "/events.jsonl"); // events of this render only
+    }
+    alarms.configure(alarm_cfg, class_names, video_path, clips_dir.empty() ? "." : clips_dir, clips_dir.empty() ? 0 : log_level, "");
+    if (!clips_dir.empty())
+    {
+        windows = find_clip_windows(log, alarms, fps, pre_sec, post_sec);
+        // clips inside the requested range only
+        windows.erase(std::remove_if(windows.begin(), windows.end(), [&](const ClipWindow &w)
+                                     { return w.last < first_frame || w.first > last_frame; }),
+                      windows.end());
+        alarms.close();
+    }
+    if (out_video_path.empty())
+    {
+        if (windows.empty())
+        {
+            if (log_level >= 1)
+                std::cout << "No alarm events in " << log_path << ", no clips written" << std::endl;
+            return 0;
+        }
+        first_frame = std::max(first_frame, windows.front().first);
+        last_frame = std::min(last_frame, windows.back().last);
+    }
+    if (log_level >= 1)
+        std::cout << "Log: " << log.size() << " frames of " << video_path << " (" << log.source() << "), " << class_names.size() << " classes"
+                  << (clips_dir.empty() ? "" : ", " + std::to_string(windows.size()) + " clips") << ", rendering frames " << first_frame
+                  << ".." << last_frame << std::endl;
+
+    auto is_alarm = [&alarms](int class_id)
+    { return alarms.is_alarm_class(class_id); };
+    cv::VideoWriter out_video, clip;
+    size_t next_window = 0;
+    bool in_clip = false;
+    cv::Mat frame, resized;
+    cv::Size out_size;
+    std::vector<Detection> dets, shown;
+    size_t cursor = 0; // index entry at or after the current frame
+    size_t decoded = 0, grabbed = 0, written = 0, clips = 0;
+    for (size_t fi = 0; fi <= last_frame; ++fi)
+    {
+        while (next_window < windows.size() && windows[next_window].last < fi)
+            ++next_window;
+        bool want_clip = next_window < windows.size() && windows[next_window].first <= fi;
+        bool want_video = !out_video_path.empty() && fi >= first_frame;
+        if (!want_clip && !want_video)
+        {
+            if (!cap.grab())
+                break;
+            ++grabbed;
+            continue;
+        }
+        if (!cap.read(frame) || frame.empty())
+            break;
+        ++decoded;
+
+        cv::Mat *out = &frame;
+        double sx = 1.0, sy = 1.0;
+        if (out_w > 0 && out_h > 0)
+        {
+            sx = (double)out_w / frame.cols;
+            sy = (double)out_h / frame.rows;
+        }
+        else if (scale != 1.0 && scale > 0.0)
+            sx = sy = scale;
+        if (sx != 1.0 || sy != 1.0)
+        {
+            cv::resize(frame, resized, cv::Size((int)std::lround(frame.cols * sx), (int)std::lround(frame.rows * sy)), 0, 0, cv::INTER_AREA);
+            out = &resized;
+        }
+
+        // boxes logged for this frame (frames the run never output have none)
+        while (cursor < log.size() && log.entry(cursor).frame < fi)
+            ++cursor;
+        shown.clear();
+        if (cursor < log.size() && log.entry(cursor).frame == fi)
+        {
+            log.record(cursor, dets);
+            for (Detection d : dets)
+            {
+                if (d.score < min_score)
+                    continue;
+                d.x1 = (float)(d.x1 * sx);
+                d.y1 = (float)(d.y1 * sy);
+                d.x2 = (float)(d.x2 * sx);
+                d.y2 = (float)(d.y2 * sy);
+                shown.push_back(d);
+            }
+        }
+        draw_detections(*out, shown, class_names, is_alarm);
+        if (out_size.width == 0)
+            out_size = out->size();
+
+        if (want_video)
+        {
+            if (!out_video.isOpened() && !try_open_video_writer(out_video, out_video_path, fps, out_size, log_level))
+                return 8;
+            out_video.write(*out);
+            ++written;
+        }
+        if (want_clip && !in_clip)
+        {
+            const ClipWindow &w = windows[next_window];
+            char name[4096];
+            snprintf(name, sizeof(name), "%s/clip_t%06.0f_f%06zu.mp4", clips_dir.c_str(), w.event_time, w.event_frame + 1);
+            if (!try_open_video_writer(clip, name, fps, out_size, log_level - 1))
+                return 8;
+            in_clip = true;
+            ++clips;
+        }
+        if (in_clip)
+        {
+            clip.write(*out);
+            if (fi == windows[next_window].last)
+            {
+                clip.release();
+                in_clip = false;
+            }
+        }
+    }
+    if (clip.isOpened())
+        clip.release();
+    if (out_video.isOpened())
+        out_video.release();
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (log_level >= 1)
+    {
+        std::cout << "Rendered " << decoded << " frames (" << grabbed << " skipped without decoding) in " << sec << " s, "
+                  << (decoded + grabbed) / std::max(1e-9, sec) << " frames/s";
+        if (!out_video_path.empty())
+            std::cout << "; video " << out_video_path << " (" << written << " frames)";
+        if (!clips_dir.empty())
+            std::cout << "; " << clips << " clips and events.jsonl in " << clips_dir;
+        std::cout << std::endl;
+    }
+    return 0;
+}
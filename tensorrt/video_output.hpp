@@ -0,0 +1,149 @@
+#pragma once
+// Output video writers.
+//
+// LiveVideoWriter encodes a live stream straight into the output file. The
+// container is constant frame rate (cv::VideoWriter), so the rate is measured
+// from the first frames' arrival times and every later frame is placed by its
+// own timestamp: a frame arriving late repeats the previous one, a frame
+// arriving early is dropped. Playback duration therefore matches wall-clock
+// capture time even when the camera's real rate differs from what it reports.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+inline bool try_open_video_writer(cv::VideoWriter &wri, const std::string &path, double fps, cv::Size size, int log_level)
+{
+    // Candidate codecs (FourCC) to try in order of preference
+    std::vector<std::pair<std::string, int>> cands = {
+        {"libx264(avc1)", cv::VideoWriter::fourcc('a', 'v', 'c', '1')},
+        {"libx264(X264)", cv::VideoWriter::fourcc('X', '2', '6', '4')},
+        {"H264", cv::VideoWriter::fourcc('H', '2', '6', '4')},
+        {"mp4v", cv::VideoWriter::fourcc('m', 'p', '4', 'v')},
+        {"MJPG", cv::VideoWriter::fourcc('M', 'J', 'P', 'G')}};
+    for (auto &p : cands)
+    {
+        const std::string &name = p.first;
+        int fourcc = p.second;
+        wri.open(path, fourcc, fps, size);
+        if (wri.isOpened())
+        {
+            if (log_level >= 1)
+                std::cout << "Opened video writer with codec: " << name << " for file: " << path << std::endl;
+            return true;
+        }
+    }
+    std::cerr << "Failed to open any video codec for: " << path << std::endl;
+    return false;
+}
+
+class LiveVideoWriter
+{
+public:
+    // The rate is estimated over the first `prebuf_target` frames or `prebuf_seconds`,
+    // whichever comes first; those frames are held in memory until the file is opened.
+    LiveVideoWriter(std::string path, int log_level, size_t prebuf_target = 30, double prebuf_seconds = 1.0)
+        : path_(std::move(path)), log_level_(log_level), prebuf_target_(std::max<size_t>(2, prebuf_target)), prebuf_seconds_(prebuf_seconds)
+    {
+    }
+
+    // `t_sec`: arrival time of the frame, any origin, non-decreasing.
+    void write(const cv::Mat &frame, double t_sec)
+    {
+        if (failed_)
+            return;
+        if (!writer_.isOpened())
+        {
+            prebuf_frames_.emplace_back(frame.clone(), t_sec);
+            double span = t_sec - prebuf_frames_.front().second;
+            if (prebuf_frames_.size() >= prebuf_target_ || span >= prebuf_seconds_)
+                start();
+            return;
+        }
+        place(frame, t_sec);
+    }
+
+    // Flush the prebuffer if the stream ended early and close the file.
+    void close()
+    {
+        if (!writer_.isOpened() && !prebuf_frames_.empty() && !failed_)
+            start();
+        if (writer_.isOpened())
+        {
+            writer_.release();
+            if (log_level_ >= 1)
+                std::cout << "Live video " << path_ << ": " << written_ << " frames at " << fps_ << " fps ("
+                          << duplicated_ << " repeated, " << dropped_ << " dropped)" << std::endl;
+        }
+    }
+
+    double fps() const { return fps_; }
+    uint64_t written() const { return written_; }
+    uint64_t duplicated() const { return duplicated_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    void start()
+    {
+        // measured rate over the prebuffer; a single frame gives no interval, fall back to 25
+        size_t n = prebuf_frames_.size();
+        double span = prebuf_frames_.back().second - prebuf_frames_.front().second;
+        fps_ = (n >= 2 && span > 0.0) ? (n - 1) / span : 25.0;
+        fps_ = std::min(120.0, std::max(1.0, fps_));
+        t0_ = prebuf_frames_.front().second;
+        if (log_level_ >= 1)
+            std::cout << "Measured capture rate " << fps_ << " fps over " << n << " frames, encoding to " << path_ << std::endl;
+        const cv::Mat &first = prebuf_frames_.front().first;
+        if (!try_open_video_writer(writer_, path_, fps_, cv::Size(first.cols, first.rows), log_level_))
+        {
+            failed_ = true;
+            prebuf_frames_.clear();
+            return;
+        }
+        for (auto &f : prebuf_frames_)
+            place(f.first, f.second);
+        prebuf_frames_.clear();
+        prebuf_frames_.shrink_to_fit();
+    }
+
+    // Constant-rate placement: output frame k shows whatever arrived last at t0 + k / fps.
+    void place(const cv::Mat &frame, double t_sec)
+    {
+        int64_t slot = (int64_t)std::llround((t_sec - t0_) * fps_);
+        if (slot < next_slot_)
+        {
+            ++dropped_;
+            return;
+        }
+        // bound the fill after a long stall (e.g. reconnect) to a few seconds
+        int64_t gap = std::min<int64_t>(slot - next_slot_, (int64_t)(fps_ * 5.0));
+        for (int64_t k = 0; k < gap && !last_.empty(); ++k)
+        {
+            writer_.write(last_);
+            ++written_;
+            ++duplicated_;
+        }
+        next_slot_ = slot;
+        writer_.write(frame);
+        ++written_;
+        ++next_slot_;
+        last_ = frame; // shared, not copied: frames are not drawn into after output
+    }
+
+    std::string path_;
+    int log_level_;
+    size_t prebuf_target_;
+    double prebuf_seconds_;
+    std::vector<std::pair<cv::Mat, double>> prebuf_frames_;
+    cv::VideoWriter writer_;
+    cv::Mat last_;
+    double fps_ = 0.0, t0_ = 0.0;
+    int64_t next_slot_ = 0;
+    uint64_t written_ = 0, duplicated_ = 0, dropped_ = 0;
+    bool failed_ = false;
+};
@@ -0,0 +1,200 @@
+#pragma once
+// Decoder for the YOLOv8-style combined "output" tensor laid out as [4 + num_classes, L]
+// (cx, cy, w, h rows followed by one score row per class, anchors contiguous).
+//
+// Instead of walking every anchor column with a stride of L floats, the class
+// maximum is computed row by row over tiles of contiguous anchors (SIMD lanes
+// = anchors), candidates below the threshold are rejected before any box row
+// is touched, and survivors are mapped back through the letterbox inverse
+// (computed once per frame size) into a preallocated DetectionBuffer.
+// Results are identical to the original per-anchor loop.
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "detection.hpp"
+#include "letterbox.hpp"
+
+// Per-thread scratch: running best score / class per anchor.
+struct YoloDecodeScratch
+{
+    std::vector<float> best_score;
+    std::vector<int> best_class;
+};
+
+namespace yolo_detail
+{
+    constexpr int kAnchorTile = 512; // best_score/best_class tile stays in L1 while classes stream by
+
+    // best[i], cls[i] = max / first argmax over class rows for anchors [i0, i1)
+    inline void class_max_tile(const float *scores, int num_classes, int L, int i0, int i1,
+                               float *best, int *cls)
+    {
+        std::fill(best + i0, best + i1, -1e9f);
+        std::fill(cls + i0, cls + i1, -1);
+        for (int c = 0; c < num_classes; ++c)
+        {
+            const float *row = scores + (size_t)c * L;
+            int i = i0;
+#if defined(__AVX2__)
+            const __m256i vc = _mm256_set1_epi32(c);
+            for (; i + 8 <= i1; i += 8)
+            {
+                __m256 s = _mm256_loadu_ps(row + i);
+                __m256 b = _mm256_loadu_ps(best + i);
+                __m256 gt = _mm256_cmp_ps(s, b, _CMP_GT_OQ);
+                _mm256_storeu_ps(best + i, _mm256_blendv_ps(b, s, gt));
+                __m256i k = _mm256_loadu_si256((const __m256i *)(cls + i));
+                k = _mm256_blendv_epi8(k, vc, _mm256_castps_si256(gt));
+                _mm256_storeu_si256((__m256i *)(cls + i), k);
+            }
+#elif defined(__SSE2__)
+            // baseline x86-64: no blendv, select with and/andnot/or
+            const __m128i vc = _mm_set1_epi32(c);
+            for (; i + 4 <= i1; i += 4)
+            {
+                __m128 s = _mm_loadu_ps(row + i);
+                __m128 b = _mm_loadu_ps(best + i);
+                __m128 gt = _mm_cmpgt_ps(s, b);
+                _mm_storeu_ps(best + i, _mm_or_ps(_mm_and_ps(gt, s), _mm_andnot_ps(gt, b)));
+                __m128i m = _mm_castps_si128(gt);
+                __m128i k = _mm_loadu_si128((const __m128i *)(cls + i));
+                _mm_storeu_si128((__m128i *)(cls + i), _mm_or_si128(_mm_and_si128(m, vc), _mm_andnot_si128(m, k)));
+            }
+#elif defined(__ARM_NEON)
+            const int32x4_t vc = vdupq_n_s32(c);
+            for (; i + 4 <= i1; i += 4)
+            {
+                float32x4_t s = vld1q_f32(row + i);
+                float32x4_t b = vld1q_f32(best + i);
+                uint32x4_t gt = vcgtq_f32(s, b);
+                vst1q_f32(best + i, vbslq_f32(gt, s, b));
+                vst1q_s32(cls + i, vbslq_s32(gt, vc, vld1q_s32(cls + i)));
+            }
+#endif
+            for (; i < i1; ++i)
+            {
+                if (row[i] > best[i])
+                {
+                    best[i] = row[i];
+                    cls[i] = c;
+                }
+            }
+        }
+    }
+
+    // Scores outside [-0.5, 1.5] are treated as logits (same heuristic as before).
+    inline float to_probability(float s)
+    {
+        if (s > 1.5f || s < -0.5f)
+            s = 1.0f / (1.0f + std::exp(-s));
+        return s;
+    }
+
+    // Smallest raw score that can survive to_probability() >= conf_thresh; used to
+    // reject whole SIMD lanes before the exact check. Slightly conservative.
+    inline float raw_reject_below(float conf_thresh)
+    {
+        if (!(conf_thresh > 0.0f))
+            return -std::numeric_limits<float>::infinity();
+        float lb = std::min(conf_thresh, 1.5f);
+        if (conf_thresh < 1.0f)
+            lb = std::min(lb, std::log(conf_thresh / (1.0f - conf_thresh)) - 1e-3f);
+        return lb;
+    }
+} // namespace yolo_detail
+
+// Decode one image's output. `out` points to (4 + num_classes) * L floats, `lb` is the
+// letterbox plan used to build the input. Survivors are appended to `dets` after clear().
+inline void decode_yolo_output(const float *out, int C, int L, const LetterboxPlan &lb, float conf_thresh,
+                               YoloDecodeScratch &scratch, DetectionBuffer &dets)
+{
+    dets.clear();
+    if (C <= 4 || L <= 0)
+        return;
+    int num_classes = C - 4;
+    dets.reserve((size_t)L);
+    if (scratch.best_score.size() < (size_t)L)
+    {
+        scratch.best_score.resize(L);
+        scratch.best_class.resize(L);
+    }
+    float *best = scratch.best_score.data();
+    int *cls = scratch.best_class.data();
+    const float *rows_cx = out, *rows_cy = out + L, *rows_w = out + 2 * (size_t)L, *rows_h = out + 3 * (size_t)L;
+    const float *scores = out + 4 * (size_t)L;
+
+    // letterbox inverse, hoisted out of the anchor loop
+    const float r = lb.r, pad_x = lb.pad_x, pad_y = lb.pad_y;
+    const float reject_below = yolo_detail::raw_reject_below(conf_thresh);
+
+    auto emit = [&](int i)
+    {
+        float s = yolo_detail::to_probability(best[i]);
+        if (s < conf_thresh)
+            return;
+        float cx = rows_cx[i], cy = rows_cy[i], w = rows_w[i], h = rows_h[i];
+        float x1 = (cx - w / 2.0f - pad_x) / r;
+        float y1 = (cy - h / 2.0f - pad_y) / r;
+        float x2 = (cx + w / 2.0f - pad_x) / r;
+        float y2 = (cy + h / 2.0f - pad_y) / r;
+        dets.push(x1, y1, x2, y2, s, cls[i]);
+    };
+
+    for (int t0 = 0; t0 < L; t0 += yolo_detail::kAnchorTile)
+    {
+        int t1 = std::min(L, t0 + yolo_detail::kAnchorTile);
+        yolo_detail::class_max_tile(scores, num_classes, L, t0, t1, best, cls);
+
+        int i = t0;
+#if defined(__AVX2__)
+        const __m256 vlb = _mm256_set1_ps(reject_below);
+        for (; i + 8 <= t1; i += 8)
+        {
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(best + i), vlb, _CMP_GE_OQ));
+            while (mask)
+            {
+                int lane = __builtin_ctz(mask);
+                emit(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128 vlb = _mm_set1_ps(reject_below);
+        for (; i + 4 <= t1; i += 4)
+        {
+            int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(best + i), vlb));
+            while (mask)
+            {
+                int lane = __builtin_ctz(mask);
+                emit(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const float32x4_t vlb = vdupq_n_f32(reject_below);
+        for (; i + 4 <= t1; i += 4)
+        {
+            if (vmaxvq_u32(vcgeq_f32(vld1q_f32(best + i), vlb)) == 0)
+                continue;
+            for (int k = 0; k < 4; ++k)
+                if (best[i + k] >= reject_below)
+                    emit(i + k);
+        }
+#endif
+        for (; i < t1; ++i)
+        {
+            if (best[i] >= reject_below)
+                emit(i);
+        }
+    }
+}